@@ -0,0 +1,263 @@
+/**
+ * Implement the allocator interface; see 'alloc.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "debug.h"
+#include "alloc.h"
+
+/**
+ * The default size of the chunks of an arena
+ */
+#define ARENA_DEFAULT_CHUNK 65536
+
+/**
+ * The alignment of every block allocated from an arena
+ */
+#define ARENA_ALIGNMENT _Alignof ( max_align_t )
+
+/**
+ * A chunk of an arena, chained to the next chunk
+ */
+struct arena_chunk {
+    /**
+     * The next chunk in the chain, or NULL if this is the last chunk
+     */
+    struct arena_chunk * next;
+
+    /**
+     * The capacity of the chunk, in bytes
+     */
+    size_t size;
+
+    /**
+     * The bytes of the chunk, allocated in-line with the chunk
+     */
+    _Alignas ( max_align_t ) unsigned char data [ ];
+};
+
+/**
+ * The transparent arena
+ */
+struct arena {
+    /**
+     * The first chunk of the chain
+     */
+    struct arena_chunk * head;
+
+    /**
+     * The chunk from which blocks are currently being allocated
+     */
+    struct arena_chunk * current;
+
+    /**
+     * The number of bytes of the current chunk in use
+     */
+    size_t used;
+
+    /**
+     * The most recent block, which may be grown in place or rolled back, or
+     * NULL if it has been freed
+     */
+    unsigned char * last;
+
+    /**
+     * The size of each new chunk
+     */
+    size_t chunk;
+};
+
+/**
+ * The functions of the standard allocator, which defer to the C library
+ */
+static void * standard_alloc ( void * context, size_t size )
+{
+    ( void ) context;
+    return malloc ( size );
+}
+
+static void * standard_realloc ( void * context, void * ptr, size_t old_size,
+        size_t size )
+{
+    ( void ) context;
+    ( void ) old_size;
+    return realloc ( ptr, size );
+}
+
+static void standard_free ( void * context, void * ptr, size_t size )
+{
+    ( void ) context;
+    ( void ) size;
+    free ( ptr );
+}
+
+const struct allocator * allocator_standard ( void )
+{
+    static const struct allocator standard = {
+        .alloc   = standard_alloc,
+        .realloc = standard_realloc,
+        .free    = standard_free,
+        .context = NULL,
+    };
+
+    return &standard;
+}
+
+/**
+ * Round a size up to the alignment of the blocks of an arena.
+ *
+ * @param size the size
+ * @return the rounded size
+ */
+static inline size_t align ( size_t size )
+{
+    return ( size + ARENA_ALIGNMENT - 1 ) &
+        ~ ( size_t ) ( ARENA_ALIGNMENT - 1 );
+}
+
+/**
+ * Move the arena on to a chunk with room for a block of the given size. The
+ * next chunk of the chain is reused if it is large enough; otherwise, a new
+ * chunk is allocated and linked in before it.
+ *
+ * @param self the arena
+ * @param size the aligned size of the block
+ * @return the ability to allocate the block
+ */
+static bool advance_chunk ( struct arena * self, size_t size )
+{
+    struct arena_chunk * chunk = self->current ? self->current->next :
+        self->head;
+    const size_t capacity = ( size > self->chunk ) ? size : self->chunk;
+
+    if ( !chunk || chunk->size < size ) {
+        if ( ! ( chunk = malloc ( sizeof ( struct arena_chunk ) +
+                capacity ) ) )
+            return false;
+
+        chunk->size = capacity;
+
+        if ( self->current ) {
+            chunk->next = self->current->next;
+            self->current->next = chunk;
+        } else {
+            chunk->next = self->head;
+            self->head = chunk;
+        }
+
+        debug_puts ( "Arena grown" );
+    }
+
+    self->current = chunk;
+    self->used = 0;
+
+    return true;
+}
+
+/**
+ * The functions of the arena allocator; see 'struct allocator'
+ */
+static void * arena_alloc ( void * context, size_t size )
+{
+    struct arena * self = context;
+
+    size = align ( size );
+
+    if ( ( !self->current || self->current->size - self->used < size ) &&
+            !advance_chunk ( self, size ) )
+        return NULL;
+
+    self->last = self->current->data + self->used;
+    self->used += size;
+
+    return self->last;
+}
+
+static void * arena_realloc ( void * context, void * ptr, size_t old_size,
+        size_t size )
+{
+    struct arena * self = context;
+    size_t start;
+    void * block;
+
+    /* The most recent block is resized in place, where the chunk has room */
+    if ( ptr && ptr == self->last ) {
+        start = ( size_t ) ( self->last - self->current->data );
+
+        if ( self->current->size - start >= align ( size ) ) {
+            self->used = start + align ( size );
+            return ptr;
+        }
+    }
+
+    if ( ( block = arena_alloc ( self, size ) ) && ptr && old_size )
+        memcpy ( block, ptr, ( old_size < size ) ? old_size : size );
+
+    return block;
+}
+
+static void arena_free ( void * context, void * ptr, size_t size )
+{
+    struct arena * self = context;
+
+    ( void ) size;
+
+    /* Only the most recent block can be returned to the arena */
+    if ( ptr && ptr == self->last ) {
+        self->used = ( size_t ) ( self->last - self->current->data );
+        self->last = NULL;
+    }
+}
+
+struct arena * arena_initialise ( size_t chunk )
+{
+    struct arena * self;
+
+    if ( ( self = malloc ( sizeof ( struct arena ) ) ) ) {
+        self->head = self->current = NULL;
+        self->used = 0;
+        self->last = NULL;
+        self->chunk = chunk ? align ( chunk ) : ARENA_DEFAULT_CHUNK;
+        debug_puts ( "Arena initialised" );
+    }
+
+    return self;
+}
+
+void arena_destruct ( struct arena * self )
+{
+    struct arena_chunk * chunk, * next;
+
+    if ( self ) {
+        for ( chunk = self->head; chunk; chunk = next ) {
+            next = chunk->next;
+            free ( chunk );
+        }
+
+        free ( self );
+        debug_puts ( "Arena destructed" );
+    }
+}
+
+void arena_reset ( struct arena * self )
+{
+    self->current = self->head;
+    self->used = 0;
+    self->last = NULL;
+}
+
+struct allocator arena_allocator ( struct arena * self )
+{
+    return ( struct allocator ) {
+        .alloc   = arena_alloc,
+        .realloc = arena_realloc,
+        .free    = arena_free,
+        .context = self,
+    };
+}
@@ -0,0 +1,147 @@
+/**
+ * This interface abstracts the dynamic allocator beneath the node pools, the
+ * stacks, and the expressions, so that callers may supply their own, such as an
+ * arena per request, or an arena backed by huge pages. An allocator is a table
+ * of three functions, in the manner of malloc(3), realloc(3), and free(3), and
+ * a context that is passed to each of them. The functions that resize or free
+ * an allocation are also given its size, which the standard allocator ignores,
+ * but which spares simpler allocators from recording it. Wherever an allocator
+ * is accepted, NULL selects the standard allocator, which is the C library.
+ *
+ * This interface also provides a bump arena, which carves its allocations in
+ * order from large chunks. Freeing is a no-op, save for the most recent
+ * allocation, which is rolled back, as is growing the most recent allocation
+ * done in place. The whole arena is reset in constant time, and its chunks are
+ * retained and refilled in order, so a caller that resets an arena after each
+ * request reaches a steady state in which no request calls the C library.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+/**
+ * A dynamic allocator
+ */
+struct allocator {
+    /**
+     * Allocate a block of memory, aligned for any type.
+     *
+     * @param context the context of the allocator
+     * @param size the size of the block, which is not zero
+     * @return the block, or NULL on failure
+     */
+    void * ( * alloc ) ( void * context, size_t size );
+
+    /**
+     * Resize a block of memory, preserving its contents up to the lesser size.
+     *
+     * @param context the context of the allocator
+     * @param ptr the block
+     * @param old_size the size of the block
+     * @param size the new size of the block, which is not zero
+     * @return the resized block, or NULL on failure, in which case the original
+     *      block is left untouched
+     */
+    void * ( * realloc ) ( void * context, void * ptr, size_t old_size,
+        size_t size );
+
+    /**
+     * Free a block of memory.
+     *
+     * @param context the context of the allocator
+     * @param ptr the block, or NULL
+     * @param size the size of the block
+     */
+    void ( * free ) ( void * context, void * ptr, size_t size );
+
+    /**
+     * The context of the allocator, passed to each of its functions
+     */
+    void * context;
+};
+
+/**
+ * The base opaque type of a bump arena
+ */
+struct arena;
+
+/**
+ * Retrieve the standard allocator, which is the C library.
+ *
+ * @return the standard allocator
+ */
+const struct allocator * allocator_standard ( void );
+
+/**
+ * Resolve an allocator given to an initialiser, which may be NULL.
+ *
+ * @param self the allocator, or NULL for the standard allocator
+ * @return the allocator
+ */
+static inline const struct allocator * allocator_resolve (
+        const struct allocator * self )
+{
+    return self ? self : allocator_standard ( );
+}
+
+/**
+ * Call the functions of an allocator, as described by 'struct allocator'.
+ *
+ * @param self the allocator
+ */
+static inline void * allocator_alloc ( const struct allocator * self,
+        size_t size )
+{
+    return self->alloc ( self->context, size );
+}
+
+static inline void * allocator_realloc ( const struct allocator * self,
+        void * ptr, size_t old_size, size_t size )
+{
+    return self->realloc ( self->context, ptr, old_size, size );
+}
+
+static inline void allocator_free ( const struct allocator * self, void * ptr,
+        size_t size )
+{
+    self->free ( self->context, ptr, size );
+}
+
+/**
+ * Initialise a bump arena, whose chunks are taken from the C library.
+ *
+ * @param chunk the size of each chunk, in bytes; a larger allocation takes a
+ *      chunk of its own. If this is zero, a sensible default is assumed.
+ * @return the new arena, or NULL on failure
+ */
+struct arena * arena_initialise ( size_t chunk );
+
+/**
+ * Destruct an arena, and all of its chunks. Every block allocated from the
+ * arena is freed.
+ *
+ * @param self the arena
+ */
+void arena_destruct ( struct arena * self );
+
+/**
+ * Free every block allocated from the arena in constant time. The chunks of the
+ * arena are retained, and refilled in order.
+ *
+ * @param self the arena
+ */
+void arena_reset ( struct arena * self );
+
+/**
+ * Retrieve an allocator whose blocks are allocated from the given arena.
+ *
+ * @param self the arena, which must outlive every block allocated from it
+ * @return the allocator
+ */
+struct allocator arena_allocator ( struct arena * self );
+
+#endif /* ALLOC_H */
@@ -0,0 +1,836 @@
+/**
+ * Implement the batch evaluation interface; see 'batch.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "node.h"
+#include "expr.h"
+#include "debug.h"
+#include "cache.h"
+#include "writer.h"
+#include "stats.h"
+
+#include "batch.h"
+
+/**
+ * The target size of a task, in bytes. Tasks are extended to the end of the
+ * line in which this size is reached.
+ */
+#define BATCH_TASK ( 1U << 18 )
+
+/**
+ * The number of tasks given to each worker per window. Several tasks per worker
+ * give the thieves something to steal.
+ */
+#define BATCH_TASKS_PER_WORKER 16
+
+/**
+ * The white-space characters of the "C" locale; a line of only these is blank
+ */
+#define BATCH_SPACE " \t\n\v\f\r"
+
+/**
+ * The capacity of the prefix given to failure reports
+ */
+#define BATCH_PREFIX_SIZE 32
+
+/* NOTES ON SCHEDULING
+ *
+ * The input is evaluated in windows of whole lines: a mapped file is walked one
+ * window at a time, and streamed input is read one window at a time. Each
+ * window is cut into tasks of roughly BATCH_TASK bytes, again on line
+ * boundaries, and each task writes its results to its own writer over memory.
+ * Once every task of the window is complete, the task writers are appended to
+ * the output in order, so results always appear in input order, and the memory
+ * held for results is bounded by the size of a window.
+ *
+ * The tasks of a window are dealt out to the workers in contiguous runs. Each
+ * worker has a double-ended queue of task indices: the owner takes tasks from
+ * the front of its own queue, and a worker whose queue is empty steals from the
+ * back of another's. A worker that is held up by a few long expressions thereby
+ * loses the rest of its run to idle workers, rather than stalling the window.
+ * Queue operations happen once per task, not per line, so a mutex per queue is
+ * cheap and contention is negligible.
+ *
+ * The calling thread acts as the first worker; the rest are created once, and
+ * wait on a condition variable between windows. Every worker has its own node
+ * pool, expression (with its stacks), and line buffer, so no state is shared
+ * during evaluation. Failure reports are printed directly by the workers, with
+ * absolute line numbers; each report is atomic, but reports from different
+ * tasks may appear out of order.
+ */
+
+/**
+ * The state required to evaluate lines, private to a worker
+ */
+struct batch {
+    /**
+     * The node pool, reset before each line
+     */
+    struct node_pool * pool;
+
+    /**
+     * The expression, reset to each line in turn
+     */
+    struct expression * expr;
+
+    /**
+     * The cache of compiled programs, or NULL if lines are always parsed
+     */
+    struct cache * cache;
+
+    /**
+     * The writer of the results of the current task
+     */
+    struct writer * out;
+
+    /**
+     * A NULL-terminated copy of the current line
+     */
+    char * line;
+
+    /**
+     * The capacity of the line copy, in bytes
+     */
+    size_t line_capacity;
+
+    /**
+     * The number of the line most recently evaluated
+     */
+    unsigned long number;
+
+    /**
+     * The number of lines that could not be evaluated
+     */
+    unsigned long failures;
+};
+
+/**
+ * A run of whole lines, evaluated by a single worker
+ */
+struct task {
+    /**
+     * The beginning of the first line
+     */
+    const char * head;
+
+    /**
+     * The end of the last line
+     */
+    const char * end;
+
+    /**
+     * The number of the line before the first, counting from one
+     */
+    unsigned long first;
+
+    /**
+     * The writer over memory that holds the results of the task
+     */
+    struct writer * out;
+};
+
+struct scheduler;
+
+/**
+ * A worker and its queue of tasks
+ */
+struct worker {
+    /**
+     * The thread of the worker; unused for the first worker
+     */
+    pthread_t thread;
+
+    /**
+     * The scheduler to which the worker belongs
+     */
+    struct scheduler * owner;
+
+    /**
+     * The position of the worker in the scheduler
+     */
+    unsigned int id;
+
+    /**
+     * The evaluation state of the worker
+     */
+    struct batch context;
+
+    /**
+     * The lock that guards the queue
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The index of the task at the front of the queue
+     */
+    unsigned int head;
+
+    /**
+     * The index beyond the task at the back of the queue
+     */
+    unsigned int tail;
+};
+
+/**
+ * The scheduler of the workers
+ */
+struct scheduler {
+    /**
+     * The lock that guards the fields below it
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signalled when a new window is ready, or when the workers must stop
+     */
+    pthread_cond_t start;
+
+    /**
+     * Signalled when the last worker completes a window
+     */
+    pthread_cond_t done;
+
+    /**
+     * The number of windows started so far
+     */
+    unsigned long generation;
+
+    /**
+     * The number of workers yet to complete the current window
+     */
+    unsigned int active;
+
+    /**
+     * Whether the workers must stop
+     */
+    bool stopping;
+
+    /**
+     * The first failure of any worker, as an 'errno' value, or zero
+     */
+    int error;
+
+    /**
+     * The workers
+     */
+    struct worker * workers;
+
+    /**
+     * The number of workers
+     */
+    unsigned int worker_count;
+
+    /**
+     * The number of workers that were started, and must be stopped
+     */
+    unsigned int started;
+
+    /**
+     * The tasks of the current window
+     */
+    struct task * tasks;
+
+    /**
+     * The number of tasks in the current window
+     */
+    unsigned int task_count;
+
+    /**
+     * The number of tasks allocated, each with its own writer
+     */
+    unsigned int task_capacity;
+
+    /**
+     * The number of lines in all previous windows
+     */
+    unsigned long lines;
+
+    /**
+     * The writer of the results
+     */
+    struct writer * out;
+};
+
+/**
+ * Evaluate one line and write its result.
+ *
+ * @param self the evaluation state
+ * @param str the line, without its new-line
+ * @param length the length of the line
+ * @return zero on success, or -1 on an output or allocation failure
+ */
+static int batch_line ( struct batch * self, const char * str, size_t length )
+{
+    const struct program * program;
+    char prefix [ BATCH_PREFIX_SIZE ];
+    enum expr_status status;
+    number_t result;
+    char * line;
+
+    /* The tokeniser expects a NULL-terminated string, which a mapped file
+     * cannot provide in place. */
+    if ( length >= self->line_capacity ) {
+        if ( ! ( line = realloc ( self->line, length + 1 ) ) )
+            return -1;
+
+        self->line = line;
+        self->line_capacity = length + 1;
+    }
+
+    memcpy ( self->line, str, length );
+    self->line [ length ] = '\0';
+    self->number++;
+
+    if ( strspn ( self->line, BATCH_SPACE ) == length )
+        return writer_write ( self->out, "\n", 1 );
+
+    if ( self->cache ) {
+        if ( ( status = cache_compile ( self->cache, self->line, &program ) )
+                == EXPR_OK )
+            return writer_number ( self->out,
+                program_evaluate ( program, NULL ) );
+    } else {
+        pool_reset ( self->pool );
+        expression_reset ( self->expr, self->line );
+
+        if ( ( status = expression_parse ( self->expr, self->pool ) ) ==
+                EXPR_OK && ( status = expression_evaluate ( self->expr,
+                &result ) ) == EXPR_OK )
+            return writer_number ( self->out, result );
+    }
+
+    snprintf ( prefix, sizeof ( prefix ), "Line %lu", self->number );
+    flockfile ( stderr );
+
+    if ( self->cache )
+        cache_perror ( self->cache, prefix, status );
+    else
+        expression_perror ( self->expr, prefix, status );
+
+    funlockfile ( stderr );
+    self->failures++;
+
+    return writer_write ( self->out, "nan\n", 4 );
+}
+
+/**
+ * Evaluate every line of a task.
+ *
+ * @param self the evaluation state
+ * @param task the task
+ * @return zero on success, or -1 on failure
+ */
+static int batch_task ( struct batch * self, struct task * task )
+{
+    const char * head = task->head, * eol;
+
+    self->out = task->out;
+    self->number = task->first;
+
+    for ( ; head < task->end; head = eol + 1 ) {
+        if ( ! ( eol = memchr ( head, '\n',
+                ( size_t ) ( task->end - head ) ) ) )
+            eol = task->end;
+
+        if ( batch_line ( self, head, ( size_t ) ( eol - head ) ) )
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Count the new-lines in a region of memory. The loop is simple enough for the
+ * compiler to vectorise, so this is far cheaper than the evaluation of the
+ * lines it counts.
+ *
+ * @param head the beginning of the region
+ * @param end the end of the region
+ * @return the number of new-lines
+ */
+static unsigned long count_lines ( const char * head, const char * end )
+{
+    unsigned long count = 0;
+
+    for ( ; head < end; head++ )
+        count += ( *head == '\n' );
+
+    return count;
+}
+
+/**
+ * Find the end of the line in which the given position lies.
+ *
+ * @param pos the position
+ * @param end the end of the region
+ * @return the position after the next new-line, or the end of the region
+ */
+static const char * line_end ( const char * pos, const char * end )
+{
+    const char * eol;
+
+    if ( pos >= end )
+        return end;
+
+    return ( eol = memchr ( pos, '\n', ( size_t ) ( end - pos ) ) ) ?
+        eol + 1 : end;
+}
+
+/**
+ * Take the next task for a worker: from the front of its own queue, or failing
+ * that, from the back of the queue of another worker.
+ *
+ * @param self the worker
+ * @return the task, or NULL if there are no tasks left in the window
+ */
+static struct task * take_task ( struct worker * self )
+{
+    struct scheduler * owner = self->owner;
+    struct worker * victim;
+    int index = -1;
+
+    pthread_mutex_lock ( &self->lock );
+    if ( self->head < self->tail )
+        index = ( int ) self->head++;
+    pthread_mutex_unlock ( &self->lock );
+
+    for ( unsigned int i = 1; index < 0 && i < owner->worker_count; i++ ) {
+        victim = & ( owner->workers [ ( self->id + i ) %
+            owner->worker_count ] );
+
+        pthread_mutex_lock ( &victim->lock );
+        if ( victim->head < victim->tail )
+            index = ( int ) --victim->tail;
+        pthread_mutex_unlock ( &victim->lock );
+    }
+
+    return ( index < 0 ) ? NULL : & ( owner->tasks [ index ] );
+}
+
+/**
+ * Run tasks until the window is exhausted, recording the first failure.
+ *
+ * @param self the worker
+ */
+static void run_tasks ( struct worker * self )
+{
+    struct scheduler * owner = self->owner;
+    struct task * task;
+
+    while ( ( task = take_task ( self ) ) )
+        if ( batch_task ( & ( self->context ), task ) ) {
+            pthread_mutex_lock ( &owner->lock );
+            if ( !owner->error )
+                owner->error = errno ? errno : EIO;
+            pthread_mutex_unlock ( &owner->lock );
+        }
+}
+
+/**
+ * The body of every worker but the first: wait for each window, run its tasks,
+ * and report its completion.
+ *
+ * @param arg the worker
+ * @return NULL
+ */
+static void * worker_main ( void * arg )
+{
+    struct worker * self = arg;
+    struct scheduler * owner = self->owner;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock ( &owner->lock );
+
+    for ( ;; ) {
+        while ( owner->generation == seen && !owner->stopping )
+            pthread_cond_wait ( &owner->start, &owner->lock );
+
+        if ( owner->stopping )
+            break;
+
+        seen = owner->generation;
+        pthread_mutex_unlock ( &owner->lock );
+
+        run_tasks ( self );
+
+        /* The counters are folded in before the window is reported complete,
+         * so that they are visible to the caller once the batch returns */
+        stats_flush ( );
+
+        pthread_mutex_lock ( &owner->lock );
+        if ( --owner->active == 0 )
+            pthread_cond_signal ( &owner->done );
+    }
+
+    pthread_mutex_unlock ( &owner->lock );
+    return NULL;
+}
+
+/**
+ * Ensure that the scheduler has room for the given number of tasks, each with
+ * its own writer over memory.
+ *
+ * @param self the scheduler
+ * @param count the number of tasks
+ * @return zero on success, or -1 on failure
+ */
+static int reserve_tasks ( struct scheduler * self, unsigned int count )
+{
+    struct task * tasks;
+
+    if ( count <= self->task_capacity )
+        return 0;
+
+    if ( count < self->task_capacity << 1 )
+        count = self->task_capacity << 1;
+
+    if ( ! ( tasks = realloc ( self->tasks, sizeof ( struct task ) * count ) ) )
+        return -1;
+
+    self->tasks = tasks;
+
+    for ( ; self->task_capacity < count; self->task_capacity++ )
+        if ( ! ( tasks [ self->task_capacity ].out =
+                writer_initialise ( WRITER_MEMORY, BATCH_TASK >> 2 ) ) )
+            return -1;
+
+    return 0;
+}
+
+/**
+ * Evaluate every line of a window, in parallel, and write the results in order.
+ *
+ * @param self the scheduler
+ * @param head the beginning of the window
+ * @param end the end of the window, which must be the end of a line, or the end
+ *      of the input
+ * @return zero on success, or -1 on failure
+ */
+static int run_window ( struct scheduler * self, const char * head,
+        const char * end )
+{
+    unsigned int count = 0, per;
+    const char * stop;
+    struct task * task;
+
+    /* Cut the window into tasks, numbering their lines */
+    for ( ; head < end; head = stop, count++ ) {
+        if ( reserve_tasks ( self, count + 1 ) )
+            return -1;
+
+        stop = ( ( size_t ) ( end - head ) > BATCH_TASK ) ?
+            line_end ( head + BATCH_TASK - 1, end ) : end;
+        task = & ( self->tasks [ count ] );
+        task->head = head;
+        task->end = stop;
+        task->first = self->lines;
+
+        self->lines += count_lines ( head, stop );
+    }
+
+    /* Deal the tasks out in contiguous runs */
+    self->task_count = count;
+    per = count / self->worker_count;
+
+    for ( unsigned int i = 0; i < self->worker_count; i++ ) {
+        self->workers [ i ].head = i * per + ( i < count % self->worker_count ?
+            i : count % self->worker_count );
+        self->workers [ i ].tail = self->workers [ i ].head + per +
+            ( i < count % self->worker_count );
+    }
+
+    pthread_mutex_lock ( &self->lock );
+    self->active = self->worker_count - 1;
+    self->generation++;
+    pthread_cond_broadcast ( &self->start );
+    pthread_mutex_unlock ( &self->lock );
+
+    run_tasks ( & ( self->workers [ 0 ] ) );
+
+    pthread_mutex_lock ( &self->lock );
+    while ( self->active )
+        pthread_cond_wait ( &self->done, &self->lock );
+    pthread_mutex_unlock ( &self->lock );
+
+    if ( self->error ) {
+        errno = self->error;
+        return -1;
+    }
+
+    for ( unsigned int i = 0; i < count; i++ )
+        if ( writer_append ( self->out, self->tasks [ i ].out ) )
+            return -1;
+
+    return 0;
+}
+
+/**
+ * Determine the size of a window: enough tasks to give every worker several.
+ *
+ * @param self the scheduler
+ * @return the size of a window, in bytes
+ */
+static size_t window_size ( struct scheduler * self )
+{
+    return ( size_t ) BATCH_TASK * BATCH_TASKS_PER_WORKER *
+        self->worker_count;
+}
+
+/**
+ * Evaluate every line of a regular file that has been mapped into memory whole,
+ * one window at a time, then unmap it.
+ *
+ * @param self the scheduler
+ * @param map the mapping of the file
+ * @param size the size of the file
+ * @return zero on success, or -1 on failure
+ */
+static int batch_mapped ( struct scheduler * self, char * map, size_t size )
+{
+    const char * head = map, * stop, * const end = map + size;
+    const size_t window = window_size ( self );
+    int status = 0;
+
+    /* A failure of this hint is harmless */
+    ( void ) madvise ( map, size, MADV_SEQUENTIAL );
+
+    for ( ; !status && head < end; head = stop ) {
+        stop = ( ( size_t ) ( end - head ) > window ) ?
+            line_end ( head + window - 1, end ) : end;
+        status = run_window ( self, head, stop );
+    }
+
+    munmap ( map, size );
+    debug_puts ( "Mapped input evaluated" );
+
+    return status;
+}
+
+/**
+ * Evaluate every line read from a file descriptor, one window at a time. The
+ * buffer is filled, every whole line in it is evaluated, and any trailing
+ * partial line is moved to the front of the buffer to be completed by the next
+ * read. The buffer is doubled whenever a single line does not fit.
+ *
+ * @param self the scheduler
+ * @param fd the file descriptor
+ * @return zero on success, or -1 on failure
+ */
+static int batch_streamed ( struct scheduler * self, int fd )
+{
+    size_t capacity = window_size ( self ), held = 0;
+    const char * stop;
+    char * buffer, * grown;
+    bool eof = false;
+    int status = 0;
+    ssize_t got;
+
+    if ( ! ( buffer = malloc ( capacity ) ) )
+        return -1;
+
+    while ( !status && !eof ) {
+        if ( held == capacity ) {
+            if ( ! ( grown = realloc ( buffer, capacity << 1 ) ) ) {
+                status = -1;
+                break;
+            }
+
+            buffer = grown;
+            capacity <<= 1;
+        }
+
+        /* Fill the buffer, so that each window is as large as possible */
+        while ( held < capacity && !eof )
+            if ( ( got = read ( fd, buffer + held, capacity - held ) ) > 0 )
+                held += ( size_t ) got;
+            else if ( !got )
+                eof = true;
+            else if ( errno != EINTR )
+                break;
+
+        if ( held < capacity && !eof ) {
+            status = -1;
+            break;
+        }
+
+        /* Without more input, the final partial line is a whole line */
+        for ( stop = buffer + held; !eof && stop > buffer &&
+                stop [ -1 ] != '\n'; stop-- )
+            ;
+
+        if ( stop > buffer )
+            status = run_window ( self, buffer, stop );
+
+        held = ( size_t ) ( buffer + held - stop );
+        memmove ( buffer, stop, held );
+    }
+
+    free ( buffer );
+    debug_puts ( "Streamed input evaluated" );
+
+    return status;
+}
+
+/**
+ * Initialise the evaluation state of a worker.
+ *
+ * @param self the evaluation state
+ * @param cache the memory budget of the cache of the worker, or zero for none
+ * @return zero on success, or -1 on failure
+ */
+static int batch_initialise ( struct batch * self, size_t cache )
+{
+    *self = ( struct batch ) { .pool = NULL };
+
+    return ( ( self->pool = pool_initialise ( 0, NULL ) ) &&
+        ( self->expr = expression_initialise ( "", 0, NULL ) ) &&
+        ( !cache || ( self->cache = cache_initialise ( cache, NULL, 0 ) ) ) ) ?
+        0 : -1;
+}
+
+/**
+ * Destruct the evaluation state of a worker.
+ *
+ * @param self the evaluation state
+ */
+static void batch_destruct ( struct batch * self )
+{
+    cache_destruct ( self->cache );
+    expression_destruct ( self->expr );
+    pool_destruct ( self->pool );
+    free ( self->line );
+}
+
+/**
+ * Stop and join the workers of a scheduler, and release all of its resources.
+ *
+ * @param self the scheduler
+ */
+static void scheduler_destruct ( struct scheduler * self )
+{
+    pthread_mutex_lock ( &self->lock );
+    self->stopping = true;
+    pthread_cond_broadcast ( &self->start );
+    pthread_mutex_unlock ( &self->lock );
+
+    for ( unsigned int i = 0; i < self->started; i++ ) {
+        if ( i )
+            pthread_join ( self->workers [ i ].thread, NULL );
+
+        pthread_mutex_destroy ( & ( self->workers [ i ].lock ) );
+        batch_destruct ( & ( self->workers [ i ].context ) );
+    }
+
+    for ( unsigned int i = 0; i < self->task_capacity; i++ )
+        writer_destruct ( self->tasks [ i ].out );
+
+    free ( self->tasks );
+    free ( self->workers );
+    writer_destruct ( self->out );
+    pthread_cond_destroy ( &self->done );
+    pthread_cond_destroy ( &self->start );
+    pthread_mutex_destroy ( &self->lock );
+}
+
+/**
+ * Initialise a scheduler and start its workers.
+ *
+ * @param self the scheduler
+ * @param workers the number of workers
+ * @param cache the memory budget of the cache of each worker, or zero for none
+ * @param out_fd the file descriptor to which results are written
+ * @return zero on success, or -1 on failure; the scheduler must be destructed
+ *      in either case
+ */
+static int scheduler_initialise ( struct scheduler * self, unsigned int workers,
+        size_t cache, int out_fd )
+{
+    struct worker * worker;
+    int error;
+
+    *self = ( struct scheduler ) { .worker_count = workers };
+    pthread_mutex_init ( &self->lock, NULL );
+    pthread_cond_init ( &self->start, NULL );
+    pthread_cond_init ( &self->done, NULL );
+
+    if ( ! ( self->out = writer_initialise ( out_fd, 0 ) ) ||
+            ! ( self->workers = calloc ( workers, sizeof ( struct worker ) ) ) )
+        return -1;
+
+    for ( ; self->started < workers; self->started++ ) {
+        worker = & ( self->workers [ self->started ] );
+        worker->owner = self;
+        worker->id = self->started;
+        pthread_mutex_init ( &worker->lock, NULL );
+
+        /* The first worker is the calling thread */
+        if ( !( error = batch_initialise ( &worker->context, cache ) ) &&
+                self->started && ( error = pthread_create ( &worker->thread,
+                NULL, worker_main, worker ) ) )
+            errno = error;
+
+        if ( error ) {
+            batch_destruct ( &worker->context );
+            pthread_mutex_destroy ( &worker->lock );
+            return -1;
+        }
+    }
+
+    debug_printf ( "Batch scheduler started with %u worker(s)\n", workers );
+    return 0;
+}
+
+int batch_run ( int in_fd, int out_fd, unsigned int workers, size_t cache,
+        unsigned long * failures )
+{
+    struct scheduler self;
+    char * map = MAP_FAILED;
+    struct stat info;
+    long online;
+    int status, saved;
+
+    if ( !workers )
+        workers = ( ( online = sysconf ( _SC_NPROCESSORS_ONLN ) ) > 0 ) ?
+            ( unsigned int ) online : 1;
+
+    if ( !( status = scheduler_initialise ( &self, workers, cache,
+            out_fd ) ) ) {
+
+        /* Some special files, such as those of procfs, report a size of
+         * zero despite having content, so these are streamed. Anything that
+         * cannot be mapped is also streamed. */
+        if ( !fstat ( in_fd, &info ) && S_ISREG ( info.st_mode ) &&
+                info.st_size > 0 )
+            map = mmap ( NULL, ( size_t ) info.st_size, PROT_READ,
+                MAP_PRIVATE, in_fd, 0 );
+
+        status = ( map != MAP_FAILED ) ?
+            batch_mapped ( &self, map, ( size_t ) info.st_size ) :
+            batch_streamed ( &self, in_fd );
+
+        if ( writer_flush ( self.out ) )
+            status = -1;
+    }
+
+    *failures = 0;
+    for ( unsigned int i = 0; i < self.started; i++ )
+        *failures += self.workers [ i ].context.failures;
+
+    saved = errno;
+    scheduler_destruct ( &self );
+    errno = saved;
+
+    return status;
+}
@@ -0,0 +1,41 @@
+/**
+ * This interface evaluates newline-separated expressions in bulk. Input is read
+ * from a file descriptor: regular files are mapped into memory whole, and
+ * anything else (pipes, terminals) is streamed through a large buffer. Lines
+ * are evaluated in parallel by a pool of workers, each with its own node pool,
+ * expression, and stacks, which serve every line that the worker evaluates.
+ * Results are written through a buffered writer (see 'writer.h'), one per line,
+ * in input order. Each worker may also keep a cache of compiled programs (see
+ * 'cache.h'), so that repeated lines are not parsed again.
+ *
+ * A blank line produces a blank line. A line that cannot be evaluated produces
+ * "nan", and a report of the failure, with its line number, is printed to the
+ * standard error buffer.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/**
+ * Evaluate every line read from one file descriptor, writing the results to
+ * another.
+ *
+ * @param in_fd the file descriptor from which to read expressions
+ * @param out_fd the file descriptor to which results are written
+ * @param workers the number of workers, including the calling thread, or zero
+ *      for one per online processor
+ * @param cache the memory budget of the program cache of each worker, in
+ *      bytes, or zero for no cache
+ * @param failures the destination of the number of lines that could not be
+ *      evaluated
+ * @return zero on success, or -1 on an input, output, or allocation failure,
+ *      with 'errno' set appropriately
+ */
+int batch_run ( int in_fd, int out_fd, unsigned int workers, size_t cache,
+    unsigned long * failures );
+
+#endif /* BATCH_H */
@@ -0,0 +1,124 @@
+/**
+ * Check the evaluator ('expression_evaluate') against known answers, through
+ * both the two-pass parser ('expression_tokenise' then 'expression_postfix')
+ * and the fused parser ('expression_parse'). The other drivers only compare the
+ * engines with one another, so a fault shared by every engine, such as a wrong
+ * precedence decision in the Shunting Yard, is only caught here. The answers
+ * are exact in every number type, and the driver fails on any disagreement.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "node.h"
+#include "expr.h"
+
+/**
+ * An expression and its answer
+ */
+struct answer {
+    /**
+     * The infix expression
+     */
+    const char * expr;
+
+    /**
+     * The expected value of the expression
+     */
+    number_t value;
+};
+
+/**
+ * The known answers: chiefly the associativity of each pair of operators of
+ * the same precedence, in both orders, and against the others
+ */
+static const struct answer answers [ ] = {
+    { "1-2+3",         2 },
+    { "1+2-3",         0 },
+    { "8/2*2",         8 },
+    { "6*2/3",         4 },
+    { "10-4-3",        3 },
+    { "64/4/2",        8 },
+    { "2^3^2",       512 },
+    { "1+2*3",         7 },
+    { "2*3+1",         7 },
+    { "9-6/3",         7 },
+    { "(1+2)*3",       9 },
+    { "2*(7-4)^2",    18 },
+    { "12/(4-1)-2+5",  7 },
+};
+
+/**
+ * Evaluate an expression with either parser.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param expr_str the infix expression
+ * @param fused whether to use the fused parser
+ * @param result the destination of the value of the expression
+ * @return true on success, or false on failure
+ */
+static bool evaluate ( struct node_pool * pool, const char * expr_str,
+        bool fused, number_t * result )
+{
+    struct expression * expr = expression_initialise ( expr_str, 0, NULL );
+    enum expr_status status;
+
+    if ( !expr ) {
+        perror ( "Could not initialise the expression" );
+        return false;
+    }
+
+    pool_reset ( pool );
+
+    if ( fused )
+        status = expression_parse ( expr, pool );
+    else if ( ( status = expression_tokenise ( expr, pool ) ) == EXPR_OK )
+        status = expression_postfix ( expr );
+
+    if ( status == EXPR_OK )
+        status = expression_evaluate ( expr, result );
+
+    if ( status != EXPR_OK )
+        expression_perror ( expr, "Could not evaluate the expression",
+            status );
+
+    expression_destruct ( expr );
+    return status == EXPR_OK;
+}
+
+int main ( void )
+{
+    const unsigned int count = sizeof ( answers ) / sizeof ( *answers );
+    unsigned int failures = 0;
+    struct node_pool * pool;
+    number_t value;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    for ( unsigned int i = 0; i < count; i++ )
+        for ( int fused = 0; fused <= 1; fused++ ) {
+            value = 0;
+
+            if ( evaluate ( pool, answers [ i ].expr, fused, &value ) &&
+                    !memcmp ( &value, &answers [ i ].value,
+                    sizeof ( value ) ) )
+                continue;
+
+            printf ( "Wrong answer to \"%s\" (%s): %g, not %g\n",
+                answers [ i ].expr, fused ? "fused" : "two-pass",
+                ( double ) value, ( double ) answers [ i ].value );
+            failures++;
+        }
+
+    printf ( "%u of %u answers correct\n", count * 2 - failures, count * 2 );
+
+    pool_destruct ( pool );
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/**
+ * Compare the standard allocator against a bump arena that is reset after
+ * each request, where a request initialises a node pool and an expression,
+ * parses and evaluates a formula, and destructs them, on formulas of 8 to 4096
+ * tokens. Longer formulas spill their tokens, values, and stacks to the heap,
+ * and so call the allocator more often. The results of both allocators are
+ * compared bit-for-bit.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "node.h"
+#include "expr.h"
+#include "alloc.h"
+#include "bench.h"
+
+/**
+ * The total number of tokens to parse for each formula length and allocator,
+ * such that shorter formulas are requested more often
+ */
+#define BENCH_TOKENS 20000000UL
+
+/**
+ * Serve a request with the given allocator.
+ *
+ * @param allocator the allocator
+ * @param str the formula
+ * @param result the destination of the result
+ * @return zero on success, -1 on failure
+ */
+static int request ( const struct allocator * allocator, const char * str,
+        number_t * result )
+{
+    struct node_pool * pool = pool_initialise ( 0, allocator );
+    struct expression * expr = expression_initialise ( str, 0, allocator );
+    enum expr_status status = EXPR_INTERR;
+
+    if ( !pool || !expr )
+        perror ( "Could not initialise the request" );
+
+    else if ( ( status = expression_parse ( expr, pool ) ) != EXPR_OK ||
+            ( status = expression_evaluate ( expr, result ) ) != EXPR_OK )
+        expression_perror ( expr, "Could not evaluate the formula", status );
+
+    expression_destruct ( expr );
+    pool_destruct ( pool );
+
+    return ( status == EXPR_OK ) ? 0 : -1;
+}
+
+/**
+ * Serve a formula repeatedly with the given allocator, resetting the arena, if
+ * any, after each request, and measure the time taken.
+ *
+ * @param allocator the allocator
+ * @param arena the arena beneath the allocator, or NULL
+ * @param str the formula
+ * @param repeats the number of requests
+ * @param result the destination of the result
+ * @return the time taken, in nanoseconds, or a negative value on failure
+ */
+static double measure ( const struct allocator * allocator,
+        struct arena * arena, const char * str, unsigned long repeats,
+        number_t * result )
+{
+    double start = bench_now ( );
+
+    for ( unsigned long i = 0; i < repeats; i++ ) {
+        if ( request ( allocator, str, result ) )
+            return -1;
+
+        if ( arena )
+            arena_reset ( arena );
+    }
+
+    return bench_now ( ) - start;
+}
+
+int main ( void )
+{
+    struct allocator allocator;
+    struct arena * arena;
+    number_t result [ 2 ];
+    double t [ 2 ];
+    unsigned int errors = 0;
+    char * str;
+
+    if ( ! ( arena = arena_initialise ( 0 ) ) ) {
+        perror ( "Could not initialise the arena" );
+        return EXIT_FAILURE;
+    }
+
+    allocator = arena_allocator ( arena );
+
+    printf ( "%6s %8s %12s %12s %8s\n", "tokens", "repeats", "libc ns/req",
+        "arena ns/req", "speedup" );
+
+    for ( unsigned long tokens = 8; tokens <= 4096; tokens <<= 3 ) {
+        const unsigned long repeats = BENCH_TOKENS / tokens;
+
+        if ( ! ( str = bench_expression ( tokens, 42 ) ) ) {
+            perror ( "Could not generate the formula" );
+            return EXIT_FAILURE;
+        }
+
+        /* Each allocator is warmed with a request before it is timed */
+        if ( measure ( NULL, NULL, str, 1, &result [ 0 ] ) < 0 ||
+                measure ( &allocator, arena, str, 1, &result [ 1 ] ) < 0 ||
+                ( t [ 0 ] = measure ( NULL, NULL, str, repeats,
+                &result [ 0 ] ) ) < 0 ||
+                ( t [ 1 ] = measure ( &allocator, arena, str, repeats,
+                &result [ 1 ] ) ) < 0 )
+            return EXIT_FAILURE;
+
+        if ( memcmp ( &result [ 0 ], &result [ 1 ], sizeof ( number_t ) ) )
+            errors++;
+
+        printf ( "%6lu %8lu %12.1f %12.1f %7.2fx\n", tokens, repeats,
+            t [ 0 ] / ( double ) repeats, t [ 1 ] / ( double ) repeats,
+            t [ 0 ] / t [ 1 ] );
+
+        free ( str );
+    }
+
+    printf ( "%u result(s) differ between the allocators\n", errors );
+
+    arena_destruct ( arena );
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
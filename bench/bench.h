@@ -0,0 +1,85 @@
+/**
+ * Helpers shared by the benchmark drivers: a monotonic clock, and a generator
+ * of long, deterministic arithmetic expressions.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Read the monotonic clock.
+ *
+ * @return the current time, in nanoseconds
+ */
+static inline double bench_now ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ( double ) ts.tv_sec * 1e9 + ( double ) ts.tv_nsec;
+}
+
+/**
+ * Advance a xorshift pseudo-random number generator.
+ *
+ * @param state the generator state, which must not be zero
+ * @return the next pseudo-random number
+ */
+static inline unsigned int bench_random ( unsigned int * state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+/**
+ * Generate a well-formed infix expression of roughly the given number of
+ * tokens, made of literals, the four basic operators, and parenthesised
+ * sub-expressions. The same expression is generated for the same arguments.
+ *
+ * @param tokens the approximate number of tokens
+ * @param seed the non-zero seed of the generator
+ * @return the new expression, to be freed by the caller, or NULL on failure
+ */
+static inline char * bench_expression ( unsigned long tokens,
+        unsigned int seed )
+{
+    static const char operators [ ] = "+-*/";
+    char * expr, * head;
+    unsigned long count = 0;
+
+    /* No token, with its operator, is longer than eight characters */
+    if ( ! ( head = expr = malloc ( tokens * 8 + 16 ) ) )
+        return NULL;
+
+    for ( ;; ) {
+        if ( bench_random ( &seed ) % 8 == 0 && count + 5 < tokens ) {
+            head += sprintf ( head, "(%u%c%u.5)",
+                bench_random ( &seed ) % 100 + 1,
+                operators [ bench_random ( &seed ) % 4 ],
+                bench_random ( &seed ) % 100 );
+            count += 5;
+        } else {
+            head += sprintf ( head, "%u", bench_random ( &seed ) % 1000 + 1 );
+            count++;
+        }
+
+        if ( count + 1 >= tokens )
+            break;
+
+        *head++ = operators [ bench_random ( &seed ) % 4 ];
+        count++;
+    }
+
+    return expr;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,311 @@
+/**
+ * Stress the shared, concurrent cache of compiled programs ('ccache_compile')
+ * with many threads, and compare its read throughput against a single ordinary
+ * cache ('cache_compile') guarded by a mutex. Every thread looks up expressions
+ * drawn at random from a fixed set, evaluates each program, and checks the
+ * result against the value computed up-front; the driver fails on any
+ * disagreement.
+ *
+ * Two workloads are run. In the "read" workload, the budget holds every
+ * expression, so after warming up every lookup is a hit. In the "churn"
+ * workload, the budget holds about a quarter of them, so lookups race with
+ * compilation, eviction, table rebuilds, and reclamation.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "cache.h"
+#include "ccache.h"
+#include "bench.h"
+
+/**
+ * The number of distinct expressions
+ */
+#define BENCH_KEYS 4096U
+
+/**
+ * The approximate number of tokens in each expression
+ */
+#define BENCH_KEY_TOKENS 24UL
+
+/**
+ * The number of lookups made by each thread
+ */
+#define BENCH_LOOKUPS 400000U
+
+/**
+ * The number of lookups made inside the cache between entering and leaving it
+ */
+#define BENCH_BATCH 64U
+
+/**
+ * The largest number of threads
+ */
+#define BENCH_MAX_THREADS 64U
+
+/**
+ * A budget large enough to hold every expression
+ */
+#define BENCH_LARGE_BUDGET ( 64UL << 20 )
+
+/**
+ * The shared state of a run
+ */
+struct run {
+    /**
+     * The expressions
+     */
+    char ** keys;
+
+    /**
+     * The values of the expressions
+     */
+    number_t * values;
+
+    /**
+     * The shared concurrent cache, or NULL to use the guarded cache
+     */
+    struct ccache * shared;
+
+    /**
+     * The guarded cache
+     */
+    struct cache * guarded;
+
+    /**
+     * The lock that guards the guarded cache
+     */
+    pthread_mutex_t lock;
+};
+
+/**
+ * The state of one thread of a run
+ */
+struct thread {
+    /**
+     * The run
+     */
+    struct run * run;
+
+    /**
+     * The seed of the generator of the thread
+     */
+    unsigned int seed;
+
+    /**
+     * The number of wrong or failed lookups
+     */
+    unsigned long errors;
+};
+
+/**
+ * Check the result of one lookup.
+ *
+ * @param status the status of the lookup
+ * @param program the program found
+ * @param expected the expected value
+ * @return one if the lookup was wrong, or zero
+ */
+static unsigned long check ( enum expr_status status,
+        const struct program * program, number_t expected )
+{
+    number_t value;
+
+    if ( status != EXPR_OK )
+        return 1;
+
+    value = program_evaluate ( program, NULL );
+    return memcmp ( &value, &expected, sizeof ( value ) ) != 0;
+}
+
+/**
+ * The body of a thread: make BENCH_LOOKUPS lookups of random expressions.
+ *
+ * @param arg the state of the thread
+ * @return NULL
+ */
+static void * thread_main ( void * arg )
+{
+    struct thread * self = arg;
+    struct run * run = self->run;
+    const struct program * program;
+    struct ccache_thread * handle;
+    enum expr_status status;
+    unsigned int key;
+
+    if ( !run->shared ) {
+        for ( unsigned int i = 0; i < BENCH_LOOKUPS; i++ ) {
+            key = bench_random ( &self->seed ) % BENCH_KEYS;
+
+            pthread_mutex_lock ( &run->lock );
+            status = cache_compile ( run->guarded, run->keys [ key ],
+                &program );
+            self->errors += check ( status, program, run->values [ key ] );
+            pthread_mutex_unlock ( &run->lock );
+        }
+
+        return NULL;
+    }
+
+    if ( ! ( handle = ccache_register ( run->shared ) ) ) {
+        self->errors = BENCH_LOOKUPS;
+        return NULL;
+    }
+
+    for ( unsigned int i = 0; i < BENCH_LOOKUPS; i += BENCH_BATCH ) {
+        ccache_enter ( handle );
+
+        for ( unsigned int j = 0; j < BENCH_BATCH; j++ ) {
+            key = bench_random ( &self->seed ) % BENCH_KEYS;
+            status = ccache_compile ( handle, run->keys [ key ], &program );
+            self->errors += check ( status, program, run->values [ key ] );
+        }
+
+        ccache_leave ( handle );
+    }
+
+    ccache_unregister ( handle );
+    return NULL;
+}
+
+/**
+ * Run the given number of threads over a cache, and report the throughput.
+ *
+ * @param run the shared state of the run
+ * @param name the name of the cache
+ * @param count the number of threads
+ * @return the number of wrong or failed lookups
+ */
+static unsigned long measure ( struct run * run, const char * name,
+        unsigned int count )
+{
+    struct thread threads [ BENCH_MAX_THREADS ];
+    pthread_t ids [ BENCH_MAX_THREADS ];
+    unsigned long errors = 0;
+    double start, elapsed;
+
+    start = bench_now ( );
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        threads [ i ] = ( struct thread ) { run, 2463534242U + i * 7919U, 0 };
+        pthread_create ( & ( ids [ i ] ), NULL, thread_main,
+            & ( threads [ i ] ) );
+    }
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        pthread_join ( ids [ i ], NULL );
+        errors += threads [ i ].errors;
+    }
+
+    elapsed = bench_now ( ) - start;
+
+    printf ( "%-8s %8u %14.2f %10lu\n", name, count,
+        ( double ) BENCH_LOOKUPS * count / elapsed * 1e3, errors );
+
+    return errors;
+}
+
+/**
+ * Run one workload over both caches, for each number of threads.
+ *
+ * @param run the shared state of the run
+ * @param workload the name of the workload
+ * @param budget the memory budget of the caches
+ * @param max_threads the largest number of threads
+ * @return the number of wrong or failed lookups
+ */
+static unsigned long workload ( struct run * run, const char * workload,
+        size_t budget, unsigned int max_threads )
+{
+    struct cache_stats stats;
+    unsigned long errors = 0;
+
+    printf ( "\n%s workload (budget %zu bytes)\n%-8s %8s %14s %10s\n",
+        workload, budget, "cache", "threads", "Mlookups/s", "errors" );
+
+    for ( unsigned int count = 1; count <= max_threads; count <<= 1 ) {
+        run->shared = NULL;
+        run->guarded = cache_initialise ( budget, NULL, 0 );
+        errors += measure ( run, "mutex", count );
+        cache_destruct ( run->guarded );
+
+        run->shared = ccache_initialise ( budget, NULL, 0 );
+        errors += measure ( run, "ccache", count );
+        ccache_stats ( run->shared, &stats );
+        ccache_destruct ( run->shared );
+    }
+
+    printf ( "ccache at %u threads: %lu hits, %lu misses, %lu evictions\n",
+        max_threads, stats.hits, stats.misses, stats.evictions );
+
+    return errors;
+}
+
+int main ( void )
+{
+    struct run run = { .keys = NULL };
+    const struct program * program;
+    struct cache_stats stats;
+    unsigned int max_threads = 1;
+    unsigned long errors = 0;
+    struct cache * cache;
+    long online;
+
+    if ( ( online = sysconf ( _SC_NPROCESSORS_ONLN ) ) < 1 )
+        online = 1;
+
+    /* Over-subscribe the processors, to stress the reclamation of threads
+     * that are descheduled inside the cache. */
+    while ( max_threads < ( unsigned long ) online * 2 &&
+            max_threads < BENCH_MAX_THREADS )
+        max_threads <<= 1;
+
+    if ( max_threads < 4 )
+        max_threads = 4;
+
+    run.keys = calloc ( BENCH_KEYS, sizeof ( char * ) );
+    run.values = calloc ( BENCH_KEYS, sizeof ( number_t ) );
+
+    if ( !run.keys || !run.values ||
+            ! ( cache = cache_initialise ( BENCH_LARGE_BUDGET, NULL, 0 ) ) ) {
+        perror ( "Could not allocate the expressions" );
+        return EXIT_FAILURE;
+    }
+
+    for ( unsigned int i = 0; i < BENCH_KEYS; i++ ) {
+        if ( ! ( run.keys [ i ] = bench_expression ( BENCH_KEY_TOKENS,
+                i + 1 ) ) || cache_compile ( cache, run.keys [ i ],
+                &program ) != EXPR_OK ) {
+            fputs ( "Could not prepare the expressions\n", stderr );
+            return EXIT_FAILURE;
+        }
+
+        run.values [ i ] = program_evaluate ( program, NULL );
+    }
+
+    cache_stats ( cache, &stats );
+    cache_destruct ( cache );
+    pthread_mutex_init ( &run.lock, NULL );
+
+    errors += workload ( &run, "read", BENCH_LARGE_BUDGET, max_threads );
+    errors += workload ( &run, "churn", stats.footprint / 4, max_threads );
+
+    pthread_mutex_destroy ( &run.lock );
+
+    for ( unsigned int i = 0; i < BENCH_KEYS; i++ )
+        free ( run.keys [ i ] );
+
+    free ( run.keys );
+    free ( run.values );
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
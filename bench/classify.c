@@ -0,0 +1,193 @@
+/**
+ * Compare the tokeniser ('expression_tokenise') with the bulk classifier (see
+ * 'classify.h') against the byte-wise scanner, on expressions of 10^3 to 10^6
+ * tokens, both densely written and padded with white-space. Every expression is
+ * tokenised, converted, and evaluated under each classifier, and the results
+ * are checked against those of the byte-wise scanner; the driver fails on any
+ * disagreement.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "node.h"
+#include "expr.h"
+#include "cpu.h"
+#include "classify.h"
+#include "bench.h"
+
+/**
+ * The total number of tokens to tokenise for each expression length and
+ * level, such that shorter expressions are repeated more often
+ */
+#define BENCH_TOKENS 20000000UL
+
+/**
+ * The largest run of white-space inserted between the tokens of a padded
+ * expression
+ */
+#define BENCH_MAX_SPACE 8U
+
+/**
+ * Copy an expression, separating every token with a random run of blanks,
+ * tabs, and new-lines.
+ *
+ * @param dense the expression, written without white-space
+ * @return the padded expression, to be freed by the caller, or NULL on failure
+ */
+static char * pad ( const char * dense )
+{
+    static const char blanks [ ] = "  \t \n ";
+    unsigned int seed = 7, run;
+    char * padded, * head;
+
+    if ( ! ( head = padded = malloc ( strlen ( dense ) *
+            ( BENCH_MAX_SPACE + 1 ) + 1 ) ) )
+        return NULL;
+
+    for ( ; *dense; dense++ ) {
+        *head++ = *dense;
+
+        /* Only separate the tokens, never the bytes of a literal */
+        if ( dense [ 1 ] && ( strchr ( "+-*/()", *dense ) ||
+                strchr ( "+-*/()", dense [ 1 ] ) ) )
+            for ( run = bench_random ( &seed ) % ( BENCH_MAX_SPACE + 1 );
+                    run; run-- )
+                *head++ = blanks [ bench_random ( &seed ) %
+                    ( sizeof ( blanks ) - 1 ) ];
+    }
+
+    *head = '\0';
+    return padded;
+}
+
+/**
+ * Tokenise an expression, and measure the time taken. The expression is then
+ * converted and evaluated, untimed, for the agreement check.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param expr_str the infix expression
+ * @param result the destination of the value of the expression
+ * @return the time taken, in nanoseconds, or a negative value on failure
+ */
+static double measure ( struct node_pool * pool, const char * expr_str,
+        number_t * result )
+{
+    struct expression * expr = expression_initialise ( expr_str, 0, NULL );
+    enum expr_status status;
+    double start, end;
+
+    if ( !expr ) {
+        perror ( "Could not initialise the expression" );
+        return -1;
+    }
+
+    pool_reset ( pool );
+    start = bench_now ( );
+    status = expression_tokenise ( expr, pool );
+    end = bench_now ( );
+
+    if ( status == EXPR_OK && ( status = expression_postfix ( expr ) ) ==
+            EXPR_OK )
+        status = expression_evaluate ( expr, result );
+
+    if ( status != EXPR_OK )
+        expression_perror ( expr, "Could not tokenise the expression",
+            status );
+
+    expression_destruct ( expr );
+
+    return ( status == EXPR_OK ) ? end - start : -1;
+}
+
+/**
+ * Tokenise an expression under every level supported by the host processor,
+ * and print the rate of each against that of the byte-wise scanner.
+ *
+ * @param pool the node pool
+ * @param name the name of the style of the expression
+ * @param expr_str the infix expression
+ * @param tokens the approximate number of tokens in the expression
+ * @param host the most capable level of the host processor
+ * @return the number of levels that disagreed with the byte-wise scanner
+ */
+static unsigned int compare ( struct node_pool * pool, const char * name,
+        const char * expr_str, unsigned long tokens, enum cpu_level host )
+{
+    const unsigned long repeats = BENCH_TOKENS / tokens;
+    double elapsed [ CPU_COUNT ], t;
+    number_t results [ CPU_COUNT ];
+    unsigned int mismatches = 0;
+
+    /* The levels are interleaved, so that drift in the clock rate of the
+     * host is shared between them. */
+    for ( unsigned int level = 0; level <= host; level++ )
+        elapsed [ level ] = 0;
+
+    for ( unsigned long i = 0; i < repeats; i++ )
+        for ( unsigned int level = 0; level <= host; level++ ) {
+            classify_select ( ( enum cpu_level ) level );
+
+            if ( ( t = measure ( pool, expr_str, &results [ level ] ) ) < 0 )
+                return host + 1;
+
+            elapsed [ level ] += t;
+        }
+
+    for ( unsigned int level = 1; level <= host; level++ ) {
+        if ( memcmp ( &results [ level ], &results [ CPU_SCALAR ],
+                sizeof ( number_t ) ) ) {
+            printf ( "Mismatch under %s: %a vs. %a\n",
+                cpu_level_str ( ( enum cpu_level ) level ),
+                ( double ) results [ level ],
+                ( double ) results [ CPU_SCALAR ] );
+            mismatches++;
+        }
+
+        printf ( "%-7s %10lu %8lu %-7s %14.2f %14.2f %7.2fx\n", name, tokens,
+            repeats, cpu_level_str ( ( enum cpu_level ) level ),
+            elapsed [ CPU_SCALAR ] / ( double ) ( repeats * tokens ),
+            elapsed [ level ] / ( double ) ( repeats * tokens ),
+            elapsed [ CPU_SCALAR ] / elapsed [ level ] );
+    }
+
+    return mismatches;
+}
+
+int main ( void )
+{
+    const enum cpu_level host = cpu_detect ( );
+    unsigned int mismatches = 0;
+    struct node_pool * pool;
+    char * dense, * padded;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    printf ( "%-7s %10s %8s %-7s %14s %14s %8s\n", "style", "tokens",
+        "repeats", "level", "bytes ns/tok", "bulk ns/tok", "speedup" );
+
+    for ( unsigned long tokens = 1000; tokens <= 1000000; tokens *= 10 ) {
+        if ( ! ( dense = bench_expression ( tokens, 42 ) ) ||
+                ! ( padded = pad ( dense ) ) ) {
+            perror ( "Could not generate the expression" );
+            return EXIT_FAILURE;
+        }
+
+        mismatches += compare ( pool, "dense", dense, tokens, host );
+        mismatches += compare ( pool, "padded", padded, tokens, host );
+
+        free ( padded );
+        free ( dense );
+    }
+
+    classify_select ( host );
+    pool_destruct ( pool );
+
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
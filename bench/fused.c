@@ -0,0 +1,101 @@
+/**
+ * Compare the two-pass parser ('expression_tokenise' then 'expression_postfix')
+ * against the fused, single-pass parser ('expression_parse') on expressions of
+ * 10^3 to 10^6 tokens.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "node.h"
+#include "expr.h"
+#include "bench.h"
+
+/**
+ * The total number of tokens to parse for each expression length, such that
+ * shorter expressions are repeated more often
+ */
+#define BENCH_TOKENS 20000000UL
+
+/**
+ * Parse an expression with either parser, and measure the time taken.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param expr_str the infix expression
+ * @param fused whether to use the fused parser
+ * @return the time taken, in nanoseconds, or a negative value on failure
+ */
+static double measure ( struct node_pool * pool, const char * expr_str,
+        int fused )
+{
+    struct expression * expr = expression_initialise ( expr_str, 0, NULL );
+    enum expr_status status;
+    double start, end;
+
+    if ( !expr ) {
+        perror ( "Could not initialise the expression" );
+        return -1;
+    }
+
+    pool_reset ( pool );
+    start = bench_now ( );
+
+    if ( fused )
+        status = expression_parse ( expr, pool );
+    else if ( ( status = expression_tokenise ( expr, pool ) ) == EXPR_OK )
+        status = expression_postfix ( expr );
+
+    end = bench_now ( );
+
+    if ( status != EXPR_OK )
+        expression_perror ( expr, "Could not parse the expression", status );
+
+    expression_destruct ( expr );
+
+    return ( status == EXPR_OK ) ? end - start : -1;
+}
+
+int main ( void )
+{
+    struct node_pool * pool;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    printf ( "%10s %8s %14s %14s %8s\n", "tokens", "repeats",
+        "two-pass ns/tok", "fused ns/tok", "speedup" );
+
+    for ( unsigned long tokens = 1000; tokens <= 1000000; tokens *= 10 ) {
+        const unsigned long repeats = BENCH_TOKENS / tokens;
+        double two_pass = 0, fused = 0, t;
+        char * expr_str;
+
+        if ( ! ( expr_str = bench_expression ( tokens, 42 ) ) ) {
+            perror ( "Could not generate the expression" );
+            return EXIT_FAILURE;
+        }
+
+        for ( unsigned long i = 0; i < repeats; i++ ) {
+            if ( ( t = measure ( pool, expr_str, 0 ) ) < 0 )
+                return EXIT_FAILURE;
+            two_pass += t;
+
+            if ( ( t = measure ( pool, expr_str, 1 ) ) < 0 )
+                return EXIT_FAILURE;
+            fused += t;
+        }
+
+        printf ( "%10lu %8lu %14.2f %14.2f %7.2fx\n", tokens, repeats,
+            two_pass / ( double ) ( repeats * tokens ),
+            fused / ( double ) ( repeats * tokens ), two_pass / fused );
+
+        free ( expr_str );
+    }
+
+    pool_destruct ( pool );
+    return EXIT_SUCCESS;
+}
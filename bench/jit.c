@@ -0,0 +1,246 @@
+/**
+ * Compare the native engine (see 'program_select') against the stack and
+ * register engines on formulas in three variables, reporting the time taken
+ * per evaluation by each engine once the native engine has tiered up, and the
+ * time taken by the evaluations until then, which include the assembly of the
+ * native code. The results of every engine are compared bit-for-bit.
+ *
+ * The formulas are wide sums of products, deep right-nested chains, which
+ * spill, and sums of powers, which call into the mathematics library.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "bench.h"
+
+/**
+ * The total number of operators to evaluate for each formula and engine, such
+ * that shorter formulas are evaluated more often
+ */
+#define BENCH_OPERATORS 40000000UL
+
+/**
+ * The number of evaluations after which every engine is timed; this exceeds
+ * the tiering threshold of the native engine
+ */
+#define BENCH_WARMUP 2000UL
+
+/**
+ * The number of distinct rows of variables
+ */
+#define BENCH_ROWS 1024U
+
+/**
+ * The number of variables
+ */
+#define BENCH_SLOTS 3U
+
+/**
+ * The number of engines
+ */
+#define BENCH_ENGINES 3U
+
+/**
+ * The shapes of formula
+ */
+enum shape {
+    SHAPE_WIDE,
+    SHAPE_DEEP,
+    SHAPE_POWER,
+
+    SHAPE_COUNT
+};
+
+/**
+ * Generate a formula of the given shape with the given number of operators.
+ *
+ * @param shape the shape
+ * @param operators the number of operators
+ * @return the new formula, to be freed by the caller, or NULL on failure
+ */
+static char * formula ( enum shape shape, unsigned long operators )
+{
+    static const char variables [ ] = "xyz";
+    static const char ops [ ] = "+-*/";
+    char * expr, * head;
+
+    /* No operand, with its operator and parentheses, is longer than sixteen
+     * characters */
+    if ( ! ( head = expr = malloc ( operators * 16 + 16 ) ) )
+        return NULL;
+
+    switch ( shape ) {
+        case SHAPE_WIDE:
+            head += sprintf ( head, "x" );
+
+            for ( unsigned long i = 0; i + 2 <= operators; i += 2 )
+                head += sprintf ( head, "%c%c*%lu.5", "+-"[ i / 2 % 2 ],
+                    variables [ i / 2 % BENCH_SLOTS ], i / 2 % 9 + 1 );
+            break;
+
+        case SHAPE_DEEP:
+            for ( unsigned long i = 0; i < operators; i++ )
+                head += sprintf ( head, "%c%c(",
+                    variables [ i % BENCH_SLOTS ], ops [ i % 4 ] );
+
+            *head++ = 'x';
+            memset ( head, ')', operators );
+            head [ operators ] = '\0';
+            break;
+
+        case SHAPE_POWER:
+            head += sprintf ( head, "x" );
+
+            /* Each term is a power and a sum, so adds two operators */
+            for ( unsigned long i = 0; i + 2 <= operators; i += 2 )
+                head += sprintf ( head, "+%c^%lu.5",
+                    variables [ i / 2 % BENCH_SLOTS ], i / 2 % 3 + 1 );
+            break;
+
+        case SHAPE_COUNT:
+            break;
+    }
+
+    return expr;
+}
+
+/**
+ * Compile a formula for the given engine.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param str the formula
+ * @param engine the engine
+ * @return the program, or NULL on failure
+ */
+static struct program * compile ( struct node_pool * pool, const char * str,
+        enum prog_engine engine )
+{
+    static const char * const names [ BENCH_SLOTS ] = { "x", "y", "z" };
+    struct expression * expr;
+    struct program * program = NULL;
+    enum expr_status status;
+
+    if ( ! ( expr = expression_initialise ( str, 0, NULL ) ) )
+        return NULL;
+
+    expression_bind ( expr, names, BENCH_SLOTS );
+    pool_reset ( pool );
+
+    if ( ( status = expression_parse ( expr, pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( expr, &program ) ) != EXPR_OK )
+        expression_perror ( expr, "Could not compile the formula", status );
+
+    else if ( program_select ( program, engine ) ) {
+        perror ( "Could not select the engine" );
+        program_destruct ( program );
+        program = NULL;
+    }
+
+    expression_destruct ( expr );
+    return program;
+}
+
+/**
+ * Evaluate a program over the rows repeatedly, and measure the time taken.
+ *
+ * @param program the program
+ * @param rows the rows of variables
+ * @param repeats the number of evaluations
+ * @param out the destination of the results, one per row
+ * @return the time taken, in nanoseconds
+ */
+static double measure ( const struct program * program,
+        const number_t * rows, unsigned long repeats, number_t * out )
+{
+    double start = bench_now ( );
+
+    for ( unsigned long i = 0; i < repeats; i++ )
+        out [ i % BENCH_ROWS ] = program_evaluate ( program,
+            & ( rows [ i % BENCH_ROWS * BENCH_SLOTS ] ) );
+
+    return bench_now ( ) - start;
+}
+
+int main ( void )
+{
+    static const char * const shapes [ SHAPE_COUNT ] = {
+        "wide", "deep", "power"
+    };
+    static const enum prog_engine engines [ BENCH_ENGINES ] = {
+        PROG_ENGINE_STACK, PROG_ENGINE_REGISTER, PROG_ENGINE_NATIVE
+    };
+    number_t rows [ BENCH_ROWS * BENCH_SLOTS ];
+    number_t out [ BENCH_ENGINES ] [ BENCH_ROWS ];
+    double warmup [ BENCH_ENGINES ], t [ BENCH_ENGINES ];
+    struct program * program [ BENCH_ENGINES ];
+    unsigned int seed = 42, errors = 0;
+    struct node_pool * pool;
+    char * str;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    /* Operands lie in [1, 3], so that deep quotients stay finite */
+    for ( unsigned int i = 0; i < BENCH_ROWS * BENCH_SLOTS; i++ )
+        rows [ i ] = ( number_t ) ( bench_random ( &seed ) % 2001 ) /
+            1000.0f + 1.0f;
+
+    printf ( "%-5s %9s %9s %9s %9s %9s %11s\n", "shape", "operators",
+        "stack ns", "reg ns", "native ns", "speedup", "warm-up us" );
+
+    for ( unsigned int s = 0; s < SHAPE_COUNT; s++ )
+        for ( unsigned long operators = 16; operators <= 4096;
+                operators <<= 2 ) {
+            const unsigned long repeats = BENCH_OPERATORS / operators;
+
+            if ( ! ( str = formula ( ( enum shape ) s, operators ) ) ) {
+                perror ( "Could not generate the formula" );
+                return EXIT_FAILURE;
+            }
+
+            for ( unsigned int k = 0; k < BENCH_ENGINES; k++ ) {
+                if ( ! ( program [ k ] = compile ( pool, str,
+                        engines [ k ] ) ) )
+                    return EXIT_FAILURE;
+
+                warmup [ k ] = measure ( program [ k ], rows, BENCH_WARMUP,
+                    out [ k ] );
+                t [ k ] = measure ( program [ k ], rows, repeats, out [ k ] );
+            }
+
+            for ( unsigned int k = 1; k < BENCH_ENGINES; k++ )
+                for ( unsigned int i = 0; i < BENCH_ROWS; i++ )
+                    if ( memcmp ( & ( out [ 0 ] [ i ] ), & ( out [ k ] [ i ] ),
+                            sizeof ( number_t ) ) &&
+                            !( isnan ( out [ 0 ] [ i ] ) &&
+                            isnan ( out [ k ] [ i ] ) ) )
+                        errors++;
+
+            /* The speedup is that of the native engine over the register
+             * engine, and the warm-up includes the assembly */
+            printf ( "%-5s %9lu %9.1f %9.1f %9.1f %8.2fx %11.1f\n",
+                shapes [ s ], operators, t [ 0 ] / ( double ) repeats,
+                t [ 1 ] / ( double ) repeats, t [ 2 ] / ( double ) repeats,
+                t [ 1 ] / t [ 2 ], warmup [ 2 ] / 1e3 );
+
+            for ( unsigned int k = 0; k < BENCH_ENGINES; k++ )
+                program_destruct ( program [ k ] );
+
+            free ( str );
+        }
+
+    printf ( "%u result(s) differ between the engines\n", errors );
+
+    pool_destruct ( pool );
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,277 @@
+/**
+ * Compare the generic exponentiation path (powf(3)) against strength-reduced
+ * integral powers (PROG_PASS_POWI) on formulas dominated by exponentiation.
+ * Each formula is a sum of terms such as "3*x^4" or "(x+y)^3", in three
+ * variables, with small integral exponents and the occasional fractional one.
+ * Every formula is compiled both ways and evaluated over the same rows, one row
+ * at a time and in batches, and the results are compared. A last-bit
+ * difference in one power can grow by many units in the last place where the
+ * terms of a sum cancel.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "bench.h"
+
+/**
+ * The number of formulas
+ */
+#define BENCH_FORMULAS 64U
+
+/**
+ * The number of terms in each formula
+ */
+#define BENCH_TERMS 12U
+
+/**
+ * The number of rows over which each formula is evaluated
+ */
+#define BENCH_ROWS 4096U
+
+/**
+ * The number of times each formula is evaluated over every row
+ */
+#define BENCH_REPEATS 20U
+
+/**
+ * The number of variables
+ */
+#define BENCH_SLOTS 3U
+
+/**
+ * Generate an exponent-heavy formula.
+ *
+ * @param seed the non-zero seed of the generator
+ * @return the new formula, to be freed by the caller, or NULL on failure
+ */
+static char * formula ( unsigned int seed )
+{
+    static const char * const bases [ ] = {
+        "x", "y", "z", "(x+y)", "(y-z)", "(x*z+1)"
+    };
+    char * expr, * head;
+
+    if ( ! ( head = expr = malloc ( BENCH_TERMS * 32 ) ) )
+        return NULL;
+
+    for ( unsigned int i = 0; i < BENCH_TERMS; i++ ) {
+        if ( i )
+            *head++ = "+-"[ bench_random ( &seed ) % 2 ];
+
+        head += sprintf ( head, "%u*%s^", bench_random ( &seed ) % 9 + 1,
+            bases [ bench_random ( &seed ) % 6 ] );
+
+        /* One exponent in eight is fractional, and takes the generic path */
+        if ( bench_random ( &seed ) % 8 == 0 )
+            head += sprintf ( head, "%u.5", bench_random ( &seed ) % 3 + 1 );
+        else
+            head += sprintf ( head, "%u", bench_random ( &seed ) % 7 + 2 );
+    }
+
+    return expr;
+}
+
+/**
+ * Compile a formula with the given passes.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param str the formula
+ * @param passes the optimisation passes
+ * @return the program, or NULL on failure
+ */
+static struct program * compile ( struct node_pool * pool, const char * str,
+        unsigned int passes )
+{
+    static const char * const names [ BENCH_SLOTS ] = { "x", "y", "z" };
+    struct expression * expr;
+    struct program * program = NULL;
+    enum expr_status status;
+
+    if ( ! ( expr = expression_initialise ( str, 0, NULL ) ) )
+        return NULL;
+
+    expression_bind ( expr, names, BENCH_SLOTS );
+    expression_set_passes ( expr, passes );
+    pool_reset ( pool );
+
+    if ( ( status = expression_parse ( expr, pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( expr, &program ) ) != EXPR_OK )
+        expression_perror ( expr, "Could not compile the formula", status );
+
+    expression_destruct ( expr );
+    return program;
+}
+
+/**
+ * Evaluate a program over every row, one row at a time.
+ *
+ * @param program the program
+ * @param columns the variable columns
+ * @param out the destination of the results
+ * @return the time taken, in nanoseconds
+ */
+static double measure_rows ( const struct program * program,
+        const number_t * const * columns, number_t * out )
+{
+    number_t vars [ BENCH_SLOTS ];
+    double start = bench_now ( );
+
+    for ( unsigned int r = 0; r < BENCH_REPEATS; r++ )
+        for ( unsigned int i = 0; i < BENCH_ROWS; i++ ) {
+            for ( unsigned int s = 0; s < BENCH_SLOTS; s++ )
+                vars [ s ] = columns [ s ] [ i ];
+
+            out [ i ] = program_evaluate ( program, vars );
+        }
+
+    return bench_now ( ) - start;
+}
+
+/**
+ * Evaluate a program over every row, in batches.
+ *
+ * @param program the program
+ * @param columns the variable columns
+ * @param out the destination of the results
+ * @return the time taken, in nanoseconds, or a negative value on failure
+ */
+static double measure_batch ( const struct program * program,
+        const number_t * const * columns, number_t * out )
+{
+    double start = bench_now ( );
+
+    for ( unsigned int r = 0; r < BENCH_REPEATS; r++ )
+        if ( program_evaluate_batch ( program, columns, out, BENCH_ROWS ) )
+            return -1;
+
+    return bench_now ( ) - start;
+}
+
+/**
+ * Count the results that differ between two runs, and the greatest difference
+ * between them in units in the last place.
+ *
+ * @param a the first results
+ * @param b the second results
+ * @param ulps the greatest difference so far, updated as necessary
+ * @return the number of results that differ
+ */
+static unsigned long compare ( const number_t * a, const number_t * b,
+        unsigned long * ulps )
+{
+    unsigned long differ = 0, d;
+    int32_t x, y;
+
+    for ( unsigned int i = 0; i < BENCH_ROWS; i++ ) {
+        if ( !memcmp ( & ( a [ i ] ), & ( b [ i ] ), sizeof ( number_t ) ) ||
+                ( isnan ( a [ i ] ) && isnan ( b [ i ] ) ) )
+            continue;
+
+        memcpy ( &x, & ( a [ i ] ), sizeof ( x ) );
+        memcpy ( &y, & ( b [ i ] ), sizeof ( y ) );
+        d = ( x > y ) ? ( unsigned long ) x - ( unsigned long ) y :
+            ( unsigned long ) y - ( unsigned long ) x;
+
+        if ( d > *ulps )
+            *ulps = d;
+        differ++;
+    }
+
+    return differ;
+}
+
+int main ( void )
+{
+    double rows [ 2 ] = { 0, 0 }, batch [ 2 ] = { 0, 0 }, t;
+    number_t * columns [ BENCH_SLOTS ], * out [ 2 ];
+    unsigned long length [ 2 ] = { 0, 0 }, differ = 0, ulps = 0;
+    static const unsigned int passes [ 2 ] = {
+        PROG_PASS_DEFAULT, PROG_PASS_DEFAULT | PROG_PASS_POWI
+    };
+    struct program * program [ 2 ];
+    unsigned int seed = 42;
+    struct node_pool * pool;
+    char * str;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ||
+            ! ( out [ 0 ] = malloc ( sizeof ( number_t ) * BENCH_ROWS ) ) ||
+            ! ( out [ 1 ] = malloc ( sizeof ( number_t ) * BENCH_ROWS ) ) ) {
+        perror ( "Could not allocate the rows" );
+        return EXIT_FAILURE;
+    }
+
+    /* Operands lie in [-2, 2], so that powers stay well within range */
+    for ( unsigned int s = 0; s < BENCH_SLOTS; s++ ) {
+        if ( ! ( columns [ s ] = malloc ( sizeof ( number_t ) *
+                BENCH_ROWS ) ) ) {
+            perror ( "Could not allocate the rows" );
+            return EXIT_FAILURE;
+        }
+
+        for ( unsigned int i = 0; i < BENCH_ROWS; i++ )
+            columns [ s ] [ i ] = ( number_t ) ( bench_random ( &seed ) %
+                4001 ) / 1000.0f - 2.0f;
+    }
+
+    for ( unsigned int f = 0; f < BENCH_FORMULAS; f++ ) {
+        if ( ! ( str = formula ( f + 1 ) ) ) {
+            perror ( "Could not generate the formula" );
+            return EXIT_FAILURE;
+        }
+
+        for ( unsigned int k = 0; k < 2; k++ ) {
+            if ( ! ( program [ k ] = compile ( pool, str, passes [ k ] ) ) )
+                return EXIT_FAILURE;
+
+            length [ k ] += program_length ( program [ k ] );
+            rows [ k ] += measure_rows ( program [ k ],
+                ( const number_t * const * ) columns, out [ k ] );
+
+            if ( ( t = measure_batch ( program [ k ],
+                    ( const number_t * const * ) columns, out [ k ] ) ) < 0 ) {
+                perror ( "Could not evaluate the batch" );
+                return EXIT_FAILURE;
+            }
+
+            batch [ k ] += t;
+        }
+
+        differ += compare ( out [ 0 ], out [ 1 ], &ulps );
+
+        program_destruct ( program [ 0 ] );
+        program_destruct ( program [ 1 ] );
+        free ( str );
+    }
+
+    printf ( "%-8s %14s %14s %14s\n", "path", "instructions", "row ns/eval",
+        "batch ns/eval" );
+
+    for ( unsigned int k = 0; k < 2; k++ )
+        printf ( "%-8s %14lu %14.2f %14.2f\n", k ? "powi" : "powf",
+            length [ k ], rows [ k ] / ( BENCH_FORMULAS * BENCH_ROWS *
+            BENCH_REPEATS ), batch [ k ] / ( BENCH_FORMULAS * BENCH_ROWS *
+            BENCH_REPEATS ) );
+
+    printf ( "speedup: %.2fx by row, %.2fx by batch\n", rows [ 0 ] / rows [ 1 ],
+        batch [ 0 ] / batch [ 1 ] );
+    printf ( "%lu of %u results differ, by at most %lu ulp(s)\n", differ,
+        BENCH_FORMULAS * BENCH_ROWS, ulps );
+
+    for ( unsigned int s = 0; s < BENCH_SLOTS; s++ )
+        free ( columns [ s ] );
+
+    free ( out [ 0 ] );
+    free ( out [ 1 ] );
+    pool_destruct ( pool );
+
+    return EXIT_SUCCESS;
+}
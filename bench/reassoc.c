@@ -0,0 +1,315 @@
+/**
+ * Compare the reductions into which long chains of sums and products may be
+ * reassociated (see 'PROG_PASS_REASSOCIATE'), under the stack and native
+ * engines, reporting the time taken per evaluation, the speedup over serial
+ * evaluation, and the relative error against a reference accumulated in the
+ * wide type. The results of both engines are compared bit-for-bit.
+ *
+ *  - Sums are of products of variables by literals, such as "x*1.5+y*2.5",
+ *    whose variables lie in [-1, 1], so that the terms cancel; and
+ *
+ *  - Products are of variables and factors, such as "x*1.0001220703125*y",
+ *    whose variables lie in [0.999, 1.001], so that the product stays finite.
+ *    The factors are pseudo-random, since the rounding errors of a periodic
+ *    product would recur in every run of its terms.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "bench.h"
+
+/**
+ * The total number of terms to evaluate for each formula, mode, and engine,
+ * such that shorter formulas are evaluated more often
+ */
+#define BENCH_TERMS 40000000UL
+
+/**
+ * The number of evaluations after which every engine is timed; this exceeds
+ * the tiering threshold of the native engine
+ */
+#define BENCH_WARMUP 2000UL
+
+/**
+ * The number of distinct rows of variables
+ */
+#define BENCH_ROWS 1024U
+
+/**
+ * The number of variables
+ */
+#define BENCH_SLOTS 3U
+
+/**
+ * The number of engines
+ */
+#define BENCH_ENGINES 2U
+
+/**
+ * The number of modes of reduction, and of shapes of formula
+ */
+#define BENCH_MODES 4U
+#define BENCH_SHAPES 2U
+
+/**
+ * The seed of the factors of products
+ */
+#define BENCH_FACTOR_SEED 7U
+
+/**
+ * Generate the next factor of a product, which is a dyadic number near one,
+ * and so exactly representable in every number type.
+ *
+ * @param seed the generator state
+ * @return the factor
+ */
+static double factor ( unsigned int * seed )
+{
+    return 1.0 + ( double ) ( ( int ) ( bench_random ( seed ) % 65 ) - 32 ) /
+        65536.0;
+}
+
+/**
+ * Generate a sum or product with the given number of terms.
+ *
+ * @param terms the number of terms
+ * @param product whether the formula should be a product, rather than a sum
+ * @return the new formula, to be freed by the caller, or NULL on failure
+ */
+static char * formula ( unsigned long terms, int product )
+{
+    static const char variables [ ] = "xyz";
+    unsigned int seed = BENCH_FACTOR_SEED;
+    char * expr, * head;
+
+    /* No term, with its operator, is longer than twenty characters */
+    if ( ! ( head = expr = malloc ( terms * 20 + 16 ) ) )
+        return NULL;
+
+    for ( unsigned long i = 0; i < terms; i++ )
+        if ( product && i % 2 )
+            head += sprintf ( head, "*%.16f", factor ( &seed ) );
+        else if ( product )
+            head += sprintf ( head, "%s%c", i ? "*" : "",
+                variables [ i / 2 % BENCH_SLOTS ] );
+        else
+            head += sprintf ( head, "%s%c*%lu.5", i ? "+" : "",
+                variables [ i % BENCH_SLOTS ], i % 9 + 1 );
+
+    return expr;
+}
+
+/**
+ * Compute the formula of the given shape in the wide type, from the terms
+ * that every engine computes, for each row.
+ *
+ * @param rows the rows of variables
+ * @param terms the number of terms
+ * @param product whether the formula is a product, rather than a sum
+ * @param out the destination of the references, one per row
+ */
+static void reference ( const number_t * rows, unsigned long terms,
+        int product, number_wide_t * out )
+{
+    const number_t * vars;
+    number_wide_t acc;
+    unsigned int seed;
+
+    for ( unsigned int r = 0; r < BENCH_ROWS; r++ ) {
+        vars = & ( rows [ r * BENCH_SLOTS ] );
+        acc = product ? number_widen ( NUMBER_ONE ) :
+            number_widen ( NUMBER_ZERO );
+        seed = BENCH_FACTOR_SEED;
+
+        for ( unsigned long i = 0; i < terms; i++ )
+            if ( product && i % 2 )
+                acc *= number_widen ( number_from_double ( factor (
+                    &seed ) ) );
+            else if ( product )
+                acc *= number_widen ( vars [ i / 2 % BENCH_SLOTS ] );
+            else
+                acc += number_widen ( number_multiply (
+                    vars [ i % BENCH_SLOTS ], number_from_double (
+                    ( double ) ( i % 9 + 1 ) + 0.5 ) ) );
+
+        out [ r ] = acc;
+    }
+}
+
+/**
+ * Compile a formula with the given passes for the given engine.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param str the formula
+ * @param passes the optimisation passes
+ * @param engine the engine
+ * @return the program, or NULL on failure
+ */
+static struct program * compile ( struct node_pool * pool, const char * str,
+        unsigned int passes, enum prog_engine engine )
+{
+    static const char * const names [ BENCH_SLOTS ] = { "x", "y", "z" };
+    struct expression * expr;
+    struct program * program = NULL;
+    enum expr_status status;
+
+    if ( ! ( expr = expression_initialise ( str, 0, NULL ) ) )
+        return NULL;
+
+    expression_bind ( expr, names, BENCH_SLOTS );
+    expression_set_passes ( expr, passes );
+    pool_reset ( pool );
+
+    if ( ( status = expression_parse ( expr, pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( expr, &program ) ) != EXPR_OK )
+        expression_perror ( expr, "Could not compile the formula", status );
+
+    else if ( program_select ( program, engine ) ) {
+        perror ( "Could not select the engine" );
+        program_destruct ( program );
+        program = NULL;
+    }
+
+    expression_destruct ( expr );
+    return program;
+}
+
+/**
+ * Evaluate a program over the rows repeatedly, and measure the time taken.
+ *
+ * @param program the program
+ * @param rows the rows of variables
+ * @param repeats the number of evaluations
+ * @param out the destination of the results, one per row
+ * @return the time taken, in nanoseconds
+ */
+static double measure ( const struct program * program,
+        const number_t * rows, unsigned long repeats, number_t * out )
+{
+    double start = bench_now ( );
+
+    for ( unsigned long i = 0; i < repeats; i++ )
+        out [ i % BENCH_ROWS ] = program_evaluate ( program,
+            & ( rows [ i % BENCH_ROWS * BENCH_SLOTS ] ) );
+
+    return bench_now ( ) - start;
+}
+
+/**
+ * Measure the error of the results against the references, relative to the
+ * magnitude of the references.
+ *
+ * @param out the results, one per row
+ * @param ref the references, one per row
+ * @return the relative error
+ */
+static double relative_error ( const number_t * out, const number_wide_t * ref )
+{
+    double error = 0, magnitude = 0;
+
+    for ( unsigned int r = 0; r < BENCH_ROWS; r++ ) {
+        error += fabs ( ( double ) ( number_widen ( out [ r ] ) - ref [ r ] ) );
+        magnitude += fabs ( ( double ) ref [ r ] );
+    }
+
+    return error / magnitude;
+}
+
+int main ( void )
+{
+    static const char * const shapes [ BENCH_SHAPES ] = { "sum", "product" };
+    static const char * const modes [ BENCH_MODES ] = {
+        "serial", "interleaved", "pairwise", "kahan"
+    };
+    static const unsigned int passes [ BENCH_MODES ] = {
+        PROG_PASS_DEFAULT,
+        PROG_PASS_DEFAULT | PROG_PASS_REASSOCIATE,
+        PROG_PASS_DEFAULT | PROG_PASS_PAIRWISE,
+        PROG_PASS_DEFAULT | PROG_PASS_KAHAN
+    };
+    static const enum prog_engine engines [ BENCH_ENGINES ] = {
+        PROG_ENGINE_STACK, PROG_ENGINE_NATIVE
+    };
+    number_t rows [ BENCH_SHAPES ] [ BENCH_ROWS * BENCH_SLOTS ];
+    number_t out [ BENCH_ENGINES ] [ BENCH_ROWS ];
+    number_wide_t ref [ BENCH_ROWS ];
+    double t [ BENCH_ENGINES ], serial [ BENCH_ENGINES ] = { 0, 0 };
+    struct program * program [ BENCH_ENGINES ];
+    unsigned int seed = 42, errors = 0;
+    struct node_pool * pool;
+    char * str;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    for ( unsigned int i = 0; i < BENCH_ROWS * BENCH_SLOTS; i++ ) {
+        rows [ 0 ] [ i ] = number_from_double ( ( double ) ( bench_random (
+            &seed ) % 2001 ) / 1000.0 - 1.0 );
+        rows [ 1 ] [ i ] = number_from_double ( ( double ) ( bench_random (
+            &seed ) % 2001 ) / 1e6 + 0.999 );
+    }
+
+    printf ( "%-7s %5s %-11s %9s %9s %9s %9s %9s\n", "shape", "terms", "mode",
+        "stack ns", "speedup", "native ns", "speedup", "rel error" );
+
+    for ( unsigned int s = 0; s < BENCH_SHAPES; s++ )
+        for ( unsigned long terms = 64; terms <= 4096; terms <<= 2 ) {
+            const unsigned long repeats = BENCH_TERMS / terms;
+
+            if ( ! ( str = formula ( terms, ( int ) s ) ) ) {
+                perror ( "Could not generate the formula" );
+                return EXIT_FAILURE;
+            }
+
+            reference ( rows [ s ], terms, ( int ) s, ref );
+
+            for ( unsigned int m = 0; m < BENCH_MODES; m++ ) {
+                for ( unsigned int k = 0; k < BENCH_ENGINES; k++ ) {
+                    if ( ! ( program [ k ] = compile ( pool, str, passes [ m ],
+                            engines [ k ] ) ) )
+                        return EXIT_FAILURE;
+
+                    measure ( program [ k ], rows [ s ], BENCH_WARMUP,
+                        out [ k ] );
+                    t [ k ] = measure ( program [ k ], rows [ s ], repeats,
+                        out [ k ] );
+
+                    if ( m == 0 )
+                        serial [ k ] = t [ k ];
+
+                    program_destruct ( program [ k ] );
+                }
+
+                for ( unsigned int i = 0; i < BENCH_ROWS; i++ )
+                    if ( memcmp ( & ( out [ 0 ] [ i ] ), & ( out [ 1 ] [ i ] ),
+                            sizeof ( number_t ) ) &&
+                            !( number_is_invalid ( out [ 0 ] [ i ] ) &&
+                            number_is_invalid ( out [ 1 ] [ i ] ) ) )
+                        errors++;
+
+                /* Each speedup is over serial evaluation by the same engine */
+                printf ( "%-7s %5lu %-11s %9.1f %8.2fx %9.1f %8.2fx %9.2e\n",
+                    shapes [ s ], terms, modes [ m ],
+                    t [ 0 ] / ( double ) repeats, serial [ 0 ] / t [ 0 ],
+                    t [ 1 ] / ( double ) repeats, serial [ 1 ] / t [ 1 ],
+                    relative_error ( out [ 0 ], ref ) );
+            }
+
+            free ( str );
+        }
+
+    printf ( "%u result(s) differ between the engines\n", errors );
+
+    pool_destruct ( pool );
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
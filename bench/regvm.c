@@ -0,0 +1,203 @@
+/**
+ * Compare the stack engine against the register engine (see 'program_select')
+ * on deep and wide formulas in three variables, reporting the instructions
+ * executed by each engine per evaluation, and the time taken per evaluation.
+ * The results of both engines are compared bit-for-bit.
+ *
+ *  - Wide formulas are flat sums of products, such as "x*1.5+y*2.5-z*3.5",
+ *    whose value stack never grows beyond three values; and
+ *
+ *  - Deep formulas are right-nested, such as "x-(y*(z+(x/...)))", whose value
+ *    stack grows with their length, and whose register code must spill once
+ *    the register file is exhausted.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "bench.h"
+
+/**
+ * The total number of operators to evaluate for each formula, such that
+ * shorter formulas are evaluated more often
+ */
+#define BENCH_OPERATORS 40000000UL
+
+/**
+ * The number of distinct rows of variables
+ */
+#define BENCH_ROWS 1024U
+
+/**
+ * The number of variables
+ */
+#define BENCH_SLOTS 3U
+
+/**
+ * Generate a wide or deep formula with the given number of operators.
+ *
+ * @param operators the number of operators
+ * @param deep whether the formula should be deep, rather than wide
+ * @return the new formula, to be freed by the caller, or NULL on failure
+ */
+static char * formula ( unsigned long operators, int deep )
+{
+    static const char variables [ ] = "xyz";
+    static const char ops [ ] = "+-*/";
+    char * expr, * head;
+
+    /* No operand, with its operator and parentheses, is longer than sixteen
+     * characters */
+    if ( ! ( head = expr = malloc ( operators * 16 + 16 ) ) )
+        return NULL;
+
+    if ( deep ) {
+        for ( unsigned long i = 0; i < operators; i++ )
+            head += sprintf ( head, "%c%c(", variables [ i % BENCH_SLOTS ],
+                ops [ i % 4 ] );
+
+        *head++ = 'x';
+        memset ( head, ')', operators );
+        head [ operators ] = '\0';
+    } else {
+        head += sprintf ( head, "x" );
+
+        /* Each term is a product, so adds two operators */
+        for ( unsigned long i = 0; i + 2 <= operators; i += 2 )
+            head += sprintf ( head, "%c%c*%lu.5", "+-"[ i / 2 % 2 ],
+                variables [ i / 2 % BENCH_SLOTS ], i / 2 % 9 + 1 );
+    }
+
+    return expr;
+}
+
+/**
+ * Compile a formula for the given engine.
+ *
+ * @param pool the node pool, which is reset before use
+ * @param str the formula
+ * @param engine the engine
+ * @return the program, or NULL on failure
+ */
+static struct program * compile ( struct node_pool * pool, const char * str,
+        enum prog_engine engine )
+{
+    static const char * const names [ BENCH_SLOTS ] = { "x", "y", "z" };
+    struct expression * expr;
+    struct program * program = NULL;
+    enum expr_status status;
+
+    if ( ! ( expr = expression_initialise ( str, 0, NULL ) ) )
+        return NULL;
+
+    expression_bind ( expr, names, BENCH_SLOTS );
+    pool_reset ( pool );
+
+    if ( ( status = expression_parse ( expr, pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( expr, &program ) ) != EXPR_OK )
+        expression_perror ( expr, "Could not compile the formula", status );
+
+    else if ( program_select ( program, engine ) ) {
+        perror ( "Could not select the engine" );
+        program_destruct ( program );
+        program = NULL;
+    }
+
+    expression_destruct ( expr );
+    return program;
+}
+
+/**
+ * Evaluate a program over the rows repeatedly, and measure the time taken.
+ *
+ * @param program the program
+ * @param rows the rows of variables
+ * @param repeats the number of evaluations
+ * @param out the destination of the results, one per row
+ * @return the time taken, in nanoseconds
+ */
+static double measure ( const struct program * program,
+        const number_t * rows, unsigned long repeats, number_t * out )
+{
+    double start = bench_now ( );
+
+    for ( unsigned long i = 0; i < repeats; i++ )
+        out [ i % BENCH_ROWS ] = program_evaluate ( program,
+            & ( rows [ i % BENCH_ROWS * BENCH_SLOTS ] ) );
+
+    return bench_now ( ) - start;
+}
+
+int main ( void )
+{
+    static const char * const engines [ 2 ] = { "stack", "register" };
+    number_t rows [ BENCH_ROWS * BENCH_SLOTS ], out [ 2 ] [ BENCH_ROWS ];
+    struct program * program [ 2 ];
+    unsigned int seed = 42, errors = 0;
+    struct node_pool * pool;
+    double t [ 2 ];
+    char * str;
+
+    if ( ! ( pool = pool_initialise ( 0, NULL ) ) ) {
+        perror ( "Could not initialise the node pool" );
+        return EXIT_FAILURE;
+    }
+
+    /* Operands lie in [1, 3], so that deep quotients stay finite */
+    for ( unsigned int i = 0; i < BENCH_ROWS * BENCH_SLOTS; i++ )
+        rows [ i ] = ( number_t ) ( bench_random ( &seed ) % 2001 ) /
+            1000.0f + 1.0f;
+
+    printf ( "%-5s %9s %10s %10s %10s %10s %8s\n", "shape", "operators",
+        "stack ins", "reg ins", "stack ns", "reg ns", "speedup" );
+
+    for ( int deep = 0; deep < 2; deep++ )
+        for ( unsigned long operators = 16; operators <= 4096;
+                operators <<= 2 ) {
+            const unsigned long repeats = BENCH_OPERATORS / operators;
+
+            if ( ! ( str = formula ( operators, deep ) ) ) {
+                perror ( "Could not generate the formula" );
+                return EXIT_FAILURE;
+            }
+
+            for ( int k = 0; k < 2; k++ ) {
+                if ( ! ( program [ k ] = compile ( pool, str,
+                        k ? PROG_ENGINE_REGISTER : PROG_ENGINE_STACK ) ) )
+                    return EXIT_FAILURE;
+
+                t [ k ] = measure ( program [ k ], rows, repeats, out [ k ] );
+            }
+
+            for ( unsigned int i = 0; i < BENCH_ROWS; i++ )
+                if ( memcmp ( & ( out [ 0 ] [ i ] ), & ( out [ 1 ] [ i ] ),
+                        sizeof ( number_t ) ) &&
+                        !( isnan ( out [ 0 ] [ i ] ) &&
+                        isnan ( out [ 1 ] [ i ] ) ) )
+                    errors++;
+
+            printf ( "%-5s %9lu %10u %10u %10.1f %10.1f %7.2fx\n",
+                deep ? "deep" : "wide", operators,
+                program_length ( program [ 0 ] ),
+                program_length ( program [ 1 ] ),
+                t [ 0 ] / ( double ) repeats, t [ 1 ] / ( double ) repeats,
+                t [ 0 ] / t [ 1 ] );
+
+            program_destruct ( program [ 0 ] );
+            program_destruct ( program [ 1 ] );
+            free ( str );
+        }
+
+    printf ( "%u result(s) differ between %s and %s\n", errors,
+        engines [ 0 ], engines [ 1 ] );
+
+    pool_destruct ( pool );
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
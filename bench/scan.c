@@ -0,0 +1,189 @@
+/**
+ * Compare the dedicated literal scanner ('scan_number') against strtof(3), for
+ * both speed and agreement. Every generated literal is scanned by both, and any
+ * difference in the consumed length or in the bits of the value is reported;
+ * the driver fails if any literal disagrees.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+
+#include "node.h"
+#include "scan.h"
+#include "debug.h"
+#include "bench.h"
+
+/**
+ * The number of generated literals
+ */
+#define BENCH_LITERALS 1000000U
+
+/**
+ * The number of passes over the literals for the timing measurements
+ */
+#define BENCH_PASSES 10U
+
+/**
+ * The capacity of each literal
+ */
+#define BENCH_LITERAL_SIZE 48U
+
+/**
+ * The number of literal styles that are typical of hand-written expressions;
+ * the remaining styles exercise the full range of the scanner
+ */
+#define BENCH_TYPICAL_STYLES 3U
+
+/**
+ * The total number of literal styles
+ */
+#define BENCH_STYLES 6U
+
+/**
+ * Generate a literal in one of several styles: short integers, short decimals,
+ * decimals with exponents, long decimals, and the shortest and hexadecimal
+ * representations of random floats.
+ *
+ * @param buffer the destination of the literal
+ * @param seed the generator state
+ * @param styles the number of styles from which to choose
+ */
+static void generate ( char * buffer, unsigned int * seed,
+        unsigned int styles )
+{
+    unsigned int bits;
+    float value;
+
+    switch ( bench_random ( seed ) % styles ) {
+        case 0:
+            sprintf ( buffer, "%u", bench_random ( seed ) % 100000 );
+            break;
+
+        case 1:
+            sprintf ( buffer, "%u.%02u", bench_random ( seed ) % 1000,
+                bench_random ( seed ) % 100 );
+            break;
+
+        case 2:
+            sprintf ( buffer, "%u.%ue%d", bench_random ( seed ) % 10,
+                bench_random ( seed ) % 1000,
+                ( int ) ( bench_random ( seed ) % 80 ) - 40 );
+            break;
+
+        case 3:
+            sprintf ( buffer, "%u%u%u.%u", bench_random ( seed ),
+                bench_random ( seed ), bench_random ( seed ),
+                bench_random ( seed ) );
+            break;
+
+        default:
+            do {
+                bits = bench_random ( seed ) & 0x7fffffffU;
+                memcpy ( &value, &bits, sizeof ( value ) );
+            } while ( !isfinite ( value ) );
+
+            sprintf ( buffer, ( bench_random ( seed ) & 1 ) ? "%.9g" : "%a",
+                ( double ) value );
+    }
+}
+
+/**
+ * Scan a literal with the C library, with the same acceptance rules as the
+ * dedicated scanner.
+ *
+ * @param str the literal
+ * @param value the destination of the value
+ * @return the length of the literal, or zero if it was rejected
+ */
+static unsigned int reference ( const char * str, number_t * value )
+{
+    char * end_ptr;
+
+    errno = 0;
+    *value = strtof ( str, &end_ptr );
+
+    return errno ? 0 : ( unsigned int ) ( end_ptr - str );
+}
+
+/**
+ * Generate a set of literals, check that the scanner agrees with the C library
+ * on every one, and compare their speeds.
+ *
+ * @param name the name of the set
+ * @param literals space for the literals
+ * @param styles the number of literal styles from which to choose
+ * @return the number of disagreements
+ */
+static unsigned int compare ( const char * name, char * literals,
+        unsigned int styles )
+{
+    unsigned int seed = 42, mismatches = 0, l1, l2;
+    double start, scanner, library;
+    number_t v1, v2, sink = 0;
+
+    for ( unsigned int i = 0; i < BENCH_LITERALS; i++ )
+        generate ( & ( literals [ i * BENCH_LITERAL_SIZE ] ), &seed, styles );
+
+    for ( unsigned int i = 0; i < BENCH_LITERALS; i++ ) {
+        const char * str = & ( literals [ i * BENCH_LITERAL_SIZE ] );
+
+        v1 = v2 = 0;
+        l1 = scan_number ( str, &v1 );
+        l2 = reference ( str, &v2 );
+
+        if ( l1 != l2 || ( l1 && memcmp ( &v1, &v2, sizeof ( v1 ) ) ) ) {
+            if ( mismatches++ < 10 )
+                printf ( "Mismatch on \"%s\": %u:%a vs. %u:%a\n", str, l1,
+                    ( double ) v1, l2, ( double ) v2 );
+        }
+    }
+
+    start = bench_now ( );
+    for ( unsigned int pass = 0; pass < BENCH_PASSES; pass++ )
+        for ( unsigned int i = 0; i < BENCH_LITERALS; i++ ) {
+            scan_number ( & ( literals [ i * BENCH_LITERAL_SIZE ] ), &v1 );
+            sink += v1;
+        }
+    scanner = bench_now ( ) - start;
+
+    start = bench_now ( );
+    for ( unsigned int pass = 0; pass < BENCH_PASSES; pass++ )
+        for ( unsigned int i = 0; i < BENCH_LITERALS; i++ ) {
+            reference ( & ( literals [ i * BENCH_LITERAL_SIZE ] ), &v2 );
+            sink += v2;
+        }
+    library = bench_now ( ) - start;
+
+    printf ( "%-10s %11u %11u %11.2f %11.2f %7.2fx\n", name, BENCH_LITERALS,
+        mismatches, scanner / ( BENCH_LITERALS * BENCH_PASSES ),
+        library / ( BENCH_LITERALS * BENCH_PASSES ), library / scanner );
+    debug_printf ( "Checksum: %g\n", ( double ) sink );
+
+    return mismatches;
+}
+
+int main ( void )
+{
+    unsigned int mismatches;
+    char * literals;
+
+    if ( ! ( literals = malloc ( BENCH_LITERALS * BENCH_LITERAL_SIZE ) ) ) {
+        perror ( "Could not allocate the literals" );
+        return EXIT_FAILURE;
+    }
+
+    printf ( "%-10s %11s %11s %11s %11s %8s\n", "set", "literals",
+        "mismatches", "scan ns/lit", "strtof ns", "speedup" );
+
+    mismatches = compare ( "typical", literals, BENCH_TYPICAL_STYLES );
+    mismatches += compare ( "full-range", literals, BENCH_STYLES );
+
+    free ( literals );
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
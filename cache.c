@@ -0,0 +1,478 @@
+/**
+ * Implement the compiled-expression cache interface; see 'cache.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "debug.h"
+
+#include "cache.h"
+
+/**
+ * The initial number of hash buckets; this is always a power of two
+ */
+#define CACHE_BUCKETS 64U
+
+/**
+ * The punctuation characters: those that always form a token on their own
+ */
+#define CACHE_PUNCT "+-*/^()[]{}"
+
+/**
+ * A cached program and its normalised key
+ */
+struct entry {
+    /**
+     * The next entry in the same hash bucket
+     */
+    struct entry * chain;
+
+    /**
+     * The previous entry in the CLOCK ring
+     */
+    struct entry * prev;
+
+    /**
+     * The next entry in the CLOCK ring
+     */
+    struct entry * next;
+
+    /**
+     * The compiled program
+     */
+    struct program * program;
+
+    /**
+     * The hash of the key
+     */
+    uint64_t hash;
+
+    /**
+     * The memory held by the entry, its key, and its program
+     */
+    size_t footprint;
+
+    /**
+     * The length of the key
+     */
+    size_t length;
+
+    /**
+     * Has the entry been found since the hand last passed it?
+     */
+    bool referenced;
+
+    /**
+     * The normalised key, allocated in-line with the entry
+     */
+    char key [ ];
+};
+
+/**
+ * The transparent cache
+ */
+struct cache {
+    /**
+     * The hash buckets, each a chain of entries
+     */
+    struct entry ** buckets;
+
+    /**
+     * The number of hash buckets
+     */
+    unsigned int bucket_count;
+
+    /**
+     * The CLOCK hand: the next entry to be considered for eviction, or NULL if
+     * the cache is empty
+     */
+    struct entry * hand;
+
+    /**
+     * The memory budget in bytes
+     */
+    size_t budget;
+
+    /**
+     * The node pool used to compile missing programs
+     */
+    struct node_pool * pool;
+
+    /**
+     * The expression used to compile missing programs
+     */
+    struct expression * expr;
+
+    /**
+     * The most recent program that was too large for the budget, held only
+     * until the next lookup
+     */
+    struct program * transient;
+
+    /**
+     * The normalised key of the current lookup
+     */
+    char * key;
+
+    /**
+     * The capacity of the key buffer, in bytes
+     */
+    size_t key_capacity;
+
+    /**
+     * The counters
+     */
+    struct cache_stats stats;
+};
+
+/**
+ * Is the given character punctuation?
+ *
+ * @param c the character
+ * @return the class of the character
+ */
+static inline bool is_punct ( char c )
+{
+    return c && strchr ( CACHE_PUNCT, c );
+}
+
+/**
+ * Might the given character introduce the exponent of a literal, such that a
+ * following sign would be taken into the literal?
+ *
+ * @param c the character
+ * @return the class of the character
+ */
+static inline bool is_exponent ( char c )
+{
+    return c == 'e' || c == 'E' || c == 'p' || c == 'P';
+}
+
+/**
+ * Must the white-space between the normalised key so far and the next
+ * character be kept? White-space separates two tokens that would otherwise
+ * merge, and a sign from a preceding exponent marker, which would otherwise be
+ * scanned as part of a literal; anywhere else, it can be removed. A single
+ * space is kept in place of any run of white-space.
+ *
+ * @param key the normalised key so far, which is not empty
+ * @param n the length of the key so far
+ * @param next the next character
+ * @return whether a space must be kept
+ */
+static bool keep_space ( const char * key, size_t n, char next )
+{
+    const char prev = key [ n - 1 ];
+
+    if ( ( next == '+' || next == '-' ) && is_exponent ( prev ) )
+        return true;
+
+    if ( ( prev == '+' || prev == '-' ) && n > 1 &&
+            is_exponent ( key [ n - 2 ] ) )
+        return true;
+
+    return !is_punct ( prev ) && !is_punct ( next );
+}
+
+size_t cache_normalise ( const char * str, char * key, uint64_t * hash )
+{
+    uint64_t h = UINT64_C ( 0xcbf29ce484222325 );
+    bool space = false;
+    size_t n = 0;
+    char c;
+
+    for ( ; ( c = *str ); str++ ) {
+        if ( c == ' ' || ( c >= '\t' && c <= '\r' ) ) {
+            space = true;
+            continue;
+        }
+
+        if ( space && n && keep_space ( key, n, c ) )
+            key [ n++ ] = ' ';
+
+        switch ( c ) {
+            case '[': case '{': c = '('; break;
+            case ']': case '}': c = ')'; break;
+            default: break;
+        }
+
+        key [ n++ ] = c;
+        space = false;
+    }
+
+    key [ n ] = '\0';
+
+    for ( size_t i = 0; i < n; i++ )
+        h = ( h ^ ( unsigned char ) key [ i ] ) * UINT64_C ( 0x100000001b3 );
+
+    *hash = h;
+    return n;
+}
+
+/**
+ * Normalise an expression into the key buffer, growing it as necessary.
+ *
+ * @param self the cache
+ * @param str the infix string expression
+ * @param hash the destination of the hash
+ * @return the length of the key, or -1 if the key buffer could not be grown
+ */
+static long normalise ( struct cache * self, const char * str,
+        uint64_t * hash )
+{
+    const size_t length = strlen ( str );
+    char * key;
+
+    if ( length >= self->key_capacity ) {
+        if ( ! ( key = realloc ( self->key, length + 1 ) ) )
+            return -1;
+
+        self->key = key;
+        self->key_capacity = length + 1;
+    }
+
+    return ( long ) cache_normalise ( str, self->key, hash );
+}
+
+/**
+ * Find the bucket in which an entry with the given hash is chained.
+ *
+ * @param self the cache
+ * @param hash the hash
+ * @return the head of the bucket
+ */
+static inline struct entry ** bucket ( struct cache * self, uint64_t hash )
+{
+    return & ( self->buckets [ hash & ( self->bucket_count - 1 ) ] );
+}
+
+/**
+ * Double the number of hash buckets, and redistribute the entries.
+ *
+ * @param self the cache
+ * @return zero on success, or -1 on failure
+ */
+static int grow_buckets ( struct cache * self )
+{
+    struct entry ** old = self->buckets, * entry, * chain;
+    const unsigned int old_count = self->bucket_count;
+
+    if ( ! ( self->buckets = calloc ( old_count << 1,
+            sizeof ( struct entry * ) ) ) ) {
+        self->buckets = old;
+        return -1;
+    }
+
+    self->bucket_count = old_count << 1;
+
+    for ( unsigned int i = 0; i < old_count; i++ )
+        for ( entry = old [ i ]; entry; entry = chain ) {
+            chain = entry->chain;
+            entry->chain = *bucket ( self, entry->hash );
+            *bucket ( self, entry->hash ) = entry;
+        }
+
+    free ( old );
+    return 0;
+}
+
+/**
+ * Evict one entry, as chosen by the CLOCK hand. The cache must not be empty.
+ *
+ * @param self the cache
+ */
+static void evict ( struct cache * self )
+{
+    struct entry * victim, ** link;
+
+    while ( self->hand->referenced ) {
+        self->hand->referenced = false;
+        self->hand = self->hand->next;
+    }
+
+    victim = self->hand;
+
+    if ( victim->next == victim )
+        self->hand = NULL;
+    else {
+        victim->prev->next = victim->next;
+        victim->next->prev = victim->prev;
+        self->hand = victim->next;
+    }
+
+    for ( link = bucket ( self, victim->hash ); *link != victim;
+            link = & ( ( *link )->chain ) )
+        ;
+
+    *link = victim->chain;
+
+    self->stats.footprint -= victim->footprint;
+    self->stats.entries--;
+    self->stats.evictions++;
+
+    program_destruct ( victim->program );
+    free ( victim );
+}
+
+/**
+ * Insert a program under the current key, evicting entries as necessary to
+ * respect the budget. A program too large for the whole budget is held as the
+ * transient program instead.
+ *
+ * @param self the cache
+ * @param program the program
+ * @param length the length of the current key
+ * @param hash the hash of the current key
+ * @return zero on success, or -1 on failure, in which case the program has
+ *      been destructed
+ */
+static int insert ( struct cache * self, struct program * program,
+        size_t length, uint64_t hash )
+{
+    const size_t footprint = sizeof ( struct entry ) + length + 1 +
+        program_footprint ( program );
+    struct entry * entry;
+
+    if ( footprint > self->budget ) {
+        self->transient = program;
+        return 0;
+    }
+
+    while ( self->stats.footprint + footprint > self->budget )
+        evict ( self );
+
+    if ( ( self->stats.entries >= self->bucket_count &&
+            grow_buckets ( self ) ) ||
+            ! ( entry = malloc ( sizeof ( struct entry ) + length + 1 ) ) ) {
+        program_destruct ( program );
+        return -1;
+    }
+
+    entry->program = program;
+    entry->hash = hash;
+    entry->footprint = footprint;
+    entry->length = length;
+    entry->referenced = false;
+    memcpy ( entry->key, self->key, length + 1 );
+
+    entry->chain = *bucket ( self, hash );
+    *bucket ( self, hash ) = entry;
+
+    /* The entry joins the ring just behind the hand, so it is the last to be
+     * considered for eviction. */
+    if ( self->hand ) {
+        entry->next = self->hand;
+        entry->prev = self->hand->prev;
+        entry->prev->next = entry;
+        self->hand->prev = entry;
+    } else
+        self->hand = entry->next = entry->prev = entry;
+
+    self->stats.footprint += footprint;
+    self->stats.entries++;
+
+    return 0;
+}
+
+struct cache * cache_initialise ( size_t budget, const char * const * names,
+        unsigned int count )
+{
+    struct cache * self;
+
+    if ( ! ( self = calloc ( 1, sizeof ( struct cache ) ) ) )
+        return NULL;
+
+    if ( ! ( self->buckets = calloc ( CACHE_BUCKETS,
+            sizeof ( struct entry * ) ) ) ||
+            ! ( self->pool = pool_initialise ( 0, NULL ) ) ||
+            ! ( self->expr = expression_initialise ( "", 0, NULL ) ) ) {
+        cache_destruct ( self );
+        return NULL;
+    }
+
+    self->bucket_count = CACHE_BUCKETS;
+    self->budget = budget;
+    expression_bind ( self->expr, names, count );
+
+    debug_puts ( "Cache initialised" );
+    return self;
+}
+
+void cache_destruct ( struct cache * self )
+{
+    if ( self ) {
+        while ( self->hand )
+            evict ( self );
+
+        debug_printf ( "Cache destructed after %lu hit(s), %lu miss(es), and "
+            "%lu eviction(s)\n", self->stats.hits, self->stats.misses,
+            self->stats.evictions );
+
+        program_destruct ( self->transient );
+        expression_destruct ( self->expr );
+        pool_destruct ( self->pool );
+        free ( self->buckets );
+        free ( self->key );
+        free ( self );
+    }
+}
+
+enum expr_status cache_compile ( struct cache * self, const char * str,
+        const struct program ** program )
+{
+    enum expr_status status;
+    struct program * compiled;
+    struct entry * entry;
+    uint64_t hash;
+    long length;
+
+    program_destruct ( self->transient );
+    self->transient = NULL;
+
+    if ( ( length = normalise ( self, str, &hash ) ) < 0 )
+        return EXPR_NOEXPR;
+
+    for ( entry = *bucket ( self, hash ); entry; entry = entry->chain )
+        if ( entry->hash == hash && entry->length == ( size_t ) length &&
+                !memcmp ( entry->key, self->key, ( size_t ) length ) ) {
+            entry->referenced = true;
+            self->stats.hits++;
+            *program = entry->program;
+            return EXPR_OK;
+        }
+
+    self->stats.misses++;
+    pool_reset ( self->pool );
+    expression_reset ( self->expr, str );
+
+    if ( ( status = expression_parse ( self->expr, self->pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( self->expr, &compiled ) ) !=
+            EXPR_OK )
+        return status;
+
+    if ( insert ( self, compiled, ( size_t ) length, hash ) )
+        return EXPR_NOEXPR;
+
+    *program = compiled;
+    return EXPR_OK;
+}
+
+void cache_perror ( struct cache * self, const char * msg,
+        enum expr_status status )
+{
+    expression_perror ( self->expr, msg, status );
+}
+
+void cache_stats ( const struct cache * self, struct cache_stats * stats )
+{
+    *stats = self->stats;
+}
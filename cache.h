@@ -0,0 +1,133 @@
+/**
+ * This interface caches compiled programs by the text of their expressions, so
+ * that an expression seen before is evaluated without being parsed again. The
+ * text is first normalised: white-space that cannot affect tokenisation is
+ * removed, and every bracket style is rewritten as a parenthesis, since the
+ * tokeniser treats "[({" and ")]}" alike. Expressions that differ only in these
+ * respects share an entry.
+ *
+ * The cache is bounded by a memory budget, which covers its entries, their
+ * keys, and their programs. When an insertion would exceed the budget, entries
+ * are evicted by the CLOCK algorithm: each entry has a reference bit, set on
+ * every hit, and a hand sweeps the entries in insertion order, clearing set
+ * bits and evicting the first entry whose bit is already clear. This
+ * approximates least-recently-used eviction, without reordering anything on a
+ * hit.
+ *
+ * A cache is not safe for concurrent use; each thread should have its own, or
+ * the threads should share a concurrent cache (see 'ccache.h').
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "expr.h"
+#include "prog.h"
+
+/**
+ * The base opaque type of a cache
+ */
+struct cache;
+
+/**
+ * The counters of a cache
+ */
+struct cache_stats {
+    /**
+     * The number of lookups that found a program
+     */
+    unsigned long hits;
+
+    /**
+     * The number of lookups that compiled a program
+     */
+    unsigned long misses;
+
+    /**
+     * The number of entries evicted to respect the budget
+     */
+    unsigned long evictions;
+
+    /**
+     * The number of entries currently held
+     */
+    unsigned int entries;
+
+    /**
+     * The memory currently held by the entries, in bytes
+     */
+    size_t footprint;
+};
+
+/**
+ * Initialise a cache with the given memory budget. Identifiers in cached
+ * expressions are resolved against the given variable names, exactly as by
+ * 'expression_bind'. If this function fails, then 'errno' is set appropriately.
+ *
+ * @param budget the memory budget in bytes
+ * @param names the list of variable names, or NULL; this is not copied, so it
+ *      must outlive the cache
+ * @param count the number of given names
+ * @return the new cache, or NULL on failure
+ */
+struct cache * cache_initialise ( size_t budget, const char * const * names,
+    unsigned int count );
+
+/**
+ * Destruct a cache, and every program it holds.
+ *
+ * @param self the cache to be destructed
+ */
+void cache_destruct ( struct cache * self );
+
+/**
+ * Find the program for the given expression, compiling and inserting it if it
+ * is not already held. The program belongs to the cache: it remains valid only
+ * until the next call to 'cache_compile' or 'cache_destruct'.
+ *
+ * @param self the cache
+ * @param str the infix string expression
+ * @param program the destination of the program; this is only written if the
+ *      function succeeds
+ * @return a status code according to the standard expression error schema
+ */
+enum expr_status cache_compile ( struct cache * self, const char * str,
+    const struct program ** program );
+
+/**
+ * Print a report of the status of the most recent failed compilation, exactly
+ * as by 'expression_perror'.
+ *
+ * @param self the cache
+ * @param msg a prefix string, or NULL
+ * @param status the status to interpret
+ */
+void cache_perror ( struct cache * self, const char * msg,
+    enum expr_status status );
+
+/**
+ * Normalise an expression into the key under which its program is cached, and
+ * hash the key with 64-bit FNV-1a.
+ *
+ * @param str the infix string expression
+ * @param key the destination of the NULL-terminated key, which must have room
+ *      for at least as many bytes as the expression, including its terminator
+ * @param hash the destination of the hash
+ * @return the length of the key
+ */
+size_t cache_normalise ( const char * str, char * key, uint64_t * hash );
+
+/**
+ * Read the counters of a cache.
+ *
+ * @param self the cache
+ * @param stats the destination of the counters
+ */
+void cache_stats ( const struct cache * self, struct cache_stats * stats );
+
+#endif /* CACHE_H */
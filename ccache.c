@@ -0,0 +1,711 @@
+/**
+ * Implement the concurrent compiled-expression cache interface; see 'ccache.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "node.h"
+#include "expr.h"
+#include "prog.h"
+#include "cache.h"
+#include "debug.h"
+
+#include "ccache.h"
+
+/**
+ * The smallest number of slots in a table; this is always a power of two
+ */
+#define CCACHE_SLOTS 256U
+
+/**
+ * The number of slots in a new table per live entry. Tables are replaced once
+ * three-quarters of their slots are used, by live entries or tombstones.
+ */
+#define CCACHE_SPREAD 4U
+
+/* NOTES ON CONCURRENCY
+ *
+ * Readers load the current table, probe its slots, and compare keys, all
+ * without locks. Entries are immutable once published, apart from their
+ * reference bits, which readers set only if clear; a hot entry is therefore
+ * written once per sweep of the CLOCK hand, not once per hit.
+ *
+ * Writers (threads that have missed, and must insert a program) are serialised
+ * by the cache lock, which also guards the list of threads and the lists of
+ * retired entries and tables. A writer never modifies a published entry: it
+ * evicts by replacing the slot with a tombstone, and it grows by building a new
+ * table and publishing it in one atomic store.
+ *
+ * Reclamation is by epochs. Each thread announces the global epoch on entry,
+ * and zero on leaving. A writer that retires an object tags it with the current
+ * epoch, then advances the global epoch. Any thread that announces the advanced
+ * epoch must have entered after the object was unlinked, so cannot reach it;
+ * the object may be freed once every thread inside the cache announces a later
+ * epoch than its tag.
+ */
+
+/**
+ * A cached program and its normalised key
+ */
+struct centry {
+    /**
+     * The next retired entry
+     */
+    struct centry * limbo;
+
+    /**
+     * The epoch in which the entry was retired
+     */
+    unsigned long retired;
+
+    /**
+     * The compiled program
+     */
+    struct program * program;
+
+    /**
+     * The hash of the key
+     */
+    uint64_t hash;
+
+    /**
+     * The memory held by the entry, its key, and its program
+     */
+    size_t footprint;
+
+    /**
+     * The length of the key
+     */
+    size_t length;
+
+    /**
+     * Has the entry been found since the hand last passed it?
+     */
+    atomic_bool referenced;
+
+    /**
+     * The normalised key, allocated in-line with the entry
+     */
+    char key [ ];
+};
+
+/**
+ * An open-addressed table of entries
+ */
+struct ctable {
+    /**
+     * The next retired table
+     */
+    struct ctable * limbo;
+
+    /**
+     * The epoch in which the table was retired
+     */
+    unsigned long retired;
+
+    /**
+     * The number of slots
+     */
+    unsigned int capacity;
+
+    /**
+     * The number of slots that hold an entry or a tombstone
+     */
+    unsigned int used;
+
+    /**
+     * The slots, allocated in-line with the table
+     */
+    _Atomic ( struct centry * ) slots [ ];
+};
+
+/**
+ * The transparent concurrent cache
+ */
+struct ccache {
+    /**
+     * The current table
+     */
+    _Atomic ( struct ctable * ) table;
+
+    /**
+     * The global epoch, from one
+     */
+    atomic_ulong epoch;
+
+    /**
+     * The lock that serialises writers, and guards the fields below it
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The registered threads
+     */
+    struct ccache_thread * threads;
+
+    /**
+     * The retired entries, awaiting reclamation, in the order of retirement
+     */
+    struct centry * limbo_entries;
+
+    /**
+     * The link at the end of the retired entries
+     */
+    struct centry ** limbo_tail;
+
+    /**
+     * The retired tables, awaiting reclamation
+     */
+    struct ctable * limbo_tables;
+
+    /**
+     * The slot under the CLOCK hand
+     */
+    unsigned int hand;
+
+    /**
+     * The memory budget in bytes
+     */
+    size_t budget;
+
+    /**
+     * The variable names to which identifiers are bound
+     */
+    const char * const * names;
+
+    /**
+     * The number of bound variable names
+     */
+    unsigned int name_count;
+
+    /**
+     * The counters of the writers, and the hit and miss counters of any
+     * threads that have been unregistered
+     */
+    struct cache_stats stats;
+};
+
+/**
+ * The transparent handle of a thread
+ */
+struct ccache_thread {
+    /**
+     * The cache on which the thread is registered
+     */
+    struct ccache * owner;
+
+    /**
+     * The next registered thread
+     */
+    struct ccache_thread * next;
+
+    /**
+     * The epoch announced by the thread, or zero if it is outside the cache
+     */
+    atomic_ulong epoch;
+
+    /**
+     * The number of lookups by the thread that found a program
+     */
+    atomic_ulong hits;
+
+    /**
+     * The number of lookups by the thread that compiled a program
+     */
+    atomic_ulong misses;
+
+    /**
+     * The node pool used to compile missing programs
+     */
+    struct node_pool * pool;
+
+    /**
+     * The expression used to compile missing programs
+     */
+    struct expression * expr;
+
+    /**
+     * The most recent program that was too large for the budget, held only
+     * until the next lookup
+     */
+    struct program * transient;
+
+    /**
+     * The normalised key of the current lookup
+     */
+    char * key;
+
+    /**
+     * The capacity of the key buffer, in bytes
+     */
+    size_t key_capacity;
+};
+
+/**
+ * The tombstone that marks the slot of an evicted entry
+ */
+static struct centry tombstone;
+
+/**
+ * Allocate an empty table.
+ *
+ * @param capacity the number of slots, which must be a power of two
+ * @return the new table, or NULL on failure
+ */
+static struct ctable * table_initialise ( unsigned int capacity )
+{
+    struct ctable * table;
+
+    if ( ( table = malloc ( sizeof ( struct ctable ) +
+            sizeof ( table->slots [ 0 ] ) * capacity ) ) ) {
+        table->limbo = NULL;
+        table->capacity = capacity;
+        table->used = 0;
+
+        for ( unsigned int i = 0; i < capacity; i++ )
+            atomic_init ( & ( table->slots [ i ] ), NULL );
+    }
+
+    return table;
+}
+
+/**
+ * Find the entry with the given key in a table. This takes no locks.
+ *
+ * @param table the table
+ * @param key the normalised key
+ * @param length the length of the key
+ * @param hash the hash of the key
+ * @return the entry, or NULL if there is none
+ */
+static struct centry * lookup ( struct ctable * table, const char * key,
+        size_t length, uint64_t hash )
+{
+    const unsigned int mask = table->capacity - 1;
+    struct centry * entry;
+
+    for ( unsigned int i = ( unsigned int ) hash & mask, n = 0;
+            n < table->capacity; i = ( i + 1 ) & mask, n++ ) {
+        entry = atomic_load_explicit ( & ( table->slots [ i ] ),
+            memory_order_acquire );
+
+        if ( !entry )
+            break;
+
+        if ( entry != &tombstone && entry->hash == hash &&
+                entry->length == length && !memcmp ( entry->key, key, length ) )
+            return entry;
+    }
+
+    return NULL;
+}
+
+/**
+ * Place an entry in the first free slot of its probe sequence. The caller must
+ * be the only writer of the table, and the table must have a free slot.
+ *
+ * @param table the table
+ * @param entry the entry
+ */
+static void place ( struct ctable * table, struct centry * entry )
+{
+    const unsigned int mask = table->capacity - 1;
+    unsigned int i = ( unsigned int ) entry->hash & mask;
+    struct centry * held;
+
+    while ( ( held = atomic_load_explicit ( & ( table->slots [ i ] ),
+            memory_order_relaxed ) ) && held != &tombstone )
+        i = ( i + 1 ) & mask;
+
+    if ( !held )
+        table->used++;
+
+    atomic_store_explicit ( & ( table->slots [ i ] ), entry,
+        memory_order_release );
+}
+
+/**
+ * Free every retired entry and table that no thread inside the cache can still
+ * reach. The caller must hold the cache lock.
+ *
+ * @param self the cache
+ */
+static void reclaim ( struct ccache * self )
+{
+    unsigned long oldest = atomic_load ( &self->epoch ), epoch;
+    struct ctable ** table, * free_table;
+    struct centry * entry;
+
+    /* Order the unlinking of the retired objects before the reading of the
+     * announcements; this pairs with the fence in 'ccache_enter'. */
+    atomic_thread_fence ( memory_order_seq_cst );
+
+    for ( struct ccache_thread * t = self->threads; t; t = t->next )
+        if ( ( epoch = atomic_load ( &t->epoch ) ) && epoch < oldest )
+            oldest = epoch;
+
+    /* Entries are retired in epoch order, so only a prefix of the list can
+     * be freed; the cost of reclamation is proportional to what is freed. */
+    while ( ( entry = self->limbo_entries ) && entry->retired < oldest ) {
+        self->limbo_entries = entry->limbo;
+        program_destruct ( entry->program );
+        free ( entry );
+    }
+
+    if ( !self->limbo_entries )
+        self->limbo_tail = &self->limbo_entries;
+
+    for ( table = &self->limbo_tables; *table; )
+        if ( ( *table )->retired < oldest ) {
+            free_table = *table;
+            *table = free_table->limbo;
+            free ( free_table );
+        } else
+            table = & ( ( *table )->limbo );
+}
+
+/**
+ * Evict one entry from the current table, as chosen by the CLOCK hand. The
+ * caller must hold the cache lock, and the table must hold a live entry.
+ *
+ * @param self the cache
+ * @param table the current table
+ */
+static void evict ( struct ccache * self, struct ctable * table )
+{
+    const unsigned int mask = table->capacity - 1;
+    struct centry * victim;
+
+    for ( ;; self->hand = ( self->hand + 1 ) & mask ) {
+        victim = atomic_load_explicit ( & ( table->slots [ self->hand ] ),
+            memory_order_relaxed );
+
+        if ( !victim || victim == &tombstone )
+            continue;
+
+        if ( atomic_load_explicit ( &victim->referenced,
+                memory_order_relaxed ) )
+            atomic_store_explicit ( &victim->referenced, false,
+                memory_order_relaxed );
+        else
+            break;
+    }
+
+    atomic_store_explicit ( & ( table->slots [ self->hand ] ), &tombstone,
+        memory_order_release );
+
+    victim->retired = atomic_fetch_add ( &self->epoch, 1 );
+    victim->limbo = NULL;
+    *self->limbo_tail = victim;
+    self->limbo_tail = &victim->limbo;
+
+    self->stats.footprint -= victim->footprint;
+    self->stats.entries--;
+    self->stats.evictions++;
+}
+
+/**
+ * Replace the current table with a new one that is large enough for the live
+ * entries, and free of tombstones. The caller must hold the cache lock.
+ *
+ * @param self the cache
+ * @param table the current table
+ * @return the new table, or NULL on failure
+ */
+static struct ctable * rebuild ( struct ccache * self, struct ctable * table )
+{
+    unsigned int capacity = CCACHE_SLOTS;
+    struct ctable * fresh;
+    struct centry * entry;
+
+    while ( capacity < ( self->stats.entries + 1 ) * CCACHE_SPREAD )
+        capacity <<= 1;
+
+    if ( ! ( fresh = table_initialise ( capacity ) ) )
+        return NULL;
+
+    for ( unsigned int i = 0; i < table->capacity; i++ )
+        if ( ( entry = atomic_load_explicit ( & ( table->slots [ i ] ),
+                memory_order_relaxed ) ) && entry != &tombstone )
+            place ( fresh, entry );
+
+    atomic_store_explicit ( &self->table, fresh, memory_order_release );
+    self->hand = 0;
+
+    table->retired = atomic_fetch_add ( &self->epoch, 1 );
+    table->limbo = self->limbo_tables;
+    self->limbo_tables = table;
+
+    debug_printf ( "Concurrent cache table rebuilt with %u slots\n",
+        capacity );
+    return fresh;
+}
+
+/**
+ * Insert a program under the current key of a thread, unless another thread has
+ * inserted the same key in the meantime. The caller must hold the cache lock.
+ *
+ * @param self the handle of the thread
+ * @param program the program
+ * @param length the length of the current key
+ * @param hash the hash of the current key
+ * @return the program held by the cache for the key, or NULL on failure; the
+ *      given program has been destructed unless it is returned
+ */
+static const struct program * insert ( struct ccache_thread * self,
+        struct program * program, size_t length, uint64_t hash )
+{
+    struct ccache * owner = self->owner;
+    struct ctable * table = atomic_load_explicit ( &owner->table,
+        memory_order_relaxed );
+    const size_t footprint = sizeof ( struct centry ) + length + 1 +
+        program_footprint ( program );
+    struct centry * entry;
+
+    if ( ( entry = lookup ( table, self->key, length, hash ) ) ) {
+        program_destruct ( program );
+        return entry->program;
+    }
+
+    if ( footprint > owner->budget ) {
+        self->transient = program;
+        return program;
+    }
+
+    while ( owner->stats.footprint + footprint > owner->budget )
+        evict ( owner, table );
+
+    if ( ( ( table->used + 1 ) * 4 > table->capacity * 3 &&
+            ! ( table = rebuild ( owner, table ) ) ) ||
+            ! ( entry = malloc ( sizeof ( struct centry ) + length + 1 ) ) ) {
+        program_destruct ( program );
+        return NULL;
+    }
+
+    entry->limbo = NULL;
+    entry->program = program;
+    entry->hash = hash;
+    entry->footprint = footprint;
+    entry->length = length;
+    atomic_init ( &entry->referenced, false );
+    memcpy ( entry->key, self->key, length + 1 );
+
+    place ( table, entry );
+    owner->stats.footprint += footprint;
+    owner->stats.entries++;
+
+    return program;
+}
+
+struct ccache * ccache_initialise ( size_t budget, const char * const * names,
+        unsigned int count )
+{
+    struct ccache * self;
+    struct ctable * table;
+
+    if ( ! ( self = calloc ( 1, sizeof ( struct ccache ) ) ) )
+        return NULL;
+
+    if ( ! ( table = table_initialise ( CCACHE_SLOTS ) ) ) {
+        free ( self );
+        return NULL;
+    }
+
+    atomic_init ( &self->table, table );
+    atomic_init ( &self->epoch, 1 );
+    pthread_mutex_init ( &self->lock, NULL );
+    self->limbo_tail = &self->limbo_entries;
+    self->budget = budget;
+    self->names = names;
+    self->name_count = count;
+
+    debug_puts ( "Concurrent cache initialised" );
+    return self;
+}
+
+void ccache_destruct ( struct ccache * self )
+{
+    struct ctable * table;
+    struct centry * entry;
+
+    if ( self ) {
+        table = atomic_load ( &self->table );
+
+        for ( unsigned int i = 0; i < table->capacity; i++ )
+            if ( ( entry = atomic_load ( & ( table->slots [ i ] ) ) ) &&
+                    entry != &tombstone ) {
+                program_destruct ( entry->program );
+                free ( entry );
+            }
+
+        /* With no threads registered, everything retired is unreachable */
+        reclaim ( self );
+
+        debug_printf ( "Concurrent cache destructed after %lu hit(s), %lu "
+            "miss(es), and %lu eviction(s)\n", self->stats.hits,
+            self->stats.misses, self->stats.evictions );
+
+        free ( table );
+        pthread_mutex_destroy ( &self->lock );
+        free ( self );
+    }
+}
+
+struct ccache_thread * ccache_register ( struct ccache * self )
+{
+    struct ccache_thread * thread;
+
+    if ( ! ( thread = calloc ( 1, sizeof ( struct ccache_thread ) ) ) )
+        return NULL;
+
+    if ( ! ( thread->pool = pool_initialise ( 0, NULL ) ) ||
+            ! ( thread->expr = expression_initialise ( "", 0, NULL ) ) ) {
+        pool_destruct ( thread->pool );
+        free ( thread );
+        return NULL;
+    }
+
+    thread->owner = self;
+    atomic_init ( &thread->epoch, 0 );
+    atomic_init ( &thread->hits, 0 );
+    atomic_init ( &thread->misses, 0 );
+    expression_bind ( thread->expr, self->names, self->name_count );
+
+    pthread_mutex_lock ( &self->lock );
+    thread->next = self->threads;
+    self->threads = thread;
+    pthread_mutex_unlock ( &self->lock );
+
+    return thread;
+}
+
+void ccache_unregister ( struct ccache_thread * self )
+{
+    struct ccache * owner;
+    struct ccache_thread ** link;
+
+    if ( !self )
+        return;
+
+    owner = self->owner;
+    pthread_mutex_lock ( &owner->lock );
+
+    for ( link = &owner->threads; *link != self; link = & ( ( *link )->next ) )
+        ;
+
+    *link = self->next;
+    owner->stats.hits += atomic_load ( &self->hits );
+    owner->stats.misses += atomic_load ( &self->misses );
+    pthread_mutex_unlock ( &owner->lock );
+
+    program_destruct ( self->transient );
+    expression_destruct ( self->expr );
+    pool_destruct ( self->pool );
+    free ( self->key );
+    free ( self );
+}
+
+void ccache_enter ( struct ccache_thread * self )
+{
+    atomic_store ( &self->epoch, atomic_load ( &self->owner->epoch ) );
+
+    /* Order the announcement before any read of the table; this pairs with
+     * the fence in 'reclaim'. */
+    atomic_thread_fence ( memory_order_seq_cst );
+}
+
+void ccache_leave ( struct ccache_thread * self )
+{
+    atomic_store_explicit ( &self->epoch, 0, memory_order_release );
+}
+
+enum expr_status ccache_compile ( struct ccache_thread * self,
+        const char * str, const struct program ** program )
+{
+    struct ccache * owner = self->owner;
+    const size_t capacity = strlen ( str ) + 1;
+    const struct program * found;
+    enum expr_status status;
+    struct program * compiled;
+    struct centry * entry;
+    uint64_t hash;
+    size_t length;
+    char * key;
+
+    program_destruct ( self->transient );
+    self->transient = NULL;
+
+    if ( capacity > self->key_capacity ) {
+        if ( ! ( key = realloc ( self->key, capacity ) ) )
+            return EXPR_NOEXPR;
+
+        self->key = key;
+        self->key_capacity = capacity;
+    }
+
+    length = cache_normalise ( str, self->key, &hash );
+
+    if ( ( entry = lookup ( atomic_load_explicit ( &owner->table,
+            memory_order_acquire ), self->key, length, hash ) ) ) {
+        if ( !atomic_load_explicit ( &entry->referenced,
+                memory_order_relaxed ) )
+            atomic_store_explicit ( &entry->referenced, true,
+                memory_order_relaxed );
+
+        atomic_store_explicit ( &self->hits, atomic_load_explicit (
+            &self->hits, memory_order_relaxed ) + 1, memory_order_relaxed );
+        *program = entry->program;
+        return EXPR_OK;
+    }
+
+    atomic_store_explicit ( &self->misses, atomic_load_explicit (
+        &self->misses, memory_order_relaxed ) + 1, memory_order_relaxed );
+
+    /* Compile outside the lock, so that misses in different threads are only
+     * serialised for their insertions. */
+    pool_reset ( self->pool );
+    expression_reset ( self->expr, str );
+
+    if ( ( status = expression_parse ( self->expr, self->pool ) ) != EXPR_OK ||
+            ( status = expression_compile ( self->expr, &compiled ) ) !=
+            EXPR_OK )
+        return status;
+
+    pthread_mutex_lock ( &owner->lock );
+    found = insert ( self, compiled, length, hash );
+    reclaim ( owner );
+    pthread_mutex_unlock ( &owner->lock );
+
+    if ( !found )
+        return EXPR_NOEXPR;
+
+    *program = found;
+    return EXPR_OK;
+}
+
+void ccache_perror ( struct ccache_thread * self, const char * msg,
+        enum expr_status status )
+{
+    expression_perror ( self->expr, msg, status );
+}
+
+void ccache_stats ( struct ccache * self, struct cache_stats * stats )
+{
+    pthread_mutex_lock ( &self->lock );
+    *stats = self->stats;
+
+    for ( struct ccache_thread * t = self->threads; t; t = t->next ) {
+        stats->hits += atomic_load_explicit ( &t->hits, memory_order_relaxed );
+        stats->misses += atomic_load_explicit ( &t->misses,
+            memory_order_relaxed );
+    }
+
+    pthread_mutex_unlock ( &self->lock );
+}
@@ -0,0 +1,131 @@
+/**
+ * This interface is a variant of the compiled-expression cache (see 'cache.h')
+ * that is shared by many threads. Lookups take no locks and write to no shared
+ * memory, so threads that find their programs never contend with each other;
+ * only the compilation and insertion of a missing program is serialised.
+ *
+ * The cache is an open-addressed hash table of atomic slots, each pointing to
+ * an immutable entry. Evicted entries, and tables that have been replaced by a
+ * larger table, cannot be freed while a reader might still hold them, so they
+ * are reclaimed by epochs: each thread announces the global epoch when it
+ * enters the cache, and anything retired in an epoch is freed only once no
+ * thread remains in that epoch or an earlier one. Callers should:
+ *
+ *  - Create one shared cache;
+ *  - Register each thread with the cache, to obtain a handle for that thread;
+ *  - Enter the cache, compile (look up) programs and evaluate them as often as
+ *    required, and leave the cache; programs are only valid while inside it;
+ *  - Unregister each thread, and destruct the cache.
+ *
+ * Normalisation, the memory budget, and CLOCK eviction are as for 'cache.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef CCACHE_H
+#define CCACHE_H
+
+#include <stddef.h>
+
+#include "expr.h"
+#include "prog.h"
+#include "cache.h"
+
+/**
+ * The base opaque type of a concurrent cache
+ */
+struct ccache;
+
+/**
+ * The base opaque type of the handle of a thread on a concurrent cache
+ */
+struct ccache_thread;
+
+/**
+ * Initialise a concurrent cache with the given memory budget. Identifiers in
+ * cached expressions are resolved against the given variable names. If this
+ * function fails, then 'errno' is set appropriately.
+ *
+ * @param budget the memory budget in bytes
+ * @param names the list of variable names, or NULL; this is not copied, so it
+ *      must outlive the cache
+ * @param count the number of given names
+ * @return the new cache, or NULL on failure
+ */
+struct ccache * ccache_initialise ( size_t budget, const char * const * names,
+    unsigned int count );
+
+/**
+ * Destruct a concurrent cache, and every program it holds. Every thread must
+ * have been unregistered.
+ *
+ * @param self the cache to be destructed
+ */
+void ccache_destruct ( struct ccache * self );
+
+/**
+ * Register the calling thread with a concurrent cache. If this function fails,
+ * then 'errno' is set appropriately.
+ *
+ * @param self the cache
+ * @return the handle of the thread, or NULL on failure
+ */
+struct ccache_thread * ccache_register ( struct ccache * self );
+
+/**
+ * Unregister a thread from its concurrent cache. The thread must not be inside
+ * the cache.
+ *
+ * @param self the handle of the thread
+ */
+void ccache_unregister ( struct ccache_thread * self );
+
+/**
+ * Enter the cache. Programs found inside the cache remain valid until the
+ * thread leaves it. Threads should not stay inside the cache for long, since
+ * evicted programs are not freed while any thread remains inside.
+ *
+ * @param self the handle of the thread
+ */
+void ccache_enter ( struct ccache_thread * self );
+
+/**
+ * Leave the cache.
+ *
+ * @param self the handle of the thread
+ */
+void ccache_leave ( struct ccache_thread * self );
+
+/**
+ * Find the program for the given expression, compiling and inserting it if it
+ * is not already held. The thread must be inside the cache.
+ *
+ * @param self the handle of the thread
+ * @param str the infix string expression
+ * @param program the destination of the program; this is only written if the
+ *      function succeeds
+ * @return a status code according to the standard expression error schema
+ */
+enum expr_status ccache_compile ( struct ccache_thread * self,
+    const char * str, const struct program ** program );
+
+/**
+ * Print a report of the status of the most recent failed compilation by the
+ * given thread, exactly as by 'expression_perror'.
+ *
+ * @param self the handle of the thread
+ * @param msg a prefix string, or NULL
+ * @param status the status to interpret
+ */
+void ccache_perror ( struct ccache_thread * self, const char * msg,
+    enum expr_status status );
+
+/**
+ * Read the counters of a concurrent cache, summed over all threads.
+ *
+ * @param self the cache
+ * @param stats the destination of the counters
+ */
+void ccache_stats ( struct ccache * self, struct cache_stats * stats );
+
+#endif /* CCACHE_H */
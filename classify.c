@@ -0,0 +1,216 @@
+/**
+ * Implement the character classification interface; see 'classify.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined __x86_64__ || defined __i386__
+#    include <immintrin.h>
+#    define CLASSIFY_X86
+#endif
+
+#include "cpu.h"
+
+#include "classify.h"
+
+/**
+ * The number of bytes classified together, one per bit of a mask word. This
+ * divides the size of any page.
+ */
+#define CLASSIFY_BLOCK 64
+
+/**
+ * The punctuation characters: those that always form a token on their own
+ */
+#define CLASSIFY_PUNCT "+-*/^()[]{}"
+
+/**
+ * Classify the aligned block of CLASSIFY_BLOCK bytes at the given address into
+ * the masks of the given cursor.
+ *
+ * @param self the cursor
+ * @param block the block
+ */
+typedef void ( * block_fn ) ( struct classify_cursor * self,
+    const char * block );
+
+#ifdef CLASSIFY_X86
+
+/**
+ * Define a vectorised block classifier. Every punctuation character is
+ * compared against the whole vector, and the comparison results are gathered
+ * into the masks with a byte-wise move-mask. The block may straddle the bounds
+ * of the string, though never a page, so it is not checked by the address
+ * sanitiser.
+ *
+ * @param name the name of the classifier
+ * @param isa the instruction-set extension to be targeted by the compiler
+ * @param width the number of bytes in a vector
+ * @param vec the vector type
+ * @param load the aligned vector load intrinsic
+ * @param set1 the broadcast intrinsic
+ * @param eq the byte-wise equality intrinsic
+ * @param gt the byte-wise signed greater-than intrinsic
+ * @param vor the bitwise disjunction intrinsic
+ * @param vand the bitwise conjunction intrinsic
+ * @param movemask the byte-wise move-mask intrinsic
+ */
+#define VECTOR_CLASSIFIER(name, isa, width, vec, load, set1, eq, gt, vor,  \
+        vand, movemask)                                                    \
+    __attribute__ (( target ( isa ), no_sanitize_address ))                \
+    static void name ( struct classify_cursor * self, const char * block ) \
+    {                                                                      \
+        static const char set [ ] = CLASSIFY_PUNCT;                        \
+        uint64_t space = 0, punct = 0, nul = 0, digit = 0, point = 0;      \
+        vec c, s, p;                                                       \
+                                                                           \
+        for ( unsigned int i = 0; i < CLASSIFY_BLOCK; i += width ) {       \
+            c = load ( ( const vec * ) ( const void * ) & ( block [ i ] ) );\
+            s = vand ( gt ( c, set1 ( '\t' - 1 ) ),                        \
+                gt ( set1 ( '\r' + 1 ), c ) );                             \
+            s = vor ( s, eq ( c, set1 ( ' ' ) ) );                         \
+            p = eq ( c, set1 ( set [ 0 ] ) );                              \
+                                                                           \
+            for ( unsigned int j = 1; j < sizeof ( set ) - 1; j++ )        \
+                p = vor ( p, eq ( c, set1 ( set [ j ] ) ) );               \
+                                                                           \
+            space |= ( uint64_t ) ( uint32_t ) movemask ( s ) << i;        \
+            punct |= ( uint64_t ) ( uint32_t ) movemask ( p ) << i;        \
+            nul |= ( uint64_t ) ( uint32_t ) movemask (                    \
+                eq ( c, set1 ( '\0' ) ) ) << i;                            \
+            digit |= ( uint64_t ) ( uint32_t ) movemask ( vand (           \
+                gt ( c, set1 ( '0' - 1 ) ),                                \
+                gt ( set1 ( '9' + 1 ), c ) ) ) << i;                       \
+            point |= ( uint64_t ) ( uint32_t ) movemask (                  \
+                eq ( c, set1 ( '.' ) ) ) << i;                             \
+        }                                                                  \
+                                                                           \
+        self->block = block;                                               \
+        self->solid = ~space;                                              \
+        self->words = ~space & ~punct & ~nul;                              \
+        self->decimal = digit | point;                                     \
+        self->points = point;                                              \
+    }
+
+VECTOR_CLASSIFIER ( classify_sse2, "sse2", 16, __m128i, _mm_load_si128,
+    _mm_set1_epi8, _mm_cmpeq_epi8, _mm_cmpgt_epi8, _mm_or_si128,
+    _mm_and_si128, _mm_movemask_epi8 )
+
+VECTOR_CLASSIFIER ( classify_avx2, "avx2", 32, __m256i, _mm256_load_si256,
+    _mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_cmpgt_epi8, _mm256_or_si256,
+    _mm256_and_si256, _mm256_movemask_epi8 )
+
+#endif /* CLASSIFY_X86 */
+
+/**
+ * The selected block classifier, or NULL if there is none
+ */
+static block_fn selected = NULL;
+
+/**
+ * Select the block classifier for the host processor. This runs before 'main',
+ * so the selection is complete before any thread could observe it.
+ */
+__attribute__ (( constructor ))
+static void classify_select_host ( void )
+{
+    classify_select ( cpu_detect ( ) );
+}
+
+bool classify_available ( void )
+{
+    return selected != NULL;
+}
+
+bool classify_select ( enum cpu_level level )
+{
+    switch ( level ) {
+#ifdef CLASSIFY_X86
+        case CPU_AVX2: selected = classify_avx2; break;
+        case CPU_SSE2: selected = classify_sse2; break;
+#else
+        case CPU_AVX2:
+        case CPU_SSE2:
+#endif
+        case CPU_SCALAR:
+        case CPU_COUNT:
+        default:
+            selected = NULL;
+    }
+
+    return selected != NULL;
+}
+
+void classify_begin ( struct classify_cursor * self )
+{
+    self->block = NULL;
+}
+
+/**
+ * Retrieve the aligned block containing the given position, classifying it if
+ * it is not already the current block of the cursor.
+ *
+ * @param self the cursor
+ * @param pos the position
+ * @return the block
+ */
+static inline const char * block_of ( struct classify_cursor * self,
+        const char * pos )
+{
+    const char * block = ( const char * ) ( ( uintptr_t ) pos &
+        ~( uintptr_t ) ( CLASSIFY_BLOCK - 1 ) );
+
+    if ( block != self->block )
+        selected ( self, block );
+
+    return block;
+}
+
+const char * classify_next ( struct classify_cursor * self, const char * pos )
+{
+    const char * block = block_of ( self, pos );
+    uint64_t mask = self->solid & ~UINT64_C ( 0 ) << ( pos - block );
+
+    /* The terminator is not white-space, so the search ends at it at the
+     * latest, and never classifies a block wholly beyond the string. */
+    while ( !mask ) {
+        selected ( self, block += CLASSIFY_BLOCK );
+        mask = self->solid;
+    }
+
+    return block + __builtin_ctzll ( mask );
+}
+
+const char * classify_word_end ( struct classify_cursor * self,
+        const char * pos, bool * decimal )
+{
+    const char * block = block_of ( self, pos );
+    uint64_t from = ~UINT64_C ( 0 ) << ( pos - block ), bound, run;
+    unsigned int points = 0;
+    bool digits = true;
+
+    /* A word is closed by white-space, punctuation, or the terminator, so it
+     * never runs beyond the string. */
+    for ( ;; ) {
+        bound = ~self->words & from;
+        run = bound ? from & ( ( bound & -bound ) - 1 ) : from;
+
+        digits &= ! ( run & ~self->decimal );
+        points += ( unsigned int ) __builtin_popcountll ( run &
+            self->points );
+
+        if ( bound )
+            break;
+
+        selected ( self, block += CLASSIFY_BLOCK );
+        from = ~UINT64_C ( 0 );
+    }
+
+    block += __builtin_ctzll ( bound );
+    *decimal = digits && points <= 1 && ( size_t ) ( block - pos ) > points;
+
+    return block;
+}
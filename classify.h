@@ -0,0 +1,107 @@
+/**
+ * This interface classifies the characters of an expression in bulk, ahead of
+ * tokenisation. Each byte is classified as white-space, punctuation (an
+ * operator or a parenthesis), the terminator, or part of a word (a literal or
+ * an identifier), and the bytes of words are further marked where they are
+ * decimal digits or points. The classes are reduced to bitmasks of token
+ * boundaries: a token starts at the first byte that is not white-space, and a
+ * word ends at the first byte that is not a word byte. The tokeniser can then
+ * jump from each boundary to the next, rather than inspecting each byte in
+ * turn, and can measure a plain decimal literal without scanning it.
+ *
+ * Classification is vectorised, with the implementation selected at run-time
+ * according to the extensions supported by the host processor (see 'cpu.h').
+ * Where no vector extension is available, no classifier is selected, and the
+ * tokeniser falls back to its byte-wise scan.
+ *
+ * NOTES ON THE CURSOR
+ *
+ * The string is classified lazily, one block at a time, as a cursor advances
+ * through it, so neither its length nor any storage is needed in advance. The
+ * blocks are aligned to their size, which divides the size of a page, so the
+ * classifier may read before the string and beyond its terminator, but never
+ * into another page. The bytes outside the string are never consulted.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cpu.h"
+
+/**
+ * A cursor over a classified string. The fields are only to be interpreted by
+ * the classification API.
+ */
+struct classify_cursor {
+    /**
+     * The block currently classified, or NULL if none is
+     */
+    const char * block;
+
+    /**
+     * The masks of the block: the bytes that are not white-space, the word
+     * bytes, the decimal bytes (digits and points), and the points
+     */
+    uint64_t solid;
+    uint64_t words;
+    uint64_t decimal;
+    uint64_t points;
+};
+
+/**
+ * Determine whether a classifier is selected, without which the caller should
+ * scan byte-wise.
+ *
+ * @return true if a classifier is selected, or false
+ */
+bool classify_available ( void );
+
+/**
+ * Select the classifier for the given level, rather than for the host
+ * processor. This is intended for benchmarking, and must not be called while
+ * any string is being classified.
+ *
+ * @param level the level, which must be supported by the host processor
+ * @return true if a classifier is selected, or false if there is none for the
+ *      level, in which case the caller should scan byte-wise
+ */
+bool classify_select ( enum cpu_level level );
+
+/**
+ * Begin classifying a new string, discarding any previous classification. A
+ * classifier must be selected.
+ *
+ * @param self the cursor
+ */
+void classify_begin ( struct classify_cursor * self );
+
+/**
+ * Find the first byte at or after the given position that is not white-space:
+ * the start of a token, or the terminator.
+ *
+ * @param self the cursor
+ * @param pos the position from which to search, within a NULL-terminated
+ *      string and no further than its terminator
+ * @return the position of the byte
+ */
+const char * classify_next ( struct classify_cursor * self, const char * pos );
+
+/**
+ * Find the end of the word beginning at the given position, and determine
+ * whether the word is a plain decimal literal: digits, with at most one point.
+ * The word need not begin a token.
+ *
+ * @param self the cursor
+ * @param pos the position of the first byte of the word
+ * @param decimal the destination of the determination
+ * @return the position of the first byte after the word
+ */
+const char * classify_word_end ( struct classify_cursor * self,
+    const char * pos, bool * decimal );
+
+#endif /* CLASSIFY_H */
@@ -0,0 +1,60 @@
+/**
+ * Implement the processor-feature interface; see 'cpu.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+#include "cpu.h"
+
+/**
+ * Query the processor for its supported extensions, with CPUID.
+ *
+ * @return the most capable supported level
+ */
+static enum cpu_level query ( void )
+{
+#if defined __x86_64__ || defined __i386__
+    __builtin_cpu_init ( );
+
+    if ( __builtin_cpu_supports ( "avx2" ) )
+        return CPU_AVX2;
+
+    if ( __builtin_cpu_supports ( "sse2" ) )
+        return CPU_SSE2;
+#endif
+
+    return CPU_SCALAR;
+}
+
+enum cpu_level cpu_detect ( void )
+{
+    enum cpu_level level = query ( );
+    const char * cap = getenv ( "CALC_SIMD" );
+
+    if ( cap )
+        for ( unsigned int i = 0; i < CPU_COUNT; i++ )
+            if ( !strcmp ( cap, cpu_level_str ( ( enum cpu_level ) i ) ) &&
+                    ( enum cpu_level ) i < level )
+                level = ( enum cpu_level ) i;
+
+    debug_printf ( "Processor level: %s\n", cpu_level_str ( level ) );
+    return level;
+}
+
+const char * cpu_level_str ( enum cpu_level level )
+{
+    switch ( level ) {
+        case CPU_SCALAR: return "scalar";
+        case CPU_SSE2:   return "sse2";
+        case CPU_AVX2:   return "avx2";
+
+        case CPU_COUNT:
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,44 @@
+/**
+ * This interface exposes the instruction-set extensions of the host processor,
+ * so that vectorised routines can be selected at run-time, with a portable
+ * scalar routine always available as the fallback.
+ *
+ * The detected level may be capped through the CALC_SIMD environment variable,
+ * which accepts "scalar", "sse2", or "avx2"; this is intended for benchmarking
+ * and for isolating faults in the vectorised routines.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+/**
+ * The vector instruction-set extensions of interest, in ascending order of
+ * capability
+ */
+enum cpu_level {
+    CPU_SCALAR,
+    CPU_SSE2,
+    CPU_AVX2,
+
+    CPU_COUNT
+};
+
+/**
+ * Determine the most capable instruction-set extension supported by the host
+ * processor, subject to the CALC_SIMD cap.
+ *
+ * @return the supported level
+ */
+enum cpu_level cpu_detect ( void );
+
+/**
+ * Retrieve a human-readable name for the given level.
+ *
+ * @param level the level
+ * @return the name of the level
+ */
+const char * cpu_level_str ( enum cpu_level level );
+
+#endif /* CPU_H */
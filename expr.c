@@ -8,10 +8,18 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "node.h"
 #include "debug.h"
+#include "alloc.h"
 #include "stack.h"
+#include "prog.h"
+#include "classify.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "expr.h"
 
@@ -25,17 +33,27 @@ struct expression {
     const char * expr_head;
 
     /**
-     * Internal nodal representation of the infix expression
+     * The beginning of the infix expression, which its tokens reference
      */
-    struct node ** data;
+    const char * source;
 
     /**
-     * The (variable) number of nodes allowed by this expression
+     * Internal token representation of the infix expression
+     */
+    struct node_token * tokens;
+
+    /**
+     * The pool from which the postfix converter takes the nodes of the tokens
+     */
+    struct node_pool * pool;
+
+    /**
+     * The (variable) number of tokens allowed by this expression
      */
     unsigned int capacity;
 
     /**
-     * The current node-under-inspection in the nodal array.
+     * The number of tokens in the token array
      */
     unsigned int idx;
 
@@ -43,8 +61,64 @@ struct expression {
      * The postfix stack
      */
     struct stack * postfix;
+
+    /**
+     * The operator stack of the Shunting Yard, retained between conversions
+     */
+    struct stack * operators;
+
+    /**
+     * The storage in which the postfix and operator stacks are placed
+     */
+    struct stack_storage postfix_storage, operator_storage;
+
+    /**
+     * The value stack of the evaluator, retained between evaluations
+     */
+    number_t * values;
+
+    /**
+     * The number of numbers that the value stack can hold
+     */
+    unsigned int value_capacity;
+
+    /**
+     * The variable names to which identifiers are bound, by position
+     */
+    const char * const * names;
+
+    /**
+     * The number of bound variable names
+     */
+    unsigned int name_count;
+
+    /**
+     * The optimisation passes applied to compiled programs
+     */
+    unsigned int passes;
+
+    /**
+     * The allocator of the expression, and of everything that spills from it
+     */
+    const struct allocator * allocator;
+
+    /**
+     * Whether the expression was allocated by 'expression_initialise', rather
+     * than placed in storage by the caller
+     */
+    bool owned;
+
+    /**
+     * The in-line tokens and value stack, used until either spills to the heap
+     */
+    struct node_token inline_tokens [ EXPR_INLINE_CAPACITY ];
+    number_t inline_values [ EXPR_INLINE_CAPACITY ];
 };
 
+_Static_assert ( sizeof ( struct expression ) <=
+    sizeof ( struct expression_storage ),
+    "An expression must fit within its storage" );
+
 /**
  * Parse the expression status into a human-readable string.
  *
@@ -58,6 +132,7 @@ static const char * status_str ( enum expr_status status )
         case EXPR_NONODE:    return "Insufficient nodes";
         case EXPR_BADSYMBOL: return "Unexpected symbol";
         case EXPR_NOEXPR:    return "Insufficient expression capacity";
+        case EXPR_BADEXPR:   return "Malformed expression";
         case EXPR_INTERR:    return "Internal error; please report!";
 
         default: return "Unknown expression status";
@@ -65,71 +140,210 @@ static const char * status_str ( enum expr_status status )
 }
 
 /**
- * Determine whether the given expression node list must be increased to
- * accommodate a new (unseen) node. If the current capacity is insufficient, its
- * size is doubled; otherwise, nothing is done.
+ * Advance past any white-space separating the tokens of an expression. The
+ * white-space characters are those of the "C" locale, regardless of the
+ * current locale.
+ *
+ * @param str the read head
+ * @return the new read head, at the next token or the end of the expression
+ */
+static inline const char * skip_space ( const char * str )
+{
+    while ( *str == ' ' || ( *str >= '\t' && *str <= '\r' ) )
+        str++;
+
+    return str;
+}
+
+/**
+ * Begin classifying an expression in bulk, if a classifier is available.
+ *
+ * @param cursor the cursor of the classification
+ * @return the cursor, or NULL if the expression should be scanned byte-wise
+ */
+static inline struct classify_cursor * classify_expression (
+        struct classify_cursor * cursor )
+{
+    if ( !classify_available ( ) )
+        return NULL;
+
+    classify_begin ( cursor );
+    return cursor;
+}
+
+/**
+ * Advance to the next token. A single white-space character, the usual
+ * separator, is stepped over directly; longer runs are jumped with the
+ * classification, where there is one, and are otherwise skipped byte-wise.
+ *
+ * @param str the read head
+ * @param bounds the cursor of the classification, or NULL
+ * @return the new read head, at the next token or the end of the expression
+ */
+static inline const char * next_token ( const char * str,
+        struct classify_cursor * bounds )
+{
+    if ( *str == ' ' || ( *str >= '\t' && *str <= '\r' ) )
+        str++;
+
+    if ( bounds && ( *str == ' ' || ( *str >= '\t' && *str <= '\r' ) ) )
+        return classify_next ( bounds, str );
+
+    return skip_space ( str );
+}
+
+/**
+ * Scan the token at the read head. A plain decimal literal is measured from
+ * the classification, where there is one; any other token is scanned
+ * byte-wise.
+ *
+ * @param token the token
+ * @param str the read head
+ * @param base the beginning of the expression
+ * @param self the expression, for its variable names
+ * @param bounds the cursor of the classification, or NULL
+ * @return the new read head, which is 'str' if there is no token at it
+ */
+static inline const char * scan_token ( struct node_token * token,
+        const char * str, const char * base, const struct expression * self,
+        struct classify_cursor * bounds )
+{
+    const char * end;
+    bool decimal;
+
+    if ( bounds && ( ( *str >= '0' && *str <= '9' ) || *str == '.' ) ) {
+        end = classify_word_end ( bounds, str, &decimal );
+
+        if ( decimal )
+            return node_tokenise_decimal ( token, str, base,
+                ( size_t ) ( end - str ) );
+    }
+
+    return node_tokenise ( token, str, base, self->names, self->name_count );
+}
+
+/**
+ * Determine whether the given expression token list must be increased to
+ * accommodate a new (unseen) token. If the current capacity is insufficient,
+ * its size is doubled; otherwise, nothing is done.
  *
- * @param self the node list
- * @return the ability to add a new node
+ * @param self the token list
+ * @return the ability to add a new token
  */
 static bool realloc_check ( struct expression * self )
 {
-    struct node ** new_data;
+    struct node_token * new_tokens;
 
     if ( self->idx + 1 >= self->capacity ) {
-        if ( ! ( new_data = realloc ( self->data,
-                sizeof ( struct node * ) *
-                ( self->capacity << 1 ) ) ) )
+        if ( self->tokens != self->inline_tokens )
+            new_tokens = allocator_realloc ( self->allocator, self->tokens,
+                sizeof ( struct node_token ) * self->capacity,
+                sizeof ( struct node_token ) * ( self->capacity << 1 ) );
+
+        /* The in-line tokens are copied out when they first spill */
+        else if ( ( new_tokens = allocator_alloc ( self->allocator,
+                sizeof ( struct node_token ) * ( self->capacity << 1 ) ) ) )
+            memcpy ( new_tokens, self->tokens, sizeof ( struct node_token ) *
+                self->idx );
+
+        if ( !new_tokens )
             return false;
 
-        self->data = new_data;
+        self->tokens = new_tokens;
         self->capacity <<= 1;
+        stats_count ( growths, 1 );
     }
 
     return true;
 }
 
 /**
- * Commit (append) a structured node to the expression
+ * Commit (append) a token to the expression
  *
  * @param self the expression
- * @param node the node to be added
- * @return the committed node, or NULL if the operation could not be completed
+ * @param token the token to be added
+ * @return the ability to add the token
  */
-static inline bool commit_node ( struct expression * self, struct node * node )
+static inline bool commit_token ( struct expression * self,
+        struct node_token token )
 {
     if ( !realloc_check ( self ) )
-        return NULL;
+        return false;
+
+    self->tokens [ self->idx++ ] = token;
+    stats_count ( tokens, 1 );
+
+    return true;
+}
+
+/**
+ * Push a node to one of the stacks of the Shunting Yard, tracing the push.
+ *
+ * @param stack the stack
+ * @param which the identity of the stack, for the trace
+ * @param kind the kind of the node
+ * @param datum the datum of the node
+ * @return true on success, or false if the stack could not be grown
+ */
+static inline bool sya_push ( struct stack * stack, enum trace_stack which,
+        node_kind_t kind, union node_datum datum )
+{
+    ( void ) which; /* Unused if tracing is compiled out */
+
+    if ( !stack_push ( stack, kind, datum ) )
+        return false;
 
-    self->data [ self->idx++ ] = node;
+    trace_push ( which, kind, datum, stack_size ( stack ) );
     return true;
 }
 
+/**
+ * Move the operator on top of the operator stack to the output stack, tracing
+ * both the pop and the push.
+ *
+ * @param op_stack the operator stack
+ * @param out_stack the output stack
+ * @return true on success, or false if the output stack could not be grown
+ */
+static inline bool sya_move ( struct stack * op_stack,
+        struct stack * out_stack )
+{
+    const node_kind_t kind = stack_pop ( op_stack );
+
+    trace_pop ( TRACE_OPERATORS, kind, stack_size ( op_stack ) );
+    return sya_push ( out_stack, TRACE_OUTPUT, kind, NODE_NO_DATUM );
+}
+
 /**
  * Handle an incoming operator node during the execution of the Shunting Yard
  * algorithm, as according to the rules defined by the 'postfix' function.
  *
  * @param op_stack the operator stack
  * @param out_stack the output stack
- * @param node the incoming operator node
+ * @param kind the kind of the incoming operator node
+ * @return true on success, or false if either stack could not be grown
  */
-static void sya_handle_op ( struct stack * op_stack, struct stack * out_stack,
-        struct node * node )
+static bool sya_handle_op ( struct stack * op_stack, struct stack * out_stack,
+        node_kind_t kind )
 {
-    struct node * top;
+    node_kind_t top;
     enum node_precedence prec;
 
-    assert ( node_get_type ( node ) == NODE_OPERATOR );
+    assert ( node_kind_type ( kind ) == NODE_OPERATOR );
 
     while ( ( top = stack_peek ( op_stack ) ) &&
-            node_get_type ( top ) != NODE_LPAREN &&
-            ( ( prec = node_test_prec ( top, node ) ) ==
-                NODE_PREC_GREATER ||
-                prec == NODE_PREC_LASSOC ) )
+            node_kind_type ( top ) != NODE_LPAREN ) {
+        prec = node_test_prec ( node_kind_op ( top ), node_kind_op ( kind ) );
+        trace_decision ( top, kind, prec );
 
-        stack_push ( out_stack, stack_pop ( op_stack ) );
+        if ( prec != NODE_PREC_GREATER && prec != NODE_PREC_LASSOC )
+            break;
 
-    stack_push ( op_stack, node );
+        if ( !sya_move ( op_stack, out_stack ) )
+            return false;
+    }
+
+    return sya_push ( op_stack, TRACE_OPERATORS, kind, NODE_NO_DATUM );
 }
 
 /**
@@ -139,18 +353,107 @@ static void sya_handle_op ( struct stack * op_stack, struct stack * out_stack,
  *
  * @param op_stack the operator stack
  * @param out_stack the output stack
+ * @return EXPR_OK if a left parenthesis was matched and discarded,
+ *      EXPR_BADEXPR if there was none, or EXPR_NOEXPR if the output stack
+ *      could not be grown
  */
-static void sya_handle_rparen ( struct stack * op_stack,
+static enum expr_status sya_handle_rparen ( struct stack * op_stack,
         struct stack * out_stack )
 {
-    struct node * top;
+    node_kind_t top;
 
     while ( ( top = stack_peek ( op_stack ) ) &&
-            node_get_type ( top ) != NODE_LPAREN )
-        stack_push ( out_stack, stack_pop ( op_stack ) );
+            node_kind_type ( top ) != NODE_LPAREN )
+        if ( !sya_move ( op_stack, out_stack ) )
+            return EXPR_NOEXPR;
+
+    if ( ! ( top = stack_pop ( op_stack ) ) )
+        return EXPR_BADEXPR;
+
+    trace_pop ( TRACE_OPERATORS, top, stack_size ( op_stack ) );
+    return EXPR_OK;
+}
+
+/**
+ * Handle the next node of the infix expression during the execution of the
+ * Shunting Yard algorithm, as according to the rules defined by the 'postfix'
+ * function. The node is copied into the stacks, so it may then be reused.
+ *
+ * @param op_stack the operator stack
+ * @param out_stack the output stack
+ * @param node the incoming node
+ * @return a status code according to the standard expression error schema
+ */
+static enum expr_status sya_handle_node ( struct stack * op_stack,
+        struct stack * out_stack, struct node * node )
+{
+    bool pushed = false;
+
+    switch ( node_get_type ( node ) ) {
+        case NODE_LITERAL:
+        case NODE_VARIABLE:
+            pushed = sya_push ( out_stack, TRACE_OUTPUT,
+                node_get_kind ( node ), node_get_datum ( node ) );
+            break;
+
+        case NODE_OPERATOR:
+            pushed = sya_handle_op ( op_stack, out_stack,
+                node_get_kind ( node ) );
+            break;
+
+        case NODE_LPAREN:
+            pushed = sya_push ( op_stack, TRACE_OPERATORS,
+                node_get_kind ( node ), NODE_NO_DATUM );
+            break;
+
+        case NODE_RPAREN:
+            return sya_handle_rparen ( op_stack, out_stack );
+
+        case NODE_UNKNOWN:
+        case NODE_COUNT:
+            return EXPR_INTERR;
+    }
+
+    return pushed ? EXPR_OK : EXPR_NOEXPR;
+}
+
+/**
+ * Handle the next token of the infix expression during the execution of the
+ * Shunting Yard algorithm, encoding it into the given node first.
+ *
+ * @param self the expression
+ * @param token the incoming token
+ * @param node the node into which the token is encoded
+ * @return a status code according to the standard expression error schema
+ */
+static enum expr_status sya_handle_token ( struct expression * self,
+        struct node_token token, struct node * node )
+{
+    if ( !node_encode_token ( node, token, self->source ) ) {
+        self->expr_head = self->source + token.offset;
+        return EXPR_BADSYMBOL;
+    }
+
+    trace_token ( token.offset, node_get_kind ( node ),
+        node_get_datum ( node ) );
+    return sya_handle_node ( self->operators, self->postfix, node );
+}
+
+/**
+ * Move the operators remaining on the operator stack to the output stack, once
+ * the infix expression has been exhausted.
+ *
+ * @param op_stack the operator stack
+ * @param out_stack the output stack
+ * @return true on success, or false if the output stack could not be grown
+ */
+static bool sya_drain ( struct stack * op_stack, struct stack * out_stack )
+{
+    while ( stack_peek ( op_stack ) )
+        if ( !sya_move ( op_stack, out_stack ) )
+            return false;
 
-    assert ( node_get_type ( top ) == NODE_LPAREN );
-    stack_pop ( op_stack );
+    return true;
 }
 
 /* NOTES FOR THE POSTFIX CONVERTER
@@ -158,7 +461,8 @@ static void sya_handle_rparen ( struct stack * op_stack,
  * Reverse-Polish notation) using the Shunting Yard algorithm (SYA). This
  * function implements a variant of the SYA by executing the following rules:
  *
- *  - If the next node is a literal: push it to the output stack.
+ *  - If the next node is a literal or a variable: push it to the output
+ *    stack.
  *
  *  - If the next node is an operator: while the top of the operator stack
  *    exists and is not a left parenthesis, and has greater-or-equivalent
@@ -171,105 +475,354 @@ static void sya_handle_rparen ( struct stack * op_stack,
  *    onto the output stack until a left parenthesis is found. Then, discard
  *    both the left and right parentheses.
  *
+ * The tokens of the infix expression are packed references into its source
+ * (see 'struct node_token'), and each is only encoded into a node as it
+ * reaches the Shunting Yard, which is also when its literal is converted. A
+ * literal that is out of range is therefore reported here, rather than by the
+ * tokeniser.
+ *
+ * Both stacks hold their nodes by value (see 'stack.h'), so every token is
+ * encoded into the same scratch node, which is copied into the stacks: a
+ * conversion takes one node from its pool however long the expression. An
+ * unmatched right parenthesis is reported as a malformed expression, and a
+ * stack that cannot be grown as a failure to allocate the expression, rather
+ * than leaving a truncated postfix form.
+ *
+ * Each token, push, pop, and precedence decision is offered to the trace (see
+ * 'trace.h'), which records it in binary form if its level is selected. The
+ * postfix form is not printed as it is built, even in debugging builds; a
+ * trace is dumped on demand instead.
+ *
  * TODO: Implement a proper error-handling interface, detecting mismatched
  *      parentheses or operands, etc. Remove as many assertions as reasonable.
- * TODO: Implement a stack-based evaluator for the resultant output stack.
  */
 
 enum expr_status expression_postfix ( struct expression * self )
 {
-    struct stack * op_stack = stack_initialise ( 0 );
-    struct stack * out_stack = self->postfix;
-    struct node * node;
+    struct stack * op_stack = self->operators;
+    enum expr_status status = EXPR_OK;
+    struct node * node = NULL;
 
-    if ( !op_stack ) {
-        stack_destruct ( op_stack );
-        return EXPR_NOEXPR;
+    stats_start ( start );
+    stack_clear ( op_stack );
+
+    if ( self->idx && ! ( node = pool_new_node ( self->pool ) ) )
+        status = EXPR_NONODE;
+
+    for ( unsigned int i = 0; i < self->idx && status == EXPR_OK; i++ )
+        status = sya_handle_token ( self, self->tokens [ i ], node );
+
+    if ( status == EXPR_OK && !sya_drain ( op_stack, self->postfix ) )
+        status = EXPR_NOEXPR;
+
+    stats_stop ( STATS_POSTFIX, start );
+    debug_puts ( "Expression converted to RPN" );
+
+    return status;
+}
+
+enum expr_status expression_parse ( struct expression * self,
+        struct node_pool * pool )
+{
+    stats_start ( start );
+
+    struct stack * op_stack = self->operators;
+    const char * const base = self->expr_head;
+    struct classify_cursor cursor;
+    struct classify_cursor * bounds = classify_expression ( &cursor );
+    enum expr_status status = EXPR_OK;
+    const char * new_rh = base;
+    struct node * node = pool_new_node ( pool );
+
+    stack_clear ( op_stack );
+
+    /* Every token is encoded into the same scratch node; see the notes for
+     * the postfix converter */
+    for ( self->expr_head = next_token ( base, bounds );
+            status == EXPR_OK && *self->expr_head;
+            self->expr_head = next_token ( new_rh, bounds ) )
+
+        if ( !node )
+            status = EXPR_NONODE;
+
+        else if ( ( new_rh = node_encode ( node, self->expr_head,
+                self->names, self->name_count ) ) == self->expr_head )
+            status = EXPR_BADSYMBOL;
+
+        /* The token goes straight to the Shunting Yard, rather than via
+         * the expression storage array. */
+        else {
+            stats_count ( tokens, 1 );
+            trace_token ( self->expr_head - base, node_get_kind ( node ),
+                node_get_datum ( node ) );
+            status = sya_handle_node ( op_stack, self->postfix, node );
+        }
+
+    if ( status == EXPR_OK && !sya_drain ( op_stack, self->postfix ) )
+        status = EXPR_NOEXPR;
+
+    stats_stop ( STATS_PARSE, start );
+    debug_puts ( ( status == EXPR_OK ) ? "Expression parsed to RPN" :
+        "Expression parsed with faults" );
+
+    return status;
+}
+
+/* NOTES FOR THE EVALUATOR
+ *
+ * The postfix stack is walked from the bottom (the first node emitted by the
+ * Shunting Yard) to the top, dispatching on the packed array of kinds and
+ * reading literals from the parallel array of data. Literals are pushed to a
+ * flat value stack of numbers, and each operator pops its right- then
+ * left-hand operands and pushes the result. A well-formed expression leaves
+ * exactly one value behind.
+ *
+ * The value stack can never hold more numbers than there are postfix nodes, so
+ * it is sized once, before the walk, and never grown during it. The stack is
+ * retained by the expression, so a reset expression that is evaluated again
+ * only reallocates it if the new postfix form is longer than any before it.
+ * Holding the operands by value, rather than through the generic 'struct
+ * stack', keeps the inner loop free of per-operand indirection.
+ */
+
+/**
+ * Ensure that the value stack of the given expression can hold the given number
+ * of values. The stack is sized once, up-front, to the length of the postfix
+ * form, and the in-line values are never copied, as they hold nothing between
+ * evaluations.
+ *
+ * @param self the expression
+ * @param size the number of values
+ * @return the ability to hold the values
+ */
+static bool reserve_values ( struct expression * self, unsigned int size )
+{
+    number_t * values;
+
+    if ( size > self->value_capacity ) {
+        if ( ! ( values = ( self->values == self->inline_values ) ?
+                allocator_alloc ( self->allocator,
+                sizeof ( number_t ) * size ) :
+                allocator_realloc ( self->allocator, self->values,
+                sizeof ( number_t ) * self->value_capacity,
+                sizeof ( number_t ) * size ) ) )
+            return false;
+
+        self->values = values;
+        self->value_capacity = size;
     }
 
-    for ( unsigned int i = 0; i < self->idx; i++ ) {
-        node = self->data [ i ];
-        switch ( node_get_type ( node ) ) {
+    return true;
+}
+
+enum expr_status expression_evaluate ( struct expression * self,
+        number_t * result )
+{
+    stats_start ( start );
+
+    const unsigned int size = stack_size ( self->postfix );
+    enum expr_status status = EXPR_OK;
+    const node_kind_t * kinds = stack_kinds ( self->postfix );
+    const union node_datum * data = stack_data ( self->postfix );
+    number_t * values, * top;
+
+    /* Every fault falls through to the timer, so that failed evaluations
+     * are counted too. */
+    if ( !size )
+        status = EXPR_BADEXPR;
+    else if ( !reserve_values ( self, size ) )
+        status = EXPR_NOEXPR;
+
+    values = self->values;
+
+    /* 'top' always addresses the slot immediately above the topmost value */
+    top = values;
+
+    for ( unsigned int i = 0; i < size && status == EXPR_OK; i++ ) {
+        switch ( node_kind_type ( kinds [ i ] ) ) {
             case NODE_LITERAL:
-                stack_push ( out_stack, node );
+                *top++ = data [ i ].value;
                 break;
 
             case NODE_OPERATOR:
-                sya_handle_op ( op_stack, out_stack, node );
+                if ( top - values < 2 )
+                    status = EXPR_BADEXPR;
+                else {
+                    top--;
+                    top [ -1 ] = node_op_apply ( node_kind_op ( kinds [ i ] ),
+                        top [ -1 ], *top );
+                }
                 break;
 
+            /* A parenthesis only survives the conversion if it was never
+             * matched by its counterpart. Variables have no value until
+             * the expression is compiled and given its inputs. */
             case NODE_LPAREN:
-                stack_push ( op_stack, node );
-                break;
-
             case NODE_RPAREN:
-                sya_handle_rparen ( op_stack, out_stack );
+            case NODE_VARIABLE:
+                status = EXPR_BADEXPR;
                 break;
 
             case NODE_UNKNOWN:
             case NODE_COUNT:
-                return EXPR_INTERR;
+                status = EXPR_INTERR;
+                break;
         }
     }
 
-    while ( ( node = stack_peek ( op_stack ) ) )
-        stack_push ( out_stack, stack_pop ( op_stack ) );
+    if ( status == EXPR_OK ) {
+        if ( top - values != 1 )
+            status = EXPR_BADEXPR;
+        else
+            *result = *values;
+    }
+
+    stats_stop ( STATS_EVALUATE, start );
+    debug_puts ( ( status == EXPR_OK ) ? "Expression evaluated" :
+        "Expression evaluated with faults" );
 
-    stack_destruct ( op_stack );
-    debug_puts ( "Expression converted to RPN" );
-    stack_print ( out_stack, node_format );
+    return status;
+}
+
+enum expr_status expression_compile ( struct expression * self,
+        struct program ** program )
+{
+    struct program * prog;
+    int failed;
+
+    if ( ! ( prog = program_assemble ( self->postfix ) ) )
+        return ( errno == EINVAL ) ? EXPR_BADEXPR : EXPR_NOEXPR;
+
+    stats_start ( start );
+    failed = program_optimise ( prog, self->passes );
+    stats_stop ( STATS_OPTIMISE, start );
+
+    if ( failed ) {
+        program_destruct ( prog );
+        return EXPR_NOEXPR;
+    }
+
+    *program = prog;
+    debug_puts ( "Expression compiled" );
 
     return EXPR_OK;
 }
 
+struct expression * expression_initialise_in (
+        struct expression_storage * storage, const char * expr,
+        unsigned int capacity, const struct allocator * allocator )
+{
+    struct expression * self = ( void * ) storage;
+
+    self->allocator = allocator_resolve ( allocator );
+    self->operators = stack_initialise_in ( &self->operator_storage, 0,
+        self->allocator );
+
+    if ( ! ( self->postfix = stack_initialise_in ( &self->postfix_storage,
+            capacity, self->allocator ) ) )
+        return NULL;
+
+    self->tokens = self->inline_tokens;
+    self->pool = NULL;
+    self->values = self->inline_values;
+    self->value_capacity = EXPR_INLINE_CAPACITY;
+    self->capacity = EXPR_INLINE_CAPACITY;
+    self->idx = 0;
+    self->expr_head = self->source = expr;
+    self->names = NULL;
+    self->name_count = 0;
+    self->passes = PROG_PASS_DEFAULT;
+    self->owned = false;
+
+    debug_puts ( "Expression initialised" );
+    return self;
+}
+
 struct expression * expression_initialise ( const char * expr,
-        unsigned int capacity )
+        unsigned int capacity, const struct allocator * allocator )
 {
-    struct expression * self;
-
-    if ( ! ( self = malloc ( sizeof ( struct expression ) ) ) ||
-            ! ( self->postfix = stack_initialise ( capacity ) ) ) {
-        free ( self );
-        self = NULL;
-    } else {
-        self->data = NULL;
-        self->capacity = 1;
-        self->idx = 0;
-        self->expr_head = expr;
-
-        debug_puts ( "Expression initialised" );
-    }
+    struct expression_storage * storage;
+    struct expression * self = NULL;
+
+    allocator = allocator_resolve ( allocator );
+
+    if ( ( storage = allocator_alloc ( allocator,
+            sizeof ( struct expression_storage ) ) ) &&
+            ! ( self = expression_initialise_in ( storage, expr, capacity,
+            allocator ) ) )
+        allocator_free ( allocator, storage,
+            sizeof ( struct expression_storage ) );
+
+    if ( self )
+        self->owned = true;
 
     return self;
 }
 
+struct expression * expression_scratch_initialise (
+        struct expression_scratch * scratch, const char * expr,
+        struct node_pool ** pool, const struct allocator * allocator )
+{
+    /* Neither can fail, since neither is given more than its in-line
+     * capacity */
+    *pool = pool_initialise_in ( &scratch->pool, 0, allocator );
+    return expression_initialise_in ( &scratch->expression, expr, 0,
+        allocator );
+}
+
+void expression_reset ( struct expression * self, const char * expr )
+{
+    self->expr_head = self->source = expr;
+    self->idx = 0;
+    stack_clear ( self->postfix );
+}
+
+void expression_bind ( struct expression * self, const char * const * names,
+        unsigned int count )
+{
+    self->names = names;
+    self->name_count = count;
+}
+
+void expression_set_passes ( struct expression * self, unsigned int passes )
+{
+    self->passes = passes;
+}
+
 enum expr_status expression_tokenise ( struct expression * self,
-        struct node_pool ** pools, unsigned int pool_count )
+        struct node_pool * pool )
 {
-    struct node * node;
-    unsigned int pool_idx = 0;
-    const char * new_rh = NULL;
+    const char * const base = self->expr_head;
+    struct classify_cursor cursor;
+    struct classify_cursor * bounds = classify_expression ( &cursor );
     enum expr_status status = EXPR_OK;
+    const char * new_rh = base;
+    struct node_token token;
 
-    for ( ; *self->expr_head && status == EXPR_OK;
-            self->expr_head = new_rh )
+    stats_start ( start );
+    self->source = base;
+    self->pool = pool;
 
-        /* Pull a new node from the pool */
-        if ( ! ( node = pool_pull_node ( pools, &pool_idx,
-                pool_count ) ) )
-            status = EXPR_NONODE;
+    for ( self->expr_head = next_token ( base, bounds );
+            status == EXPR_OK && *self->expr_head;
+            self->expr_head = next_token ( new_rh, bounds ) )
+
+        /* Tokens record their offsets in 32 bits */
+        if ( ( size_t ) ( self->expr_head - base ) > UINT32_MAX )
+            status = EXPR_NOEXPR;
 
         /* Tokenise. If the new read head matches the old one, then we
          * have encountered a troublesome symbol. */
-        else if ( ( new_rh = node_encode ( node, self->expr_head ) ) ==
-                self->expr_head )
+        else if ( ( new_rh = scan_token ( &token, self->expr_head, base,
+                self, bounds ) ) == self->expr_head )
             status = EXPR_BADSYMBOL;
 
-        /* Now the token is successfully parsed, we can attempt to
-         * commit the populated node to the expression storage array. */
-        else if ( !commit_node ( self, node ) )
+        /* Now the token is successfully scanned, we can attempt to
+         * commit it to the expression storage array. */
+        else if ( !commit_token ( self, token ) )
             status = EXPR_NOEXPR;
 
+    stats_stop ( STATS_TOKENISE, start );
     debug_puts ( ( status == EXPR_OK ) ? "Expression tokenised" :
         "Expression tokenised with faults" );
 
@@ -279,9 +832,20 @@ enum expr_status expression_tokenise ( struct expression * self,
 void expression_destruct ( struct expression * self )
 {
     if ( self ) {
-        free ( self->data );
+        if ( self->tokens != self->inline_tokens )
+            allocator_free ( self->allocator, self->tokens,
+                sizeof ( struct node_token ) * self->capacity );
+        if ( self->values != self->inline_values )
+            allocator_free ( self->allocator, self->values,
+                sizeof ( number_t ) * self->value_capacity );
+
         stack_destruct ( self->postfix );
-        free ( self );
+        stack_destruct ( self->operators );
+
+        if ( self->owned )
+            allocator_free ( self->allocator, self,
+                sizeof ( struct expression_storage ) );
+
         debug_puts ( "Expression destructed" );
     }
 }
@@ -9,7 +9,18 @@
  *   - Conversion of the IR from the infix order to postfix order with an
  *     implementation of operator-precedence parsing; and
  *
- *   - [TODO] Stack-based evaluation of the expression to a numerical value.
+ *   - Stack-based evaluation of the expression to a numerical value; and
+ *
+ *   - Compilation of the postfix IR into a self-contained program, for
+ *     repeated evaluation without re-parsing.
+ *
+ * An expression holds its first EXPR_INLINE_CAPACITY tokens and values, and
+ * the first STACK_INLINE_CAPACITY nodes of each of its stacks, in-line, and
+ * only a longer expression spills them to the heap. An expression may also be
+ * placed in storage provided by the caller; in particular, a scratch context
+ * (see 'struct expression_scratch') holds an expression and a node pool, and
+ * may be an automatic variable, so that a short expression is tokenised,
+ * converted, and evaluated without a single call to the dynamic allocator.
  *
  * @author Oliver Dixon
  */
@@ -17,13 +28,44 @@
 #ifndef EXPR_H
 #define EXPR_H
 
+#include <stddef.h>
+
 #include "node.h"
+#include "alloc.h"
+#include "stack.h"
+#include "prog.h"
+
+/**
+ * The number of tokens, and of values, held in-line by every expression
+ */
+#define EXPR_INLINE_CAPACITY 32
 
 /**
  * The base opaque type of an expression
  */
 struct expression;
 
+/**
+ * Storage, of a fixed size, in which an expression may be placed by the
+ * caller. Its contents are private to the expression.
+ */
+struct expression_storage {
+    /* The header, with room for its padding, then the in-line stacks, tokens,
+     * and values */
+    _Alignas ( max_align_t ) unsigned char bytes [ 16 * sizeof ( void * ) +
+        2 * sizeof ( struct stack_storage ) + EXPR_INLINE_CAPACITY *
+        ( sizeof ( struct node_token ) + sizeof ( number_t ) ) ];
+};
+
+/**
+ * A scratch context: the storage of an expression, and of the node pool from
+ * which it takes its nodes
+ */
+struct expression_scratch {
+    struct expression_storage expression;
+    struct pool_storage pool;
+};
+
 /**
  * A status code indicating the status of functions concerned with the direct
  * handling of an arithmetic expression
@@ -33,6 +75,7 @@ enum expr_status {
     EXPR_NONODE,
     EXPR_BADSYMBOL,
     EXPR_NOEXPR,
+    EXPR_BADEXPR,
     EXPR_INTERR,
 };
 
@@ -42,30 +85,106 @@ enum expr_status {
  * appropriately.
  *
  * @param expr the infix string expression to be tokenised
+ * @param capacity the initial capacity of the postfix stack, or zero
+ * @param allocator the allocator of the expression, or NULL for the standard
+ *      allocator (see 'alloc.h'); it must outlive the expression
  * @return the created expression, or NULL on failure
  */
 struct expression * expression_initialise ( const char * expr,
-    unsigned int capacity );
+    unsigned int capacity, const struct allocator * allocator );
+
+/**
+ * Initialise an expression, as by 'expression_initialise', within the given
+ * storage. The expression only calls the dynamic allocator if the capacity of
+ * its postfix stack exceeds STACK_INLINE_CAPACITY, so this cannot fail for a
+ * lesser capacity.
+ *
+ * @param storage the storage, which must outlive the expression
+ * @param expr the infix string expression to be tokenised
+ * @param capacity the initial capacity of the postfix stack
+ * @param allocator the allocator of anything that spills from the storage, or
+ *      NULL for the standard allocator; it must outlive the expression
+ * @return the created expression, or NULL on failure
+ */
+struct expression * expression_initialise_in (
+    struct expression_storage * storage, const char * expr,
+    unsigned int capacity, const struct allocator * allocator );
+
+/**
+ * Initialise an expression, and a node pool for it, within the given scratch
+ * context. This cannot fail. Both are destructed as usual, which frees only
+ * what has spilled to the heap.
+ *
+ * @param scratch the scratch context, which must outlive both
+ * @param expr the infix string expression to be tokenised
+ * @param pool the destination of the node pool
+ * @param allocator the allocator of anything that spills from the context, or
+ *      NULL for the standard allocator; it must outlive both
+ * @return the created expression
+ */
+struct expression * expression_scratch_initialise (
+    struct expression_scratch * scratch, const char * expr,
+    struct node_pool ** pool, const struct allocator * allocator );
+
+/**
+ * Reset an expression to hold the given string, as if it had been newly
+ * initialised with it. The storage of the expression (its node list, and its
+ * postfix, operator, and value stacks) is retained, so an expression may be
+ * reused for many strings without further allocation. Any variable binding is
+ * also retained. Nodes from the previous string are not freed; the caller
+ * should reset their pool.
+ *
+ * @param self the expression
+ * @param expr the infix string expression to be tokenised
+ */
+void expression_reset ( struct expression * self, const char * expr );
 
 /**
  * Shallow-destruct an entire expression type: constituent nodes are not freed.
+ * The storage of an expression initialised with 'expression_initialise_in' is
+ * not freed, but anything that spilled from it is.
  *
  * @param self the expression to be destructed
  */
 void expression_destruct ( struct expression * self );
 
+/**
+ * Bind a list of variable names to the expression. During tokenisation, each
+ * identifier is resolved to the position (slot) of its name in this list, and
+ * values are later supplied to the compiled program by slot. The list is not
+ * copied, so it must outlive tokenisation. This must be called before
+ * 'expression_tokenise' if the expression refers to any variables.
+ *
+ * @param self the expression
+ * @param names the list of variable names
+ * @param count the number of given names
+ */
+void expression_bind ( struct expression * self, const char * const * names,
+    unsigned int count );
+
+/**
+ * Select the optimisation passes applied to programs compiled from the
+ * expression (see 'prog.h'). The default passes are applied unless others are
+ * selected.
+ *
+ * @param self the expression
+ * @param passes the passes, from the 'prog_pass' enumeration
+ */
+void expression_set_passes ( struct expression * self, unsigned int passes );
+
 /**
  * Tokenise the expression in the given expression to its equivalent internal
  * representation, according to the standard rules of arithmetic defined by the
- * Node interface.
+ * Node interface. The tokens reference the string rather than copying it, so
+ * the string must outlive the conversion to postfix, which also encodes the
+ * tokens into nodes.
  *
  * @param self the expression
- * @param pools the list of available node pools
- * @param pool_count the number of available given pools
+ * @param pool the node pool from which the conversion to postfix takes nodes
  * @return a status code according to the standard expression error schema
  */
 enum expr_status expression_tokenise ( struct expression * self,
-    struct node_pool ** pools, unsigned int pool_count );
+    struct node_pool * pool );
 
 /**
  * Format and print a human-readable report of the status of the given
@@ -80,12 +199,55 @@ void expression_perror ( struct expression * self, const char * msg,
 
 /**
  * Convert the tokenised expression into an equivalent postfix (a.k.a.
- * Reverse-Polish notation.
+ * Reverse-Polish notation. Literals are converted as they are encoded into
+ * nodes, so a literal that is out of range is reported here.
  *
  * @param self the expression to convert
  * @return the new status of the given expression
  */
 enum expr_status expression_postfix ( struct expression * self );
 
+/**
+ * Tokenise the expression and convert it to postfix in a single pass: each
+ * token is handed to the Shunting Yard as soon as it has been encoded, so the
+ * infix form is never stored. This is equivalent to calling
+ * 'expression_tokenise' followed by 'expression_postfix'.
+ *
+ * @param self the expression
+ * @param pool the node pool from which to take nodes
+ * @return a status code according to the standard expression error schema
+ */
+enum expr_status expression_parse ( struct expression * self,
+    struct node_pool * pool );
+
+/**
+ * Evaluate the postfix form of the expression to a single number. The operands
+ * are held on a flat, contiguous value stack that is sized once, up-front, from
+ * the length of the postfix form; the stack is never grown during the walk.
+ * Expressions that refer to variables must instead be compiled, and evaluated
+ * with their inputs through the program interface.
+ *
+ * @param self the expression, already converted to postfix
+ * @param result the destination of the computed value; this is only written if
+ *      the evaluation succeeds
+ * @return the new status of the given expression
+ */
+enum expr_status expression_evaluate ( struct expression * self,
+    number_t * result );
+
+/**
+ * Compile the postfix form of the expression into a program, and optimise it
+ * with the selected passes. The program does not reference the expression, its
+ * nodes, or their pools, so all of these may be released once compilation has
+ * succeeded.
+ *
+ * @param self the expression, already converted to postfix
+ * @param program the destination of the new program; this is only written if
+ *      compilation succeeds
+ * @return the new status of the given expression
+ */
+enum expr_status expression_compile ( struct expression * self,
+    struct program ** program );
+
 #endif /* EXPR_H */
 
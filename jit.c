@@ -0,0 +1,591 @@
+/**
+ * Implement the native code interface; see 'jit.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined __x86_64__ && defined __unix__ && !defined NUMBER_FIXED
+#    include <sys/mman.h>
+#    include <unistd.h>
+#    define JIT_X86_64
+#endif
+
+#include "node.h"
+#include "debug.h"
+
+#include "jit.h"
+
+#ifdef JIT_X86_64
+
+/* NOTES ON THE GENERATED CODE
+ *
+ * Each function follows the System V calling convention. The frame and the
+ * variables arrive in RDI and RSI, and are moved to RBX and RBP, which survive
+ * calls, so cells are addressed as [RBX + 4i] and variables as [RBP + 4i]
+ * (or 8i, for doubles). Literals are placed after the code, and addressed
+ * relative to the instruction pointer. Every value is computed with the scalar
+ * SSE instructions (ADDSS, or ADDSD for doubles, and so on), which round
+ * exactly as the interpreters do; the wider AVX encodings offer nothing to
+ * scalar code. Fixed-point numbers saturate, which these instructions cannot,
+ * so they are never assembled.
+ *
+ * The registers XMM0 to XMM14 are the registers named by operands, and XMM15
+ * is scratch. Every XMM register is clobbered by a call, so before calling
+ * into the mathematics library, each register that has been written is stored
+ * to its home in the frame, and reloaded afterwards; the result is written to
+ * the home of its destination, so that it is reloaded with the rest.
+ */
+
+/**
+ * The scratch register, which is never named by an operand
+ */
+#define JIT_SCRATCH JIT_REGISTERS
+
+/**
+ * The first byte of each scalar SSE instruction, which selects the precision
+ */
+#if defined NUMBER_DOUBLE
+#    define JIT_SCALAR 0xf2
+#else
+#    define JIT_SCALAR 0xf3
+#endif
+
+/**
+ * A reference to a literal, to be patched once the address of the literal is
+ * known
+ */
+struct fixup {
+    /**
+     * The offset of the 32-bit displacement to be patched
+     */
+    size_t at;
+
+    /**
+     * The index of the literal
+     */
+    unsigned int literal;
+};
+
+/**
+ * The transparent assembler
+ */
+struct jit {
+    /**
+     * The code assembled so far, and its length and capacity in bytes
+     */
+    unsigned char * code;
+    size_t length, capacity;
+
+    /**
+     * The pending references to literals, and their number and capacity
+     */
+    struct fixup * fixups;
+    unsigned int pending, room;
+
+    /**
+     * The literals, and their number
+     */
+    number_t * literals;
+    unsigned int count;
+
+    /**
+     * The set of registers written so far, one bit per register
+     */
+    unsigned int written;
+
+    /**
+     * Whether an allocation has failed, or an operand could not be encoded
+     */
+    bool failed;
+};
+
+/**
+ * Append bytes to the code under assembly.
+ *
+ * @param self the assembler
+ * @param bytes the bytes
+ * @param n the number of bytes
+ */
+static void emit ( struct jit * self, const unsigned char * bytes, size_t n )
+{
+    unsigned char * code;
+    size_t capacity = self->capacity;
+
+    while ( self->length + n > capacity )
+        capacity *= 2;
+
+    if ( capacity != self->capacity ) {
+        if ( ! ( code = realloc ( self->code, capacity ) ) ) {
+            self->failed = true;
+            return;
+        }
+
+        self->code = code;
+        self->capacity = capacity;
+    }
+
+    memcpy ( self->code + self->length, bytes, n );
+    self->length += n;
+}
+
+/**
+ * Append a single byte to the code under assembly.
+ *
+ * @param self the assembler
+ * @param byte the byte
+ */
+static void emit_byte ( struct jit * self, unsigned char byte )
+{
+    emit ( self, &byte, 1 );
+}
+
+/**
+ * Append a little-endian 32-bit value to the code under assembly.
+ *
+ * @param self the assembler
+ * @param value the value
+ */
+static void emit_u32 ( struct jit * self, uint32_t value )
+{
+    const unsigned char bytes [ 4 ] = {
+        ( unsigned char ) value, ( unsigned char ) ( value >> 8 ),
+        ( unsigned char ) ( value >> 16 ), ( unsigned char ) ( value >> 24 )
+    };
+
+    emit ( self, bytes, sizeof ( bytes ) );
+}
+
+/**
+ * Append an SSE instruction whose register operand is a register, and whose
+ * other operand is the given operand.
+ *
+ * @param self the assembler
+ * @param prefix the mandatory prefix, or zero
+ * @param opcode the opcode, following the 0x0f escape
+ * @param reg the register operand
+ * @param rm the other operand
+ */
+static void sse ( struct jit * self, unsigned char prefix,
+        unsigned char opcode, unsigned int reg, struct jit_operand rm )
+{
+    const unsigned char modrm = ( unsigned char ) ( ( reg & 7 ) << 3 );
+    unsigned char rex = 0x40;
+    struct fixup * fixups;
+
+    if ( reg & 8 )
+        rex |= 0x04;
+    if ( rm.space == JIT_REGISTER && ( rm.index & 8 ) )
+        rex |= 0x01;
+
+    if ( prefix )
+        emit_byte ( self, prefix );
+    if ( rex != 0x40 )
+        emit_byte ( self, rex );
+
+    emit_byte ( self, 0x0f );
+    emit_byte ( self, opcode );
+
+    if ( rm.index > INT32_MAX / sizeof ( number_t ) )
+        self->failed = true;
+
+    switch ( rm.space ) {
+        case JIT_REGISTER:
+            emit_byte ( self, 0xc0 | modrm | ( rm.index & 7 ) );
+            break;
+
+        case JIT_LITERAL:
+            if ( self->pending == self->room ) {
+                if ( ! ( fixups = realloc ( self->fixups,
+                        sizeof ( struct fixup ) * self->room * 2 ) ) ) {
+                    self->failed = true;
+                    return;
+                }
+
+                self->fixups = fixups;
+                self->room *= 2;
+            }
+
+            /* [RIP + disp32], patched on finalisation */
+            emit_byte ( self, 0x05 | modrm );
+            self->fixups [ self->pending++ ] = ( struct fixup ) {
+                self->length, rm.index };
+            emit_u32 ( self, 0 );
+            break;
+
+        case JIT_VARIABLE:
+            /* [RBP + disp32] */
+            emit_byte ( self, 0x85 | modrm );
+            emit_u32 ( self, ( uint32_t ) ( rm.index * sizeof ( number_t ) ) );
+            break;
+
+        case JIT_CELL:
+            /* [RBX + disp32] */
+            emit_byte ( self, 0x83 | modrm );
+            emit_u32 ( self, ( uint32_t ) ( rm.index * sizeof ( number_t ) ) );
+            break;
+    }
+}
+
+/**
+ * Raise a number to a power, as called by native code.
+ *
+ * @param lhs the base
+ * @param rhs the exponent
+ * @return the power
+ */
+static number_t power ( number_t lhs, number_t rhs )
+{
+    return number_power ( lhs, rhs );
+}
+
+/**
+ * Determine whether an operand is the given register.
+ *
+ * @param operand the operand
+ * @param reg the register
+ * @return true if the operand is the register, or false
+ */
+static inline bool is_register ( struct jit_operand operand, unsigned int reg )
+{
+    return operand.space == JIT_REGISTER && operand.index == reg;
+}
+
+/**
+ * Find the home in the frame of an operand that is a register.
+ *
+ * @param operand the operand
+ * @return the home of the register, or the operand itself otherwise
+ */
+static inline struct jit_operand home ( struct jit_operand operand )
+{
+    return operand.space == JIT_REGISTER ?
+        ( struct jit_operand ) { JIT_CELL, operand.index } : operand;
+}
+
+/**
+ * Append the load of an operand into a register, unless it is already there.
+ *
+ * @param self the assembler
+ * @param reg the register
+ * @param src the operand
+ */
+static void load ( struct jit * self, unsigned int reg, struct jit_operand src )
+{
+    if ( is_register ( src, reg ) )
+        return;
+
+    /* MOVAPS between registers, which avoids the partial-register dependency
+     * of MOVSS, and MOVSS from memory */
+    if ( src.space == JIT_REGISTER )
+        sse ( self, 0, 0x28, reg, src );
+    else
+        sse ( self, JIT_SCALAR, 0x10, reg, src );
+}
+
+/**
+ * Append the store of a register into a cell.
+ *
+ * @param self the assembler
+ * @param dst the cell
+ * @param reg the register
+ */
+static void store ( struct jit * self, struct jit_operand dst,
+        unsigned int reg )
+{
+    sse ( self, JIT_SCALAR, 0x11, reg, dst );
+}
+
+/**
+ * Append a call into the mathematics library, preserving every register that
+ * has been written.
+ *
+ * @param self the assembler
+ * @param fn the address of the function
+ * @param dst the destination
+ * @param lhs the first argument
+ * @param rhs the second argument, or NULL to pass the integral argument
+ * @param integral the integral argument
+ */
+static void call ( struct jit * self, uintptr_t fn, struct jit_operand dst,
+        struct jit_operand lhs, const struct jit_operand * rhs, int integral )
+{
+    for ( unsigned int r = 0; r < JIT_REGISTERS; r++ )
+        if ( self->written & ( 1U << r ) )
+            store ( self, home ( ( struct jit_operand ) { JIT_REGISTER, r } ),
+                r );
+
+    /* The arguments are loaded from the homes of their registers, which are
+     * not overwritten by loading the other argument */
+    load ( self, 0, home ( lhs ) );
+
+    if ( rhs )
+        load ( self, 1, home ( *rhs ) );
+    else {
+        /* MOV EDI, imm32 */
+        emit_byte ( self, 0xbf );
+        emit_u32 ( self, ( uint32_t ) integral );
+    }
+
+    /* MOV RAX, imm64; CALL RAX */
+    emit_byte ( self, 0x48 );
+    emit_byte ( self, 0xb8 );
+    emit_u32 ( self, ( uint32_t ) fn );
+    emit_u32 ( self, ( uint32_t ) ( ( uint64_t ) fn >> 32 ) );
+    emit_byte ( self, 0xff );
+    emit_byte ( self, 0xd0 );
+
+    store ( self, home ( dst ), 0 );
+
+    if ( dst.space == JIT_REGISTER )
+        self->written |= 1U << dst.index;
+
+    for ( unsigned int r = 0; r < JIT_REGISTERS; r++ )
+        if ( self->written & ( 1U << r ) )
+            load ( self, r, home ( ( struct jit_operand ) { JIT_REGISTER,
+                r } ) );
+}
+
+bool jit_supported ( void )
+{
+    return true;
+}
+
+struct jit * jit_initialise ( const number_t * literals, unsigned int count )
+{
+    /* PUSH RBX; PUSH RBP; SUB RSP, 8; MOV RBX, RDI; MOV RBP, RSI. The stack
+     * is left aligned to sixteen bytes for calls. */
+    static const unsigned char prologue [ ] = {
+        0x53, 0x55, 0x48, 0x83, 0xec, 0x08, 0x48, 0x89, 0xfb, 0x48, 0x89, 0xf5
+    };
+    struct jit * self;
+
+    if ( ! ( self = malloc ( sizeof ( struct jit ) ) ) )
+        return NULL;
+
+    self->length = 0;
+    self->capacity = 256;
+    self->pending = 0;
+    self->room = 16;
+    self->count = count;
+    self->written = 0;
+    self->failed = false;
+
+    self->code = malloc ( self->capacity );
+    self->fixups = malloc ( sizeof ( struct fixup ) * self->room );
+    self->literals = malloc ( sizeof ( number_t ) * count + 1 );
+
+    if ( !self->code || !self->fixups || !self->literals ) {
+        free ( self->code );
+        free ( self->fixups );
+        free ( self->literals );
+        free ( self );
+        return NULL;
+    }
+
+    if ( count )
+        memcpy ( self->literals, literals, sizeof ( number_t ) * count );
+
+    emit ( self, prologue, sizeof ( prologue ) );
+    return self;
+}
+
+void jit_binary ( struct jit * self, enum jit_op op, struct jit_operand dst,
+        struct jit_operand lhs, struct jit_operand rhs )
+{
+    const unsigned int d = ( dst.space == JIT_REGISTER ) ? dst.index :
+        JIT_SCRATCH;
+    unsigned char opcode = 0;
+
+    switch ( op ) {
+        case JIT_OP_EXP:
+            call ( self, ( uintptr_t ) power, dst, lhs, &rhs, 0 );
+            return;
+
+        case JIT_OP_DIVIDE:   opcode = 0x5e; break;
+        case JIT_OP_MULTIPLY: opcode = 0x59; break;
+        case JIT_OP_ADD:      opcode = 0x58; break;
+        case JIT_OP_SUBTRACT: opcode = 0x5c; break;
+    }
+
+    /* The destination is computed in place, so when it is the right-hand
+     * operand, a commutative operation swaps its operands, and any other
+     * moves the right-hand operand aside first */
+    if ( is_register ( rhs, d ) && !is_register ( lhs, d ) ) {
+        if ( op == JIT_OP_MULTIPLY || op == JIT_OP_ADD )
+            sse ( self, JIT_SCALAR, opcode, d, lhs );
+        else {
+            load ( self, JIT_SCRATCH, rhs );
+            load ( self, d, lhs );
+            sse ( self, JIT_SCALAR, opcode, d, ( struct jit_operand ) {
+                JIT_REGISTER, JIT_SCRATCH } );
+        }
+    } else {
+        load ( self, d, lhs );
+        sse ( self, JIT_SCALAR, opcode, d, rhs );
+    }
+
+    if ( dst.space == JIT_REGISTER )
+        self->written |= 1U << d;
+    else
+        store ( self, dst, JIT_SCRATCH );
+}
+
+void jit_call_int ( struct jit * self, number_t ( * fn ) ( number_t, int ),
+        struct jit_operand dst, struct jit_operand lhs, int exponent )
+{
+    call ( self, ( uintptr_t ) fn, dst, lhs, NULL, exponent );
+}
+
+void jit_return ( struct jit * self, struct jit_operand result )
+{
+    /* ADD RSP, 8; POP RBP; POP RBX; RET */
+    static const unsigned char epilogue [ ] = {
+        0x48, 0x83, 0xc4, 0x08, 0x5d, 0x5b, 0xc3
+    };
+
+    load ( self, 0, result );
+    emit ( self, epilogue, sizeof ( epilogue ) );
+}
+
+/**
+ * Patch the references to literals, and copy the code and the literals into a
+ * new executable mapping. If this function fails, then 'errno' is set
+ * appropriately.
+ *
+ * @param self the assembler, whose code is padded to align the literals
+ * @param page the size of a page
+ * @param size the destination of the size of the mapping, in bytes
+ * @return the mapping, or NULL on failure
+ */
+static void * place ( struct jit * self, size_t page, size_t * size )
+{
+    int32_t rel;
+    void * map;
+
+    for ( unsigned int i = 0; i < self->pending; i++ ) {
+        rel = ( int32_t ) ( self->length + self->fixups [ i ].literal *
+            sizeof ( number_t ) - ( self->fixups [ i ].at + 4 ) );
+        memcpy ( self->code + self->fixups [ i ].at, &rel, sizeof ( rel ) );
+    }
+
+    *size = self->length + sizeof ( number_t ) * self->count;
+    *size = ( *size + page - 1 ) & ~ ( page - 1 );
+
+    if ( ( map = mmap ( NULL, *size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED )
+        return NULL;
+
+    memcpy ( map, self->code, self->length );
+    memcpy ( ( char * ) map + self->length, self->literals,
+        sizeof ( number_t ) * self->count );
+
+    /* The mapping is never writable and executable at once */
+    if ( mprotect ( map, *size, PROT_READ | PROT_EXEC ) ) {
+        munmap ( map, *size );
+        return NULL;
+    }
+
+    return map;
+}
+
+jit_function jit_finalise ( struct jit * self, size_t * size )
+{
+    const long page = sysconf ( _SC_PAGESIZE );
+    jit_function fn = NULL;
+    void * map;
+
+    /* The literals follow the code, aligned, with INT3 as padding */
+    while ( self->length % sizeof ( number_t ) )
+        emit_byte ( self, 0xcc );
+
+    if ( self->failed || page <= 0 )
+        errno = ENOMEM;
+
+    else if ( ( map = place ( self, ( size_t ) page, size ) ) ) {
+        memcpy ( &fn, &map, sizeof ( fn ) );
+        debug_printf ( "Assembled %zu byte(s) of native code\n",
+            self->length );
+    }
+
+    free ( self->code );
+    free ( self->fixups );
+    free ( self->literals );
+    free ( self );
+    return fn;
+}
+
+void jit_release ( jit_function fn, size_t size )
+{
+    void * map;
+
+    if ( fn ) {
+        memcpy ( &map, &fn, sizeof ( map ) );
+        munmap ( map, size );
+    }
+}
+
+#else
+
+bool jit_supported ( void )
+{
+    return false;
+}
+
+struct jit * jit_initialise ( const number_t * literals, unsigned int count )
+{
+    ( void ) literals;
+    ( void ) count;
+
+    errno = ENOSYS;
+    return NULL;
+}
+
+void jit_binary ( struct jit * self, enum jit_op op, struct jit_operand dst,
+        struct jit_operand lhs, struct jit_operand rhs )
+{
+    ( void ) self;
+    ( void ) op;
+    ( void ) dst;
+    ( void ) lhs;
+    ( void ) rhs;
+}
+
+void jit_call_int ( struct jit * self, number_t ( * fn ) ( number_t, int ),
+        struct jit_operand dst, struct jit_operand lhs, int exponent )
+{
+    ( void ) self;
+    ( void ) fn;
+    ( void ) dst;
+    ( void ) lhs;
+    ( void ) exponent;
+}
+
+void jit_return ( struct jit * self, struct jit_operand result )
+{
+    ( void ) self;
+    ( void ) result;
+}
+
+jit_function jit_finalise ( struct jit * self, size_t * size )
+{
+    ( void ) self;
+    ( void ) size;
+
+    errno = ENOSYS;
+    return NULL;
+}
+
+void jit_release ( jit_function fn, size_t size )
+{
+    ( void ) fn;
+    ( void ) size;
+}
+
+#endif /* JIT_X86_64 */
@@ -0,0 +1,163 @@
+/**
+ * This interface assembles three-address code into native machine code, held
+ * in its own executable mapping and called as an ordinary function. Operands
+ * are registers of the host, literals, variables, or cells of a frame supplied
+ * by the caller. Callers should:
+ *
+ *  - Check that the host is supported at all (see 'jit_supported');
+ *  - Initialise an assembler with the literals of the code;
+ *  - Append each instruction, in order, and then the return of the result;
+ *  - Finalise the assembler, to obtain the native function;
+ *  - Call the function as often as required, with a frame and the variables;
+ *  - Once finished, release the function.
+ *
+ * Only x86-64 hosts are supported. Elsewhere, no assembler can be initialised,
+ * and the caller is expected to keep interpreting its code.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "node.h"
+
+/**
+ * The number of registers of the host that may be named as operands. The
+ * first JIT_REGISTERS cells of every frame are reserved to hold them across
+ * calls to the mathematics library.
+ */
+#define JIT_REGISTERS 15U
+
+/**
+ * The base opaque type of an assembler
+ */
+struct jit;
+
+/**
+ * A finalised native function
+ *
+ * @param frame the frame, holding at least as many cells as the greatest cell
+ *      named by the code, and no fewer than JIT_REGISTERS
+ * @param vars the values of the variables, indexed by slot
+ * @return the computed value
+ */
+typedef number_t ( * jit_function ) ( number_t * frame,
+    const number_t * vars );
+
+/**
+ * The operations that may be assembled
+ */
+enum jit_op {
+    JIT_OP_EXP,
+    JIT_OP_DIVIDE,
+    JIT_OP_MULTIPLY,
+    JIT_OP_ADD,
+    JIT_OP_SUBTRACT,
+};
+
+/**
+ * The locations in which an operand may be held
+ */
+enum jit_space {
+    /* A register of the host, below JIT_REGISTERS */
+    JIT_REGISTER,
+
+    /* A literal, indexed among those given to the assembler */
+    JIT_LITERAL,
+
+    /* A variable, indexed by slot */
+    JIT_VARIABLE,
+
+    /* A cell of the frame, which is writable */
+    JIT_CELL,
+};
+
+/**
+ * An operand of an instruction
+ */
+struct jit_operand {
+    /**
+     * The location of the operand
+     */
+    enum jit_space space;
+
+    /**
+     * The index of the operand within its location
+     */
+    unsigned int index;
+};
+
+/**
+ * Determine whether native code can be assembled for the host at all.
+ *
+ * @return true if the host is supported, or false
+ */
+bool jit_supported ( void );
+
+/**
+ * Initialise an assembler. If this function fails, then 'errno' is set
+ * appropriately: ENOSYS indicates an unsupported host.
+ *
+ * @param literals the values of the literals; these are copied
+ * @param count the number of literals
+ * @return the new assembler, or NULL on failure
+ */
+struct jit * jit_initialise ( const number_t * literals, unsigned int count );
+
+/**
+ * Append a binary operation, 'dst = lhs op rhs', to the code under assembly.
+ * The destination must be a register or a cell.
+ *
+ * @param self the assembler
+ * @param op the operation
+ * @param dst the destination
+ * @param lhs the left-hand operand
+ * @param rhs the right-hand operand
+ */
+void jit_binary ( struct jit * self, enum jit_op op, struct jit_operand dst,
+    struct jit_operand lhs, struct jit_operand rhs );
+
+/**
+ * Append a call to a helper function, 'dst = fn ( lhs, exponent )', to the
+ * code under assembly. The destination must be a register or a cell.
+ *
+ * @param self the assembler
+ * @param fn the helper function
+ * @param dst the destination
+ * @param lhs the operand
+ * @param exponent the integral argument
+ */
+void jit_call_int ( struct jit * self, number_t ( * fn ) ( number_t, int ),
+    struct jit_operand dst, struct jit_operand lhs, int exponent );
+
+/**
+ * Append the return of the given operand, which ends the code under assembly.
+ *
+ * @param self the assembler
+ * @param result the value to return
+ */
+void jit_return ( struct jit * self, struct jit_operand result );
+
+/**
+ * Finalise an assembler, mapping its code into executable memory, and then
+ * destruct it. If this function fails, then 'errno' is set appropriately.
+ *
+ * @param self the assembler to be finalised
+ * @param size the destination of the size of the mapping, in bytes
+ * @return the native function, or NULL on failure
+ */
+jit_function jit_finalise ( struct jit * self, size_t * size );
+
+/**
+ * Release a native function, unmapping its code.
+ *
+ * @param fn the native function, or NULL
+ * @param size the size of its mapping, as given on finalisation
+ */
+void jit_release ( jit_function fn, size_t size );
+
+#endif /* JIT_H */
@@ -0,0 +1,179 @@
+/**
+ * Implement the block kernel interface; see 'kernel.h'.
+ *
+ * The vectorised kernels handle whole vectors of lanes, and finish any
+ * remaining rows with the scalar operator. Exponentiation has no vector
+ * instruction, and a polynomial approximation would not agree with powf(3),
+ * so every set shares the scalar exponentiation kernel. The vector width and
+ * intrinsics follow the number type (see 'number.h'); saturating fixed-point
+ * arithmetic has no vector instructions either, so it has only scalar kernels.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <math.h>
+
+#if ( defined __x86_64__ || defined __i386__ ) && !defined NUMBER_FIXED
+#    include <immintrin.h>
+#    define KERNEL_X86
+#endif
+
+#include "node.h"
+#include "cpu.h"
+#include "debug.h"
+
+#include "kernel.h"
+
+/**
+ * Define a portable scalar kernel for an operator.
+ *
+ * @param name the name of the kernel
+ * @param op the operator function (see 'number.h')
+ */
+#define SCALAR_KERNEL(name, op)                                            \
+    static void name ( number_t * restrict lhs,                            \
+            const number_t * restrict rhs, unsigned int n )                \
+    {                                                                      \
+        for ( unsigned int i = 0; i < n; i++ )                             \
+            lhs [ i ] = op ( lhs [ i ], rhs [ i ] );                       \
+    }
+
+SCALAR_KERNEL ( scalar_divide,   number_divide )
+SCALAR_KERNEL ( scalar_multiply, number_multiply )
+SCALAR_KERNEL ( scalar_add,      number_add )
+SCALAR_KERNEL ( scalar_subtract, number_subtract )
+
+/**
+ * The scalar exponentiation kernel, shared by all sets
+ *
+ * @param lhs the bases, and the destination of the results
+ * @param rhs the exponents
+ * @param n the number of rows
+ */
+static void scalar_exp ( number_t * restrict lhs,
+        const number_t * restrict rhs, unsigned int n )
+{
+    for ( unsigned int i = 0; i < n; i++ )
+        lhs [ i ] = number_power ( lhs [ i ], rhs [ i ] );
+}
+
+static const struct kernels scalar_kernels = {
+    .exp      = scalar_exp,
+    .divide   = scalar_divide,
+    .multiply = scalar_multiply,
+    .add      = scalar_add,
+    .subtract = scalar_subtract,
+    .level    = CPU_SCALAR,
+};
+
+#ifdef KERNEL_X86
+
+/**
+ * Define a vectorised kernel for an infix operator.
+ *
+ * @param name the name of the kernel
+ * @param isa the instruction-set extension to be targeted by the compiler
+ * @param width the number of lanes in a vector
+ * @param vec the vector type
+ * @param load the unaligned vector load intrinsic
+ * @param store the unaligned vector store intrinsic
+ * @param vop the vector operator intrinsic
+ * @param op the equivalent scalar operator function
+ */
+#define VECTOR_KERNEL(name, isa, width, vec, load, store, vop, op)         \
+    __attribute__ (( target ( isa ) ))                                     \
+    static void name ( number_t * restrict lhs,                            \
+            const number_t * restrict rhs, unsigned int n )                \
+    {                                                                      \
+        unsigned int i = 0;                                                \
+                                                                           \
+        for ( ; i + width <= n; i += width ) {                             \
+            vec l = load ( & ( lhs [ i ] ) );                              \
+            vec r = load ( & ( rhs [ i ] ) );                              \
+            store ( & ( lhs [ i ] ), vop ( l, r ) );                       \
+        }                                                                  \
+                                                                           \
+        for ( ; i < n; i++ )                                               \
+            lhs [ i ] = op ( lhs [ i ], rhs [ i ] );                       \
+    }
+
+#if defined NUMBER_DOUBLE
+#    define SSE2_KERNEL(name, vop, op) VECTOR_KERNEL ( name, "sse2", 2,    \
+        __m128d, _mm_loadu_pd, _mm_storeu_pd, _mm_##vop##_pd, op )
+#    define AVX2_KERNEL(name, vop, op) VECTOR_KERNEL ( name, "avx2", 4,    \
+        __m256d, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_##vop##_pd, op )
+#else
+#    define SSE2_KERNEL(name, vop, op) VECTOR_KERNEL ( name, "sse2", 4,    \
+        __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_##vop##_ps, op )
+#    define AVX2_KERNEL(name, vop, op) VECTOR_KERNEL ( name, "avx2", 8,    \
+        __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_##vop##_ps, op )
+#endif
+
+SSE2_KERNEL ( sse2_divide,   div, number_divide )
+SSE2_KERNEL ( sse2_multiply, mul, number_multiply )
+SSE2_KERNEL ( sse2_add,      add, number_add )
+SSE2_KERNEL ( sse2_subtract, sub, number_subtract )
+
+AVX2_KERNEL ( avx2_divide,   div, number_divide )
+AVX2_KERNEL ( avx2_multiply, mul, number_multiply )
+AVX2_KERNEL ( avx2_add,      add, number_add )
+AVX2_KERNEL ( avx2_subtract, sub, number_subtract )
+
+static const struct kernels sse2_kernels = {
+    .exp      = scalar_exp,
+    .divide   = sse2_divide,
+    .multiply = sse2_multiply,
+    .add      = sse2_add,
+    .subtract = sse2_subtract,
+    .level    = CPU_SSE2,
+};
+
+static const struct kernels avx2_kernels = {
+    .exp      = scalar_exp,
+    .divide   = avx2_divide,
+    .multiply = avx2_multiply,
+    .add      = avx2_add,
+    .subtract = avx2_subtract,
+    .level    = CPU_AVX2,
+};
+
+#endif /* KERNEL_X86 */
+
+/**
+ * The kernels selected for the host processor, set once at start-up
+ */
+static const struct kernels * selected = &scalar_kernels;
+
+/**
+ * Select the kernels for the host processor. This runs before 'main', so the
+ * selection is complete before any thread could observe it.
+ */
+__attribute__ (( constructor ))
+static void kernels_select ( void )
+{
+    selected = kernels_for ( cpu_detect ( ) );
+    debug_printf ( "Selected the %s block kernels\n",
+        cpu_level_str ( selected->level ) );
+}
+
+const struct kernels * kernels_get ( void )
+{
+    return selected;
+}
+
+const struct kernels * kernels_for ( enum cpu_level level )
+{
+    switch ( level ) {
+#ifdef KERNEL_X86
+        case CPU_AVX2: return &avx2_kernels;
+        case CPU_SSE2: return &sse2_kernels;
+#else
+        case CPU_AVX2:
+        case CPU_SSE2:
+#endif
+        case CPU_SCALAR:
+        case CPU_COUNT:
+        default:
+            return &scalar_kernels;
+    }
+}
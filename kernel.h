@@ -0,0 +1,60 @@
+/**
+ * This interface exposes the block kernels used by the batch evaluator: each
+ * kernel applies one arithmetic operator across a block of rows, leaving the
+ * results in the left-hand operands. Vectorised kernels are selected once, at
+ * start-up, according to the extensions supported by the host processor (see
+ * 'cpu.h'); the portable scalar kernels are the fallback.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "node.h"
+#include "cpu.h"
+
+/**
+ * A block kernel for a binary operator
+ *
+ * @param lhs the left-hand operands, and the destination of the results
+ * @param rhs the right-hand operands
+ * @param n the number of rows
+ */
+typedef void ( * kernel_fn ) ( number_t * restrict lhs,
+    const number_t * restrict rhs, unsigned int n );
+
+/**
+ * A complete set of block kernels for a particular instruction-set extension
+ */
+struct kernels {
+    kernel_fn exp;
+    kernel_fn divide;
+    kernel_fn multiply;
+    kernel_fn add;
+    kernel_fn subtract;
+
+    /**
+     * The extension targeted by the set
+     */
+    enum cpu_level level;
+};
+
+/**
+ * Retrieve the set of block kernels selected for the host processor.
+ *
+ * @return the selected kernels
+ */
+const struct kernels * kernels_get ( void );
+
+/**
+ * Retrieve the set of block kernels targeting the given extension. The host
+ * processor is not consulted, so the caller is responsible for ensuring that
+ * the extension is supported.
+ *
+ * @param level the extension
+ * @return the kernels, or the scalar kernels if the extension has none
+ */
+const struct kernels * kernels_for ( enum cpu_level level );
+
+#endif /* KERNEL_H */
@@ -10,9 +10,14 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <math.h>
+#include <ctype.h>
 
 #include "node.h"
+#include "scan.h"
 #include "debug.h"
+#include "alloc.h"
+#include "stats.h"
 
 /**
  * The transparent node
@@ -29,37 +34,142 @@ struct node {
     union {
         enum node_operator op;
         number_t value;
+        unsigned int slot;
     };
 };
 
+/**
+ * The greatest datum of a token
+ */
+#define TOKEN_DATUM_MAX ( UINT32_MAX >> NODE_TOKEN_TYPE_BITS )
+
+/**
+ * An individual block of nodes, chained to the next (larger) block of the pool
+ */
+struct node_block {
+    /**
+     * The next block in the chain, or NULL if this is the last block
+     */
+    struct node_block * next;
+
+    /**
+     * The fixed capacity of the block
+     */
+    unsigned int capacity;
+
+    /**
+     * The node array, allocated in-line with the block
+     */
+    struct node data [ ];
+};
+
 /**
  * The transparent node pool
  */
 struct node_pool {
     /**
-     * The fixed capacity of the pool
+     * The first block of the chain
      */
-    unsigned int capacity;
+    struct node_block * head;
 
     /**
-     * The current occupation of the pool
+     * The block from which nodes are currently being taken
+     */
+    struct node_block * current;
+
+    /**
+     * The current occupation of the current block
      */
     unsigned int used;
 
     /**
-     * The node array
+     * The allocator of the pool, and of its blocks
      */
-    struct node * data;
+    const struct allocator * allocator;
+
+    /**
+     * Whether the pool was allocated by 'pool_initialise', rather than placed
+     * in storage by the caller
+     */
+    bool owned;
+
+    /**
+     * The in-line block, and its nodes
+     */
+    _Alignas ( struct node_block ) unsigned char inline_block [
+        sizeof ( struct node_block ) +
+        sizeof ( struct node ) * POOL_INLINE_CAPACITY ];
 };
 
+_Static_assert ( sizeof ( struct node_pool ) <= sizeof ( struct pool_storage ),
+    "A pool must fit within its storage" );
+
 /**
- * Is the pool full?
+ * Is the current block of the pool full?
  *
- * @param self the status of the pool
+ * @param self the pool
+ * @return the status of the current block
  */
 static inline bool is_full ( struct node_pool * self )
 {
-    return self->used == self->capacity;
+    return self->used == self->current->capacity;
+}
+
+/**
+ * Compute the size of a block of nodes.
+ *
+ * @param capacity the fixed capacity of the block
+ * @return the size of the block, in bytes
+ */
+static inline size_t block_size ( unsigned int capacity )
+{
+    return sizeof ( struct node_block ) + sizeof ( struct node ) * capacity;
+}
+
+/**
+ * Allocate a new, empty block of nodes.
+ *
+ * @param capacity the fixed capacity of the block
+ * @param allocator the allocator
+ * @return the address of the new block, or NULL on failure
+ */
+static struct node_block * block_initialise ( unsigned int capacity,
+        const struct allocator * allocator )
+{
+    struct node_block * block;
+
+    if ( ( block = allocator_alloc ( allocator, block_size ( capacity ) ) ) ) {
+        block->next = NULL;
+        block->capacity = capacity;
+    }
+
+    return block;
+}
+
+/**
+ * Move the pool on to the next block of the chain, allocating and linking a new
+ * block, of double the capacity of the current one, if the chain is exhausted.
+ *
+ * @param self the pool
+ * @return the ability to take a new node from the pool
+ */
+static bool advance_block ( struct node_pool * self )
+{
+    struct node_block * block = self->current->next;
+
+    if ( !block ) {
+        if ( ! ( block = block_initialise (
+                self->current->capacity << 1, self->allocator ) ) )
+            return false;
+
+        self->current->next = block;
+        debug_puts ( "Node pool grown" );
+    }
+
+    self->current = block;
+    self->used = 0;
+
+    return true;
 }
 
 /**
@@ -94,8 +204,8 @@ static inline unsigned int encode_prn ( struct node * self, enum node_type prn )
 }
 
 /**
- * A helper for encoding a literal (assumed to be type-compatible with float)
- * into a node; the node type is also set appropriately.
+ * A helper for encoding a literal into a node; the node type is also set
+ * appropriately. See 'scan.h' for the accepted forms.
  *
  * @param self the target node
  * @param str the string whose head begins a literal token
@@ -103,19 +213,69 @@ static inline unsigned int encode_prn ( struct node * self, enum node_type prn )
  */
 static inline unsigned int encode_lit ( struct node * self, const char * str )
 {
-    char * end_ptr;
+    unsigned int length;
     number_t val;
 
-    errno = 0;
-    val = strtof ( str, &end_ptr );
-
-    if ( !errno && end_ptr != str ) {
+    if ( ( length = scan_number ( str, &val ) ) ) {
         self->type = NODE_LITERAL;
         self->value = val;
-    } else
-        return 0;
+    }
+
+    return length;
+}
+
+/**
+ * Resolve an identifier to a slot in the given list of names. Identifiers
+ * begin with a letter or an underscore, and continue with letters, digits, and
+ * underscores.
+ *
+ * @param str the string whose head begins an identifier token
+ * @param names the list of variable names
+ * @param name_count the number of given variable names
+ * @param slot the destination of the slot
+ * @return the length of the identifier, or zero if it is not a known variable
+ */
+static unsigned int resolve_var ( const char * str, const char * const * names,
+        unsigned int name_count, unsigned int * slot )
+{
+    unsigned int length = 1;
+
+    while ( isalnum ( ( unsigned char ) str [ length ] ) ||
+            str [ length ] == '_' )
+        length++;
 
-    return ( unsigned int ) ( end_ptr - str );
+    for ( unsigned int i = 0; i < name_count; i++ )
+        if ( !strncmp ( names [ i ], str, length ) &&
+                names [ i ] [ length ] == '\0' ) {
+            *slot = i;
+            return length;
+        }
+
+    return 0;
+}
+
+/**
+ * A helper for encoding an identifier into a variable node, resolving it to a
+ * slot in the given list of names; the node type is also set appropriately.
+ *
+ * @param self the target node
+ * @param str the string whose head begins an identifier token
+ * @param names the list of variable names
+ * @param name_count the number of given variable names
+ * @return the number of bytes by which the input string should be advanced, or
+ *      zero if the identifier is not a known variable
+ */
+static unsigned int encode_var ( struct node * self, const char * str,
+        const char * const * names, unsigned int name_count )
+{
+    unsigned int length, slot;
+
+    if ( ( length = resolve_var ( str, names, name_count, &slot ) ) ) {
+        self->type = NODE_VARIABLE;
+        self->slot = slot;
+    }
+
+    return length;
 }
 
 /**
@@ -162,8 +322,26 @@ static unsigned int simple_writeout ( char * dest, const char * src,
 static inline unsigned int formatter_literal ( struct node * self,
         char * buffer, unsigned int size )
 {
-    int retval = snprintf ( buffer, size, "Literal: %.3f", ( double )
-        self->value );
+    char number [ NUMBER_FORMAT_SIZE ];
+    int retval;
+
+    number_format ( number, sizeof ( number ), self->value );
+    retval = snprintf ( buffer, size, "Literal: %s", number );
+
+    return ( retval < 0 ) ? 0 : ( unsigned int ) retval;
+}
+
+/**
+ * Format a node variable to the given buffer.
+ *
+ * @param self the node
+ * @param buffer the destination string buffer
+ * @param size the capacity of the destination
+ */
+static inline unsigned int formatter_variable ( struct node * self,
+        char * buffer, unsigned int size )
+{
+    int retval = snprintf ( buffer, size, "Variable: %u", self->slot );
 
     return ( retval < 0 ) ? 0 : ( unsigned int ) retval;
 }
@@ -218,48 +396,91 @@ static inline unsigned int formatter_paren ( struct node * self, char * buffer,
         "Left Parenthesis" : "Right Parenthesis", size );
 }
 
-struct node_pool * pool_initialise ( unsigned int capacity )
+struct node_pool * pool_initialise_in ( struct pool_storage * storage,
+        unsigned int capacity, const struct allocator * allocator )
 {
-    static const unsigned int DEFAULT_CAPACITY = 16;
-    struct node_pool * self;
+    struct node_pool * self = ( void * ) storage;
+
+    self->allocator = allocator_resolve ( allocator );
+
+    if ( capacity > POOL_INLINE_CAPACITY ) {
+        if ( ! ( self->head = block_initialise ( capacity,
+                self->allocator ) ) )
+            return NULL;
+    } else {
+        self->head = ( void * ) self->inline_block;
+        self->head->next = NULL;
+        self->head->capacity = POOL_INLINE_CAPACITY;
+    }
 
-    if ( !capacity )
-        capacity = DEFAULT_CAPACITY;
+    self->current = self->head;
+    self->used = 0;
+    self->owned = false;
+    debug_puts ( "Node pool initialised" );
 
-    if ( ( self = malloc ( sizeof ( struct node_pool ) ) ) )
-        if ( ! ( self->data = malloc ( sizeof ( struct node ) *
-                capacity ) ) ) {
-            free ( self );
-            self = NULL;
-        } else {
-            self->capacity = capacity;
-            self->used = 0;
-            debug_puts ( "Node pool initialised" );
-        }
+    return self;
+}
+
+struct node_pool * pool_initialise ( unsigned int capacity,
+        const struct allocator * allocator )
+{
+    struct pool_storage * storage;
+    struct node_pool * self = NULL;
+
+    allocator = allocator_resolve ( allocator );
+
+    if ( ( storage = allocator_alloc ( allocator,
+            sizeof ( struct pool_storage ) ) ) &&
+            ! ( self = pool_initialise_in ( storage, capacity, allocator ) ) )
+        allocator_free ( allocator, storage, sizeof ( struct pool_storage ) );
+
+    if ( self )
+        self->owned = true;
 
     return self;
 }
 
 void pool_destruct ( struct node_pool * self )
 {
+    struct node_block * block, * next;
+
     if ( self ) {
-        free ( self->data );
-        free ( self );
+        for ( block = self->head; block; block = next ) {
+            next = block->next;
+
+            if ( block != ( void * ) self->inline_block )
+                allocator_free ( self->allocator, block,
+                    block_size ( block->capacity ) );
+        }
+
+        if ( self->owned )
+            allocator_free ( self->allocator, self,
+                sizeof ( struct pool_storage ) );
+
         debug_puts ( "Node pool destructed" );
     }
 }
 
+void pool_reset ( struct node_pool * self )
+{
+    self->current = self->head;
+    self->used = 0;
+}
+
 struct node * pool_new_node ( struct node_pool * self )
 {
     struct node * node = NULL;
 
-    if ( !is_full ( self ) )
-        node = & ( self->data [ self->used++ ] );
+    if ( !is_full ( self ) || advance_block ( self ) ) {
+        node = & ( self->current->data [ self->used++ ] );
+        stats_count ( nodes, 1 );
+    }
 
     return node;
 }
 
-char * node_format ( void * self, char * buffer, unsigned int size )
+char * node_format ( node_kind_t kind, union node_datum datum, char * buffer,
+        unsigned int size )
 {
     const unsigned int MINIMUM_LENGTH = 16;
     static unsigned int ( * const formatter [ NODE_COUNT ] )
@@ -269,7 +490,9 @@ char * node_format ( void * self, char * buffer, unsigned int size )
                 formatter_literal,     /* Literal     */
                 formatter_paren,       /* (L) Parenthesis */
                 formatter_paren,       /* (R) Parenthesis */
+                formatter_variable,    /* Variable    */
             };
+    struct node node;
 
     if ( size < MINIMUM_LENGTH ) {
         errno = EINVAL;
@@ -278,11 +501,20 @@ char * node_format ( void * self, char * buffer, unsigned int size )
 
     assert ( sizeof ( formatter ) / sizeof ( *formatter ) == NODE_COUNT );
 
+    /* The formatters read the node, so one is rebuilt from the columns */
+    node.type = node_kind_type ( kind );
+
+    if ( node.type == NODE_OPERATOR )
+        node.op = node_kind_op ( kind );
+    else if ( node.type == NODE_VARIABLE )
+        node.slot = datum.slot;
+    else
+        node.value = datum.value;
+
     /* The formatters will always add a NULL-terminator; if it had intended
      * to overwrite the available string space, then the output will be
      * truncated, so we add a three-character marker to indicate as such. */
-    if ( formatter [ ( ( struct node * ) self )->type ]
-            ( self, buffer, size ) >= size ) {
+    if ( formatter [ node.type ] ( &node, buffer, size ) >= size ) {
         buffer [ size - 2 ] = '.';
         buffer [ size - 3 ] = '.';
         buffer [ size - 4 ] = '.';
@@ -291,12 +523,14 @@ char * node_format ( void * self, char * buffer, unsigned int size )
     return buffer;
 }
 
-const char * node_encode ( struct node * self, const char * str )
+const char * node_encode ( struct node * self, const char * str,
+        const char * const * names, unsigned int name_count )
 {
     self->type = NODE_UNKNOWN;
 
     /* We first try to match for trivial single-character cases. In the
-     * current situation, this covers everything except literals. */
+     * current situation, this covers everything except literals and
+     * identifiers. */
     switch ( *str ) {
 
         /* Parentheses */
@@ -319,25 +553,133 @@ const char * node_encode ( struct node * self, const char * str )
         case '+': str += encode_opr ( self, NODE_OP_ADD      ); break;
         case '-': str += encode_opr ( self, NODE_OP_SUBTRACT ); break;
 
-        /* Anything else, likely a literal */
-        default:  str += encode_lit ( self, str );
+        /* Anything else, likely a literal or an identifier */
+        default:
+            if ( isalpha ( ( unsigned char ) *str ) || *str == '_' )
+                str += encode_var ( self, str, names, name_count );
+            else
+                str += encode_lit ( self, str );
     }
 
     return str;
 }
 
-struct node * pool_pull_node ( struct node_pool ** self,
-        unsigned int * pool_idx, unsigned int pool_count )
+_Static_assert ( NODE_COUNT <= 1U << NODE_TOKEN_TYPE_BITS,
+    "The type of a node must fit within the type bits of a token" );
+_Static_assert ( sizeof ( struct node_token ) == 8,
+    "A token must be packed into eight bytes" );
+
+const char * node_tokenise ( struct node_token * self, const char * str,
+        const char * base, const char * const * names, unsigned int name_count )
 {
-    struct node * node = NULL;
+    enum node_type type = NODE_OPERATOR;
+    unsigned int datum = 0, length = 1;
 
-    /* If we could not grab a node from the current pool, look to the next
-     * one, et cetera, until we've expended all available pools. If, at any
-     * point, we successfully grab a node, then we are done. */
-    while ( ! ( node = pool_new_node ( self [ *pool_idx ] ) ) &&
-            *pool_idx++ < pool_count );
+    assert ( ( size_t ) ( str - base ) <= UINT32_MAX );
 
-    return node;
+    switch ( *str ) {
+
+        /* Parentheses */
+        case '(':
+        case '[':
+        case '{':
+            type = NODE_LPAREN;
+            break;
+
+        case ')':
+        case ']':
+        case '}':
+            type = NODE_RPAREN;
+            break;
+
+        /* Operators */
+        case '^': datum = NODE_OP_EXP;      break;
+        case '/': datum = NODE_OP_DIVIDE;   break;
+        case '*': datum = NODE_OP_MULTIPLY; break;
+        case '+': datum = NODE_OP_ADD;      break;
+        case '-': datum = NODE_OP_SUBTRACT; break;
+
+        /* Anything else, likely a literal or an identifier. A literal is
+         * only measured, and its length is kept in place of its value. */
+        default:
+            if ( isalpha ( ( unsigned char ) *str ) || *str == '_' ) {
+                type = NODE_VARIABLE;
+                length = resolve_var ( str, names, name_count, &datum );
+            } else {
+                type = NODE_LITERAL;
+                length = datum = scan_number ( str, NULL );
+            }
+    }
+
+    if ( !length || datum > TOKEN_DATUM_MAX )
+        return str;
+
+    self->offset = ( uint32_t ) ( str - base );
+    self->info = ( uint32_t ) datum << NODE_TOKEN_TYPE_BITS |
+        ( uint32_t ) type;
+
+    return str + length;
+}
+
+const char * node_tokenise_decimal ( struct node_token * self, const char * str,
+        const char * base, size_t length )
+{
+    assert ( ( size_t ) ( str - base ) <= UINT32_MAX );
+
+    if ( length > TOKEN_DATUM_MAX )
+        return str;
+
+    self->offset = ( uint32_t ) ( str - base );
+    self->info = ( uint32_t ) length << NODE_TOKEN_TYPE_BITS |
+        ( uint32_t ) NODE_LITERAL;
+
+    return str + length;
+}
+
+bool node_encode_token ( struct node * self, struct node_token token,
+        const char * base )
+{
+    const unsigned int datum = token.info >> NODE_TOKEN_TYPE_BITS;
+
+    switch ( self->type = node_token_get_type ( token ) ) {
+        case NODE_OPERATOR:
+            self->op = ( enum node_operator ) datum;
+            break;
+
+        case NODE_VARIABLE:
+            self->slot = datum;
+            break;
+
+        case NODE_LITERAL:
+            return scan_number ( base + token.offset, &self->value ) == datum;
+
+        case NODE_UNKNOWN:
+        case NODE_LPAREN:
+        case NODE_RPAREN:
+        case NODE_COUNT:
+            break;
+    }
+
+    return true;
+}
+
+node_kind_t node_get_kind ( struct node * self )
+{
+    return ( node_kind_t ) ( ( unsigned int ) self->type << NODE_KIND_OP_BITS |
+        ( ( self->type == NODE_OPERATOR ) ? ( unsigned int ) self->op : 0 ) );
+}
+
+union node_datum node_get_datum ( struct node * self )
+{
+    union node_datum datum;
+
+    if ( self->type == NODE_VARIABLE )
+        datum.slot = self->slot;
+    else
+        datum.value = ( self->type == NODE_LITERAL ) ? self->value :
+            NUMBER_ZERO;
+
+    return datum;
 }
 
 enum node_type node_get_type ( struct node * self )
@@ -345,17 +687,43 @@ enum node_type node_get_type ( struct node * self )
     return self->type;
 }
 
+unsigned int node_get_slot ( struct node * self )
+{
+    assert ( self->type == NODE_VARIABLE );
+    return self->slot;
+}
+
 enum node_operator node_op_get_type ( struct node * self )
 {
     assert ( self->type == NODE_OPERATOR );
     return self->op;
 }
 
-enum node_precedence node_test_prec ( struct node * o1, struct node * o2 )
+number_t node_get_value ( struct node * self )
 {
-    assert ( o1->type == NODE_OPERATOR && o2->type == NODE_OPERATOR );
-    enum node_operator op1 = o1->op, op2 = o2->op;
+    assert ( self->type == NODE_LITERAL );
+    return self->value;
+}
+
+number_t node_op_apply ( enum node_operator op, number_t lhs, number_t rhs )
+{
+    switch ( op ) {
+        case NODE_OP_EXP:      return number_power ( lhs, rhs );
+        case NODE_OP_DIVIDE:   return number_divide ( lhs, rhs );
+        case NODE_OP_MULTIPLY: return number_multiply ( lhs, rhs );
+        case NODE_OP_ADD:      return number_add ( lhs, rhs );
+        case NODE_OP_SUBTRACT: return number_subtract ( lhs, rhs );
+
+        case NODE_OP_UNKNOWN:
+        case NODE_OP_COUNT:
+        default:
+            return NUMBER_INVALID;
+    }
+}
 
+enum node_precedence node_test_prec ( enum node_operator op1,
+        enum node_operator op2 )
+{
     /* Rule #1: Exponentiation has the greatest precedence and is
      * right-associative. */
     if ( op1 == NODE_OP_EXP )
@@ -369,7 +737,7 @@ enum node_precedence node_test_prec ( struct node * o1, struct node * o2 )
      * to the enumerable definition, the operators' integer values are
      * listed in reverse-precedence order. */
     if ( op1 > op2 ) {
-        if ( ( op1 == NODE_OP_ADD && op2 == NODE_OP_SUBTRACT ) || (
+        if ( ( op1 == NODE_OP_SUBTRACT && op2 == NODE_OP_ADD ) || (
                 op1 == NODE_OP_MULTIPLY &&
                 op2 == NODE_OP_DIVIDE ) )
             return NODE_PREC_LASSOC;
@@ -379,9 +747,9 @@ enum node_precedence node_test_prec ( struct node * o1, struct node * o2 )
 
     /* Rule #3: The converse case of Rule #2. */
     if ( op1 < op2 ) {
-        if ( ( op2 == NODE_OP_ADD && op1 == NODE_OP_SUBTRACT ) || (
-                op1 == NODE_OP_MULTIPLY &&
-                op2 == NODE_OP_DIVIDE ) )
+        if ( ( op1 == NODE_OP_ADD && op2 == NODE_OP_SUBTRACT ) || (
+                op1 == NODE_OP_DIVIDE &&
+                op2 == NODE_OP_MULTIPLY ) )
             return NODE_PREC_LASSOC;
 
         return NODE_PREC_GREATER;
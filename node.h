@@ -1,14 +1,19 @@
 /**
  * This interface handles collections, or "pools", of nodes. These exist to
  * minimise the number of calls to the dynamic allocator, and to maintain the
- * results of such allocations in a number of compartmentalised pools that are
- * easy to free in bulk. Callers should:
+ * results of such allocations in an arena that is easy to free in bulk. A pool
+ * is a chain of blocks: when one block is exhausted, the next is allocated with
+ * double the capacity, so a pool never runs out of nodes while memory remains.
+ * The first POOL_INLINE_CAPACITY nodes are held in-line, within the pool
+ * itself, and a pool may be placed in storage provided by the caller (see
+ * 'struct pool_storage'), so that a pool that is never grown makes no calls to
+ * the dynamic allocator at all. Callers should:
  *
  *  - Create a new pool;
  *  - Pluck nodes from that pool as required;
  *  - Freely interact with these nodes with the node API;
- *  - If they cannot receive a new node, request a new pool;
- *  - Once finished, destruct all allocated pools.
+ *  - Reset the pool to reuse its blocks for the next expression, if any;
+ *  - Once finished, destruct the pool.
  *
  * This file also describes the node API, through which callers may encode and
  * decode nodes during the parsing of an arithmetic expression.
@@ -19,6 +24,11 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include <stddef.h>
+
+#include "number.h"
+#include "alloc.h"
+
 /**
  * The base opaque type of an individual node
  */
@@ -30,10 +40,9 @@ struct node;
 struct node_pool;
 
 /**
- * An alias for the literal (number) type. This must be type-compatible with
- * double.
+ * The number of nodes held in-line by every pool
  */
-typedef float number_t;
+#define POOL_INLINE_CAPACITY 8
 
 /**
  * The type of a node, indicating the type of data encoded within
@@ -44,6 +53,7 @@ enum node_type {
     NODE_LITERAL,
     NODE_LPAREN,
     NODE_RPAREN,
+    NODE_VARIABLE,
 
     NODE_COUNT
 };
@@ -62,6 +72,30 @@ enum node_operator {
     NODE_OP_COUNT
 };
 
+/**
+ * The kind of a node: its type and, for an operator, its operator, packed into
+ * a byte (see 'node_kind_type' and 'node_kind_op'). No node has the kind zero.
+ */
+typedef unsigned char node_kind_t;
+
+/**
+ * The number of low bits of a kind that hold its operator
+ */
+#define NODE_KIND_OP_BITS 4
+
+/**
+ * The datum of a node: the value of a literal, or the slot of a variable
+ */
+union node_datum {
+    number_t value;
+    unsigned int slot;
+};
+
+/**
+ * The datum of a node that has none
+ */
+#define NODE_NO_DATUM ( ( union node_datum ) { .slot = 0 } )
+
 /**
  * The result of a comparison between the precedence of two operator nodes
  */
@@ -74,61 +108,219 @@ enum node_precedence {
 };
 
 /**
- * Initialise a new node pool of a given fixed capacity.
+ * Storage, of a fixed size, in which a pool may be placed by the caller. Its
+ * contents are private to the pool.
+ */
+struct pool_storage {
+    /* The headers, with room for their padding, and then the in-line nodes,
+     * each of which is no larger than two data */
+    _Alignas ( max_align_t ) unsigned char bytes [ 7 * sizeof ( void * ) +
+        POOL_INLINE_CAPACITY * 2 * sizeof ( union node_datum ) ];
+};
+
+/**
+ * The number of low bits of the information of a token that hold its type
+ */
+#define NODE_TOKEN_TYPE_BITS 3
+
+/**
+ * A token: the type of a node, and the position of its text in the source
+ * string, packed into eight bytes. A token references its source rather than
+ * copying it, and its literal, if any, is not converted until a node is
+ * encoded from it (see 'node_encode_token'), so a stream of tokens is a small
+ * fraction of the size of the equivalent nodes. The fields are only to be
+ * interpreted by the node API.
+ */
+struct node_token {
+    /**
+     * The offset of the text of the token from the beginning of its source
+     */
+    uint32_t offset;
+
+    /**
+     * The type of the token in the low NODE_TOKEN_TYPE_BITS bits, and above
+     * them its operator, its variable slot, or the length of its literal
+     */
+    uint32_t info;
+};
+
+/**
+ * Initialise a new node pool with a given initial capacity.
  *
- * @param capacity the fixed capacity of the node pool. If this is zero, a
- *    sensible default is assumed.
+ * @param capacity the capacity of the first block of the node pool. If this is
+ *    zero, a sensible default is assumed.
+ * @param allocator the allocator of the pool, or NULL for the standard
+ *    allocator (see 'alloc.h'); it must outlive the pool
  * @return the address of the new pool
  */
-struct node_pool * pool_initialise ( unsigned int capacity );
+struct node_pool * pool_initialise ( unsigned int capacity,
+    const struct allocator * allocator );
+
+/**
+ * Initialise a new node pool with a given initial capacity, within the given
+ * storage. The pool only calls the dynamic allocator if its capacity exceeds
+ * POOL_INLINE_CAPACITY, so this cannot fail for a lesser capacity.
+ *
+ * @param storage the storage, which must outlive the pool
+ * @param capacity the capacity of the first block of the node pool. If this is
+ *    no greater than POOL_INLINE_CAPACITY, the in-line nodes form the first
+ *    block.
+ * @param allocator the allocator of any blocks beyond the storage, or NULL for
+ *    the standard allocator; it must outlive the pool
+ * @return the address of the new pool, or NULL on failure
+ */
+struct node_pool * pool_initialise_in ( struct pool_storage * storage,
+    unsigned int capacity, const struct allocator * allocator );
 
 /**
- * Destruct an entire node pool, including its data. 
+ * Destruct an entire node pool, including all of its blocks and their data. The
+ * storage of a pool initialised with 'pool_initialise_in' is not freed, but any
+ * blocks allocated beyond it are.
  *
  * @param self the node pool to be destroyed
  */
 void pool_destruct ( struct node_pool * self );
 
 /**
- * Grab a new node from the pool and return its address.
+ * Return every node to the pool in constant time. The blocks of the pool are
+ * retained, and refilled in order, so nodes taken after a reset do not call the
+ * dynamic allocator until the previous high-water mark is exceeded. Nodes taken
+ * before the reset must no longer be used.
+ *
+ * @param self the node pool
+ */
+void pool_reset ( struct node_pool * self );
+
+/**
+ * Grab a new node from the pool and return its address, growing the pool if
+ * necessary.
  *
  * @param self the target pool
- * @return the address of the node. If no node is available, NULL is returned.
+ * @return the address of the node. If the pool could not be grown, NULL is
+ *    returned.
  */
 struct node * pool_new_node ( struct node_pool * self );
 
 /**
- * Format a node into a human-readable form, and place the results in the given
- * buffer.
+ * Format a node, given by its kind and datum, into a human-readable form, and
+ * place the results in the given buffer.
  *
- * @param self the node
+ * @param kind the kind of the node
+ * @param datum the datum of the node
  * @param buffer the destination buffer
  * @param size the capacity of the given buffer
  * @return the populated buffer, or NULL if the given buffer was unreasonably
  *    small
  */
-char * node_format ( void * self, char * buffer, unsigned int size );
+char * node_format ( node_kind_t kind, union node_datum datum, char * buffer,
+    unsigned int size );
 
 /**
  * Encode a string, up until a natural delimiter, into a node, while setting the
- * metadata accordingly.
+ * metadata accordingly. Identifiers are resolved against the given list of
+ * variable names, and are encoded by their position (slot) in that list.
  *
  * @param self the node
  * @param str the string to be parsed
+ * @param names the list of variable names, or NULL if there are none
+ * @param name_count the number of given variable names
  * @return the destination of the new read head
  */
-const char * node_encode ( struct node * self, const char * str );
+const char * node_encode ( struct node * self, const char * str,
+    const char * const * names, unsigned int name_count );
 
 /**
- * Grab the next available node from the provided pools.
+ * Scan a string, up until a natural delimiter, into a token, as 'node_encode'
+ * would into a node. Literals are measured, but neither converted nor checked
+ * for range.
  *
- * @param self the list of available node pools
- * @param pool_idx the current position in the node pool list
- * @param pool_count the number of available given pools
- * @return the requested node, or NULL if no such node is available
+ * @param self the token
+ * @param str the string to be scanned
+ * @param base the beginning of the source, within UINT32_MAX bytes of 'str'
+ * @param names the list of variable names, or NULL if there are none
+ * @param name_count the number of given variable names
+ * @return the destination of the new read head, which is 'str' if the string
+ *      does not begin with a token
  */
-struct node * pool_pull_node ( struct node_pool ** self,
-    unsigned int * pool_idx, unsigned int pool_count );
+const char * node_tokenise ( struct node_token * self, const char * str,
+    const char * base, const char * const * names, unsigned int name_count );
+
+/**
+ * Scan a plain decimal literal of a known length into a token, as
+ * 'node_tokenise' would. The length must have been measured by the caller, and
+ * must span the whole literal.
+ *
+ * @param self the token
+ * @param str the string whose head begins the literal
+ * @param base the beginning of the source, within UINT32_MAX bytes of 'str'
+ * @param length the length of the literal
+ * @return the destination of the new read head, which is 'str' if the literal
+ *      is too long to be measured in a token
+ */
+const char * node_tokenise_decimal ( struct node_token * self, const char * str,
+    const char * base, size_t length );
+
+/**
+ * Encode a token into a node, converting its literal, if any.
+ *
+ * @param self the node
+ * @param token the token
+ * @param base the beginning of the source of the token
+ * @return true on success, or false if the literal is out of range
+ */
+bool node_encode_token ( struct node * self, struct node_token token,
+    const char * base );
+
+/**
+ * Retrieves the type of the given token
+ *
+ * @param token the token
+ * @return the type of the node that the token encodes
+ */
+static inline enum node_type node_token_get_type ( struct node_token token )
+{
+    return ( enum node_type ) ( token.info &
+        ( ( 1U << NODE_TOKEN_TYPE_BITS ) - 1 ) );
+}
+
+/**
+ * Retrieves the kind of the given node
+ *
+ * @param self the node
+ * @return the kind of the node
+ */
+node_kind_t node_get_kind ( struct node * self );
+
+/**
+ * Retrieves the datum of the given node
+ *
+ * @param self the node
+ * @return the datum of the node, which is unspecified if it has none
+ */
+union node_datum node_get_datum ( struct node * self );
+
+/**
+ * Retrieves the type of a node from its kind
+ *
+ * @param kind the kind
+ * @return the type of the node
+ */
+static inline enum node_type node_kind_type ( node_kind_t kind )
+{
+    return ( enum node_type ) ( kind >> NODE_KIND_OP_BITS );
+}
+
+/**
+ * Retrieves the operator of an operator node from its kind
+ *
+ * @param kind the kind
+ * @return the nature of the operator
+ */
+static inline enum node_operator node_kind_op ( node_kind_t kind )
+{
+    return ( enum node_operator ) ( kind &
+        ( ( 1U << NODE_KIND_OP_BITS ) - 1 ) );
+}
 
 /**
  * Retrieves the type of the given node
@@ -147,14 +339,41 @@ enum node_type node_get_type ( struct node * self );
 enum node_operator node_op_get_type ( struct node * self );
 
 /**
- * Determines the precedence relationship between two given operator nodes
+ * Retrieves the value of the given literal node
+ *
+ * @param self the node containing a literal
+ * @return the encoded number
+ */
+number_t node_get_value ( struct node * self );
+
+/**
+ * Retrieves the slot index of the given variable node
+ *
+ * @param self the node containing a variable
+ * @return the position of the variable in the list of names given at encoding
+ */
+unsigned int node_get_slot ( struct node * self );
+
+/**
+ * Apply an arithmetic operator to a pair of operands.
+ *
+ * @param op the operator
+ * @param lhs the left-hand operand
+ * @param rhs the right-hand operand
+ * @return the result of the operation, or NaN if the operator is unknown
+ */
+number_t node_op_apply ( enum node_operator op, number_t lhs, number_t rhs );
+
+/**
+ * Determines the precedence relationship between two given operators
  *
- * @param o1 the first operator node
- * @param o2 the second operator node
+ * @param op1 the first operator
+ * @param op2 the second operator
  * @return the precedence of the first operator in relation to the precedence of
  *      the second one
  */
-enum node_precedence node_test_prec ( struct node * o1, struct node * o2 );
+enum node_precedence node_test_prec ( enum node_operator op1,
+    enum node_operator op2 );
 
 #endif /* NODE_H */
 
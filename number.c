@@ -0,0 +1,79 @@
+/**
+ * Implement the number interface; see 'number.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <float.h>
+
+#include "number.h"
+
+#if defined NUMBER_FIXED
+
+/**
+ * The number of decimal digits in which the fractional part is formatted,
+ * which distinguishes any two fractions
+ */
+#define NUMBER_FRACTION_DIGITS 10
+
+/**
+ * Ten to the power of NUMBER_FRACTION_DIGITS
+ */
+#define NUMBER_FRACTION_SCALE UINT64_C ( 10000000000 )
+
+unsigned int number_format ( char * buffer, size_t size, number_t value )
+{
+    const uint64_t magnitude = ( value < 0 ) ? 0 - ( uint64_t ) value :
+        ( uint64_t ) value;
+    uint64_t whole = magnitude >> NUMBER_FRACTION_BITS, fraction;
+    unsigned int digits = NUMBER_FRACTION_DIGITS;
+    int retval;
+
+    /* The fraction, rounded to the nearest decimal digit, may carry into the
+     * whole part */
+    fraction = ( uint64_t ) ( ( ( number_double_width_t ) ( magnitude &
+        ( ( UINT64_C ( 1 ) << NUMBER_FRACTION_BITS ) - 1 ) ) *
+        NUMBER_FRACTION_SCALE + ( NUMBER_ONE >> 1 ) ) >> NUMBER_FRACTION_BITS );
+
+    if ( fraction == NUMBER_FRACTION_SCALE ) {
+        whole++;
+        fraction = 0;
+    }
+
+    /* Trailing zeros are not significant */
+    for ( ; digits && fraction % 10 == 0; digits-- )
+        fraction /= 10;
+
+    if ( value == NUMBER_INVALID )
+        retval = snprintf ( buffer, size, "nan" );
+
+    else if ( digits )
+        retval = snprintf ( buffer, size, "%s%llu.%0*llu",
+            ( value < 0 ) ? "-" : "", ( unsigned long long ) whole,
+            ( int ) digits, ( unsigned long long ) fraction );
+
+    else
+        retval = snprintf ( buffer, size, "%s%llu",
+            ( value < 0 && whole ) ? "-" : "", ( unsigned long long ) whole );
+
+    return ( retval < 0 ) ? 0 : ( unsigned int ) retval;
+}
+
+#else
+
+unsigned int number_format ( char * buffer, size_t size, number_t value )
+{
+    /* As many digits as survive a round trip through the type, which for the
+     * float is exactly the six digits of "%g" */
+#if defined NUMBER_DOUBLE
+    int retval = snprintf ( buffer, size, "%.*g", DBL_DIG, value );
+#else
+    int retval = snprintf ( buffer, size, "%.*g", FLT_DIG, ( double ) value );
+#endif
+
+    return ( retval < 0 ) ? 0 : ( unsigned int ) retval;
+}
+
+#endif /* NUMBER_FIXED */
@@ -0,0 +1,374 @@
+/**
+ * This interface defines the numeric type in which every expression is
+ * evaluated, and its arithmetic. The type is chosen when building, by defining
+ * at most one of the following macros:
+ *
+ *  - (neither): IEEE-754 single precision, the default;
+ *
+ *  - NUMBER_DOUBLE: IEEE-754 double precision; or
+ *
+ *  - NUMBER_FIXED: signed fixed point, with NUMBER_FRACTION_BITS fractional
+ *    bits in a 64-bit integer. Every operation rounds to nearest and saturates
+ *    at the greatest magnitude, and results that have no value (such as 0 / 0,
+ *    or a negative number raised to a fractional power) are NUMBER_INVALID,
+ *    which then propagates as a NaN does.
+ *
+ * Every evaluator, every kernel, and constant folding apply the operators
+ * through the functions below, so all of them agree bit-for-bit whatever the
+ * type. Each type is built separately (see the Makefile), so that none pays at
+ * run-time for the others.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#if defined NUMBER_DOUBLE && defined NUMBER_FIXED
+#    error "At most one of NUMBER_DOUBLE and NUMBER_FIXED may be defined"
+#endif
+
+/**
+ * The greatest length of a formatted number (see 'number_format'), including
+ * the terminator
+ */
+#define NUMBER_FORMAT_SIZE 32
+
+#if defined NUMBER_FIXED
+
+#ifndef __SIZEOF_INT128__
+#    error "Fixed-point numbers require a 128-bit integer type"
+#endif
+
+/**
+ * An alias for the literal (number) type
+ */
+typedef int64_t number_t;
+
+/**
+ * A floating type wider than the number type, in which products are
+ * accumulated before being rounded once
+ */
+typedef double number_wide_t;
+
+/**
+ * The integer type of twice the width, in which products and quotients are
+ * computed exactly
+ */
+__extension__ typedef __int128 number_double_width_t;
+
+/**
+ * The name of the number type
+ */
+#define NUMBER_NAME "fixed"
+
+/**
+ * The number of fractional bits
+ */
+#define NUMBER_FRACTION_BITS 32
+
+/**
+ * The numbers zero, negative zero (which is zero), and one
+ */
+#define NUMBER_ZERO          ( ( number_t ) 0 )
+#define NUMBER_NEGATIVE_ZERO ( ( number_t ) 0 )
+#define NUMBER_ONE           ( ( number_t ) 1 << NUMBER_FRACTION_BITS )
+
+/**
+ * The result of an operation that has no value, and the greatest magnitude;
+ * the invalid number is never the result of saturation
+ */
+#define NUMBER_INVALID INT64_MIN
+#define NUMBER_MAX     INT64_MAX
+
+/**
+ * Round a double-width value to the number type, saturating.
+ *
+ * @param value the value
+ * @return the saturated value
+ */
+static inline number_t number_saturate ( number_double_width_t value )
+{
+    return ( value > NUMBER_MAX ) ? NUMBER_MAX : ( value < -NUMBER_MAX ) ?
+        -NUMBER_MAX : ( number_t ) value;
+}
+
+/**
+ * Divide double-width values, rounding to nearest with ties away from zero.
+ *
+ * @param n the dividend
+ * @param d the divisor, which is not zero
+ * @return the rounded quotient
+ */
+static inline number_double_width_t number_round_div ( number_double_width_t n,
+        number_double_width_t d )
+{
+    const number_double_width_t q = n / d, r = n % d;
+
+    if ( 2 * ( r < 0 ? -r : r ) >= ( d < 0 ? -d : d ) )
+        return ( ( n < 0 ) != ( d < 0 ) ) ? q - 1 : q + 1;
+
+    return q;
+}
+
+/**
+ * Convert a double to the number type, rounding to nearest and saturating.
+ *
+ * @param value the double
+ * @return the number, or NUMBER_INVALID if the double is a NaN
+ */
+static inline number_t number_from_double ( double value )
+{
+    const double scaled = ldexp ( value, NUMBER_FRACTION_BITS );
+
+    if ( isnan ( value ) )
+        return NUMBER_INVALID;
+
+    if ( scaled >= ( double ) NUMBER_MAX )
+        return NUMBER_MAX;
+
+    if ( scaled <= ( double ) -NUMBER_MAX )
+        return -NUMBER_MAX;
+
+    return ( number_t ) llround ( scaled );
+}
+
+/**
+ * Convert a number to a double, which is rounded if the number has more
+ * significant bits than the double.
+ *
+ * @param value the number
+ * @return the double, or a NaN if the number is invalid
+ */
+static inline double number_to_double ( number_t value )
+{
+    return ( value == NUMBER_INVALID ) ? ( double ) NAN :
+        ldexp ( ( double ) value, -NUMBER_FRACTION_BITS );
+}
+
+/**
+ * Determine whether a number has no value.
+ *
+ * @param value the number
+ * @return true if the number is invalid, or false
+ */
+static inline bool number_is_invalid ( number_t value )
+{
+    return value == NUMBER_INVALID;
+}
+
+/**
+ * Apply an arithmetic operator.
+ *
+ * @param lhs the left-hand operand
+ * @param rhs the right-hand operand
+ * @return the result
+ */
+static inline number_t number_add ( number_t lhs, number_t rhs )
+{
+    if ( lhs == NUMBER_INVALID || rhs == NUMBER_INVALID )
+        return NUMBER_INVALID;
+
+    return number_saturate ( ( number_double_width_t ) lhs + rhs );
+}
+
+static inline number_t number_subtract ( number_t lhs, number_t rhs )
+{
+    if ( lhs == NUMBER_INVALID || rhs == NUMBER_INVALID )
+        return NUMBER_INVALID;
+
+    return number_saturate ( ( number_double_width_t ) lhs - rhs );
+}
+
+static inline number_t number_multiply ( number_t lhs, number_t rhs )
+{
+    if ( lhs == NUMBER_INVALID || rhs == NUMBER_INVALID )
+        return NUMBER_INVALID;
+
+    /* The shift rounds half-way products upwards */
+    return number_saturate ( ( ( number_double_width_t ) lhs * rhs +
+        ( NUMBER_ONE >> 1 ) ) >> NUMBER_FRACTION_BITS );
+}
+
+static inline number_t number_divide ( number_t lhs, number_t rhs )
+{
+    if ( lhs == NUMBER_INVALID || rhs == NUMBER_INVALID ||
+            ( !lhs && !rhs ) )
+        return NUMBER_INVALID;
+
+    /* Division by zero saturates, as an infinity would */
+    if ( !rhs )
+        return ( lhs > 0 ) ? NUMBER_MAX : -NUMBER_MAX;
+
+    return number_saturate ( number_round_div ( ( number_double_width_t ) lhs *
+        NUMBER_ONE, rhs ) );
+}
+
+static inline number_t number_power ( number_t lhs, number_t rhs )
+{
+    /* As for pow(3), anything to the power of zero, and one to the power of
+     * anything, is one; and anything to the power of one is exact */
+    if ( !rhs || lhs == NUMBER_ONE )
+        return NUMBER_ONE;
+
+    if ( lhs == NUMBER_INVALID || rhs == NUMBER_INVALID )
+        return NUMBER_INVALID;
+
+    if ( rhs == NUMBER_ONE )
+        return lhs;
+
+    return number_from_double ( pow ( number_to_double ( lhs ),
+        number_to_double ( rhs ) ) );
+}
+
+/**
+ * Widen a number to the wide type, and narrow it back.
+ *
+ * @param value the number
+ * @return the widened or narrowed number
+ */
+static inline number_wide_t number_widen ( number_t value )
+{
+    return number_to_double ( value );
+}
+
+static inline number_t number_narrow ( number_wide_t value )
+{
+    return number_from_double ( value );
+}
+
+#else
+
+#if defined NUMBER_DOUBLE
+
+/**
+ * An alias for the literal (number) type
+ */
+typedef double number_t;
+
+/**
+ * A floating type wider than the number type, in which products are
+ * accumulated before being rounded once
+ */
+typedef long double number_wide_t;
+
+/**
+ * The name of the number type
+ */
+#define NUMBER_NAME "double"
+
+/**
+ * The power function of the number type
+ */
+#define NUMBER_POW pow
+
+#else
+
+/**
+ * An alias for the literal (number) type
+ */
+typedef float number_t;
+
+/**
+ * A floating type wider than the number type, in which products are
+ * accumulated before being rounded once
+ */
+typedef double number_wide_t;
+
+/**
+ * The name of the number type
+ */
+#define NUMBER_NAME "float"
+
+/**
+ * The power function of the number type
+ */
+#define NUMBER_POW powf
+
+#endif
+
+/**
+ * The numbers zero, negative zero, and one
+ */
+#define NUMBER_ZERO          ( ( number_t ) 0 )
+#define NUMBER_NEGATIVE_ZERO ( -NUMBER_ZERO )
+#define NUMBER_ONE           ( ( number_t ) 1 )
+
+/**
+ * The result of an operation that has no value
+ */
+#define NUMBER_INVALID ( ( number_t ) NAN )
+
+/* The functions below are as described for fixed point, above, in floating
+ * point, where they are exactly the operators of C */
+
+static inline number_t number_from_double ( double value )
+{
+    return ( number_t ) value;
+}
+
+static inline double number_to_double ( number_t value )
+{
+    return ( double ) value;
+}
+
+static inline bool number_is_invalid ( number_t value )
+{
+    return isnan ( value );
+}
+
+static inline number_t number_add ( number_t lhs, number_t rhs )
+{
+    return lhs + rhs;
+}
+
+static inline number_t number_subtract ( number_t lhs, number_t rhs )
+{
+    return lhs - rhs;
+}
+
+static inline number_t number_multiply ( number_t lhs, number_t rhs )
+{
+    return lhs * rhs;
+}
+
+static inline number_t number_divide ( number_t lhs, number_t rhs )
+{
+    return lhs / rhs;
+}
+
+static inline number_t number_power ( number_t lhs, number_t rhs )
+{
+    return NUMBER_POW ( lhs, rhs );
+}
+
+static inline number_wide_t number_widen ( number_t value )
+{
+    return ( number_wide_t ) value;
+}
+
+static inline number_t number_narrow ( number_wide_t value )
+{
+    return ( number_t ) value;
+}
+
+#endif /* NUMBER_FIXED */
+
+/**
+ * Format a number as decimal text, with as many significant digits as the type
+ * guarantees to preserve, as by snprintf(3).
+ *
+ * @param buffer the destination string buffer
+ * @param size the capacity of the destination
+ * @param value the number
+ * @return the length of the formatted number, excluding the terminator, or
+ *      zero on failure
+ */
+unsigned int number_format ( char * buffer, size_t size, number_t value );
+
+#endif /* NUMBER_H */
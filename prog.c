@@ -0,0 +1,2426 @@
+/**
+ * Implement the compiled program interface; see 'prog.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "node.h"
+#include "stack.h"
+#include "kernel.h"
+#include "jit.h"
+#include "debug.h"
+#include "stats.h"
+
+#include "prog.h"
+
+/**
+ * The maximum value-stack depth for which evaluation scratch space is taken
+ * from the machine stack; deeper programs fall back to the dynamic allocator.
+ */
+#define PROGRAM_LOCAL_DEPTH 256
+
+/**
+ * The number of rows evaluated together by the batch evaluator. Each
+ * instruction is dispatched once per block, and then applied to every row in
+ * that block.
+ */
+#define PROGRAM_BLOCK 256
+
+/**
+ * The greatest magnitude of an integral exponent that is strength-reduced to a
+ * chain of multiplications; greater exponents are left to powf(3).
+ */
+#define PROGRAM_POWI_MAX 65536
+
+/**
+ * The number of registers in the register file of the register engine. Values
+ * that cannot be held in a register are spilled to the frame.
+ */
+#define PROGRAM_REGISTERS 16U
+
+/**
+ * The number of evaluations of a program selected for the native engine after
+ * which it is assembled into native code; until then, it is interpreted by the
+ * register engine.
+ */
+#define PROGRAM_JIT_THRESHOLD 1000UL
+
+/**
+ * The number of independent accumulators among which the terms of a reduction
+ * are interleaved
+ */
+#define PROGRAM_LANES 8U
+
+/**
+ * The least number of terms of a chain of additions or of multiplications for
+ * it to be reassociated
+ */
+#define PROGRAM_CHAIN_MIN 16U
+
+/**
+ * The greatest number of operands of a single reduction instruction; longer
+ * chains are reduced in runs, so that the value stack stays shallow
+ */
+#define PROGRAM_REDUCE_MAX 64U
+
+/**
+ * The flag that marks a virtual register, rather than a frame cell, in the
+ * operands of register instructions under translation
+ */
+#define PROGRAM_VIRTUAL 0x80000000U
+
+/**
+ * The marker of a DAG node that holds no temporary, or of an empty slot in the
+ * hash table of DAG nodes
+ */
+#define PROGRAM_NONE UINT_MAX
+
+/**
+ * The operation encoded by an individual instruction. Operands, which push one
+ * value, precede the instructions that replace or copy the topmost value, the
+ * binary operators, which pop two values and push one, and the reductions,
+ * which pop any number of values and push one.
+ */
+enum prog_opcode {
+    PROG_OP_LITERAL,
+    PROG_OP_VARIABLE,
+    PROG_OP_TEMP,
+    PROG_OP_POWI,
+    PROG_OP_STORE,
+    PROG_OP_EXP,
+    PROG_OP_DIVIDE,
+    PROG_OP_MULTIPLY,
+    PROG_OP_ADD,
+    PROG_OP_SUBTRACT,
+    PROG_OP_SUM,
+    PROG_OP_PRODUCT,
+
+    PROG_OP_COUNT
+};
+
+/**
+ * An individual instruction. Literals and variable slots are held inline, so
+ * the instruction stream is the only data that evaluation needs to touch,
+ * besides the variables themselves.
+ */
+struct instruction {
+    /**
+     * The operation, from the 'prog_opcode' enumeration
+     */
+    unsigned char opcode;
+
+    /**
+     * The operand of the instruction, where applicable
+     */
+    union {
+        number_t value;     /* PROG_OP_LITERAL              */
+        unsigned int slot;  /* PROG_OP_VARIABLE             */
+        unsigned int temp;  /* PROG_OP_TEMP, PROG_OP_STORE  */
+        int exponent;       /* PROG_OP_POWI                 */
+        unsigned int count; /* PROG_OP_SUM, PROG_OP_PRODUCT */
+    };
+};
+
+/**
+ * A node of the expression DAG built by common-subexpression elimination
+ */
+struct dag_node {
+    /**
+     * The instruction that computes the node from its children, if any
+     */
+    struct instruction ins;
+
+    /**
+     * The left-hand (or only) child and the right-hand child, where applicable
+     */
+    unsigned int lhs, rhs;
+
+    /**
+     * The number of references to the node, from its parents and the root
+     */
+    unsigned int uses;
+
+    /**
+     * The temporary holding the value of the node once it has been computed,
+     * or PROGRAM_NONE
+     */
+    unsigned int temp;
+};
+
+/**
+ * The live interval of a virtual register, during translation for the register
+ * engine
+ */
+struct interval {
+    /**
+     * The index of the instruction that defines the value
+     */
+    unsigned int start;
+
+    /**
+     * The index of the instruction that consumes the value
+     */
+    unsigned int end;
+
+    /**
+     * The cell allocated to the value, or PROGRAM_NONE
+     */
+    unsigned int cell;
+};
+
+/**
+ * A three-address instruction of the register engine. Every operand is a cell
+ * of the frame (see the notes on the register engine), so each instruction is
+ * decoded once, and then reads and writes the frame directly.
+ */
+struct reg_instruction {
+    /**
+     * The operation, either PROG_OP_POWI or a binary operator
+     */
+    unsigned char opcode;
+
+    /**
+     * The exponent, for PROG_OP_POWI
+     */
+    int exponent;
+
+    /**
+     * The destination cell, and the left-hand (or only) and right-hand source
+     * cells
+     */
+    unsigned int dst, lhs, rhs;
+};
+
+/**
+ * The translation of a program for the register engine
+ */
+struct reg_code {
+    /**
+     * The number of instructions
+     */
+    unsigned int length;
+
+    /**
+     * The number of cells in the frame
+     */
+    unsigned int frame;
+
+    /**
+     * The number of distinct literals, which occupy the cells following the
+     * registers
+     */
+    unsigned int constants;
+
+    /**
+     * The first cell of the variables, which follow the literals
+     */
+    unsigned int variables;
+
+    /**
+     * The cell that holds the result once every instruction has executed
+     */
+    unsigned int result;
+
+    /**
+     * The values of the literals, allocated in-line after the instructions
+     */
+    number_t * pool;
+
+    /**
+     * The instruction stream, allocated in-line
+     */
+    struct reg_instruction code [ ];
+};
+
+/**
+ * The state of the native engine of a program, which is shared by every thread
+ * that evaluates the program
+ */
+struct native {
+    /**
+     * The number of evaluations so far, which stops counting once it reaches
+     * PROGRAM_JIT_THRESHOLD
+     */
+    atomic_ulong evaluations;
+
+    /**
+     * The native function, or NULL until it has been assembled
+     */
+    _Atomic ( jit_function ) function;
+
+    /**
+     * The size of the mapping of the native function, which is written before
+     * the function is published
+     */
+    size_t size;
+};
+
+/**
+ * The transparent program
+ */
+struct program {
+    /**
+     * The number of instructions
+     */
+    unsigned int length;
+
+    /**
+     * The greatest number of values simultaneously held by the value stack
+     * during evaluation
+     */
+    unsigned int depth;
+
+    /**
+     * The number of variable slots referenced by the program; this is one
+     * greater than the greatest referenced slot
+     */
+    unsigned int slots;
+
+    /**
+     * The number of temporaries, which hold values that are used more than once
+     */
+    unsigned int temps;
+
+    /**
+     * The number of nodes removed by common-subexpression elimination
+     */
+    unsigned int eliminated;
+
+    /**
+     * The order in which reductions combine their terms
+     */
+    enum prog_reduction reduction;
+
+    /**
+     * The translation for the register engine, which the native engine also
+     * interprets and assembles, or NULL if the stack engine is selected
+     */
+    struct reg_code * regs;
+
+    /**
+     * The state of the native engine, or NULL if it is not selected
+     */
+    struct native * native;
+
+    /**
+     * The instruction stream, allocated in-line with the program
+     */
+    struct instruction code [ ];
+};
+
+/**
+ * Translate a node operator into its equivalent opcode.
+ *
+ * @param op the node operator
+ * @return the opcode, or PROG_OP_COUNT if the operator is unknown
+ */
+static enum prog_opcode opcode_of ( enum node_operator op )
+{
+    switch ( op ) {
+        case NODE_OP_EXP:      return PROG_OP_EXP;
+        case NODE_OP_DIVIDE:   return PROG_OP_DIVIDE;
+        case NODE_OP_MULTIPLY: return PROG_OP_MULTIPLY;
+        case NODE_OP_ADD:      return PROG_OP_ADD;
+        case NODE_OP_SUBTRACT: return PROG_OP_SUBTRACT;
+
+        case NODE_OP_UNKNOWN:
+        case NODE_OP_COUNT:
+        default:
+            return PROG_OP_COUNT;
+    }
+}
+
+/**
+ * Translate a binary opcode into its equivalent node operator.
+ *
+ * @param op the opcode
+ * @return the node operator, or NODE_OP_UNKNOWN if the opcode is not that of a
+ *      binary operator
+ */
+static enum node_operator node_operator_of ( enum prog_opcode op )
+{
+    switch ( op ) {
+        case PROG_OP_EXP:      return NODE_OP_EXP;
+        case PROG_OP_DIVIDE:   return NODE_OP_DIVIDE;
+        case PROG_OP_MULTIPLY: return NODE_OP_MULTIPLY;
+        case PROG_OP_ADD:      return NODE_OP_ADD;
+        case PROG_OP_SUBTRACT: return NODE_OP_SUBTRACT;
+
+        case PROG_OP_LITERAL:
+        case PROG_OP_VARIABLE:
+        case PROG_OP_TEMP:
+        case PROG_OP_POWI:
+        case PROG_OP_STORE:
+        case PROG_OP_SUM:
+        case PROG_OP_PRODUCT:
+        case PROG_OP_COUNT:
+        default:
+            return NODE_OP_UNKNOWN;
+    }
+}
+
+/**
+ * Recompute the value-stack depth, the number of variable slots, and the number
+ * of temporaries of a valid program, after its instructions have been
+ * rewritten.
+ *
+ * @param self the program
+ */
+static void measure ( struct program * self )
+{
+    const struct instruction * ins;
+    unsigned int depth = 0;
+
+    self->depth = self->slots = self->temps = 0;
+
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        ins = & ( self->code [ i ] );
+
+        if ( ins->opcode == PROG_OP_VARIABLE && ins->slot >= self->slots )
+            self->slots = ins->slot + 1;
+
+        if ( ins->opcode == PROG_OP_STORE && ins->temp >= self->temps )
+            self->temps = ins->temp + 1;
+
+        /* Operands push one value; binary operators pop two, and push one;
+         * reductions pop as many as they count, and push one */
+        if ( ins->opcode <= PROG_OP_TEMP ) {
+            if ( ++depth > self->depth )
+                self->depth = depth;
+        } else if ( ins->opcode >= PROG_OP_SUM )
+            depth -= ins->count - 1;
+        else if ( ins->opcode > PROG_OP_STORE )
+            depth--;
+    }
+}
+
+/**
+ * Raise a number to an integral power by repeated squaring. The product is
+ * accumulated in the wide type (see 'number.h'), which for floats holds the
+ * square of any float exactly, and is rounded once at the end.
+ *
+ * @param base the base
+ * @param exponent the exponent
+ * @return the power
+ */
+static inline number_t powi ( number_t base, int exponent )
+{
+    unsigned int n = ( exponent < 0 ) ? 0U - ( unsigned int ) exponent :
+        ( unsigned int ) exponent;
+    number_wide_t b = number_widen ( base ), result = 1;
+
+    for ( ; n; n >>= 1 ) {
+        if ( n & 1 )
+            result *= b;
+        b *= b;
+    }
+
+    return number_narrow ( ( exponent < 0 ) ? 1 / result : result );
+}
+
+/* NOTES ON SIMPLIFICATION
+ *
+ * The folding pass walks the instruction stream once, keeping a stack of the
+ * position at which each operand begins, so that the operands of every
+ * operator are known to be contiguous runs of instructions. An operator whose
+ * operands are both single literals is replaced by its result; since folding
+ * applies exactly the same single-precision operation as the evaluator would,
+ * the folded value is identical. Folding proceeds bottom-up, so a constant
+ * subtree of any depth collapses to one literal.
+ *
+ * The remaining rewrites are identities that hold bit-for-bit for every
+ * operand, including infinities, NaNs, and signed zeroes:
+ *
+ *  - x * 1, 1 * x, x / 1, and x ^ 1 are x;
+ *  - x - 0 is x, but x + 0 is not, since -0 + 0 is +0; x + -0 and -0 + x are x;
+ *  - x ^ 0 and 1 ^ x are 1, even for a NaN x (see pow(3)).
+ *
+ * Rewrites such as x * 0 or x - x are not made, since they fail for NaNs and
+ * infinities. Nor is x ^ 2 rewritten as x * x: the product is correctly
+ * rounded, but powf(3) is not, and the two disagree whenever the exact square
+ * lies half-way between two floats. Literals are compared by their bits, so
+ * that -0 is never taken for +0. The same identities hold in fixed point,
+ * where -0 is 0, and the invalid number behaves as a NaN.
+ */
+
+/**
+ * Is the given instruction a literal with exactly the given value?
+ *
+ * @param ins the instruction
+ * @param value the value
+ * @return whether the instruction pushes the value
+ */
+static bool is_literal ( const struct instruction * ins, number_t value )
+{
+    return ins->opcode == PROG_OP_LITERAL &&
+        !memcmp ( &ins->value, &value, sizeof ( number_t ) );
+}
+
+/**
+ * Simplify the operator at the end of a run of instructions, whose operands
+ * begin at the given positions.
+ *
+ * @param code the instructions
+ * @param lhs the position of the first instruction of the left-hand operand
+ * @param rhs the position of the first instruction of the right-hand operand
+ * @param end one past the position of the operator
+ * @return one past the position of the last instruction of the simplified run,
+ *      which still begins at 'lhs'
+ */
+static unsigned int simplify ( struct instruction * code, unsigned int lhs,
+        unsigned int rhs, unsigned int end )
+{
+    const enum prog_opcode op = ( enum prog_opcode ) code [ end - 1 ].opcode;
+    const bool lconst = rhs - lhs == 1 &&
+        code [ lhs ].opcode == PROG_OP_LITERAL;
+    const bool rconst = end - rhs == 2 &&
+        code [ rhs ].opcode == PROG_OP_LITERAL;
+    const struct instruction * r = & ( code [ rhs ] );
+    const struct instruction * l = & ( code [ lhs ] );
+
+    if ( lconst && rconst ) {
+        code [ lhs ].value = node_op_apply ( node_operator_of ( op ),
+            l->value, r->value );
+        return lhs + 1;
+    }
+
+    if ( rconst && (
+            ( op == PROG_OP_MULTIPLY && is_literal ( r, NUMBER_ONE ) ) ||
+            ( op == PROG_OP_DIVIDE && is_literal ( r, NUMBER_ONE ) ) ||
+            ( op == PROG_OP_EXP && is_literal ( r, NUMBER_ONE ) ) ||
+            ( op == PROG_OP_SUBTRACT && is_literal ( r, NUMBER_ZERO ) ) ||
+            ( op == PROG_OP_ADD && is_literal ( r, NUMBER_NEGATIVE_ZERO ) ) ) )
+        return rhs;
+
+    if ( lconst && (
+            ( op == PROG_OP_MULTIPLY && is_literal ( l, NUMBER_ONE ) ) ||
+            ( op == PROG_OP_ADD &&
+                is_literal ( l, NUMBER_NEGATIVE_ZERO ) ) ) ) {
+        memmove ( & ( code [ lhs ] ), r,
+            sizeof ( struct instruction ) * ( end - 1 - rhs ) );
+        return end - 2;
+    }
+
+    if ( ( rconst && op == PROG_OP_EXP && is_literal ( r, NUMBER_ZERO ) ) ||
+            ( lconst && op == PROG_OP_EXP && is_literal ( l, NUMBER_ONE ) ) ) {
+        code [ lhs ].opcode = PROG_OP_LITERAL;
+        code [ lhs ].value = NUMBER_ONE;
+        return lhs + 1;
+    }
+
+    return end;
+}
+
+/**
+ * Fold constants and apply identities throughout a program, compacting its
+ * instruction stream in place.
+ *
+ * @param self the program
+ * @return zero on success, or -1 if scratch space could not be allocated
+ */
+static int fold ( struct program * self )
+{
+    unsigned int * starts, top = 0, n = 0, rhs;
+
+    /* Removing a subtree could remove the store of a shared value, so a
+     * program whose values are already shared is not folded again; nor is a
+     * reassociated program. */
+    if ( self->temps || self->reduction != PROG_REDUCTION_SERIAL )
+        return 0;
+
+    if ( ! ( starts = malloc ( sizeof ( unsigned int ) * self->depth ) ) )
+        return -1;
+
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        self->code [ n ] = self->code [ i ];
+
+        switch ( ( enum prog_opcode ) self->code [ n ].opcode ) {
+            case PROG_OP_LITERAL:
+            case PROG_OP_VARIABLE:
+            case PROG_OP_TEMP:
+                starts [ top++ ] = n++;
+                break;
+
+            case PROG_OP_STORE:
+                n++;
+                break;
+
+            case PROG_OP_POWI:
+                if ( starts [ top - 1 ] == n - 1 &&
+                        self->code [ n - 1 ].opcode == PROG_OP_LITERAL )
+                    self->code [ n - 1 ].value = powi (
+                        self->code [ n - 1 ].value, self->code [ n ].exponent );
+                else
+                    n++;
+                break;
+
+            case PROG_OP_EXP:
+            case PROG_OP_DIVIDE:
+            case PROG_OP_MULTIPLY:
+            case PROG_OP_ADD:
+            case PROG_OP_SUBTRACT:
+                rhs = starts [ --top ];
+                n = simplify ( self->code, starts [ top - 1 ], rhs, n + 1 );
+                break;
+
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+            case PROG_OP_COUNT:
+                n++;
+                break;
+        }
+    }
+
+    debug_printf ( "Folded a program of %u instruction(s) into %u\n",
+        self->length, n );
+
+    self->length = n;
+    measure ( self );
+    free ( starts );
+    return 0;
+}
+
+/* NOTES ON STRENGTH REDUCTION
+ *
+ * Exponentiation by a small integral literal is replaced by a single unary
+ * instruction that squares and multiplies, in a wider type, rather than
+ * calling powf(3). A literal immediately before an operator is always its
+ * right-hand operand, so the pattern is recognised without tracking operands.
+ *
+ * The power is exact until the exact result needs more than 53 bits, so it
+ * is correctly rounded, or very nearly so; powf(3) is not correctly rounded
+ * either, so the two disagree in the last bit for a few inputs in ten
+ * thousand, mostly where the exact result lies half-way between two floats.
+ * Special values agree: NaNs propagate, signed zeroes and infinities give the
+ * signs and poles of pow(3), and overflow and underflow are preserved, since
+ * the double accumulator cannot overflow or underflow before the float result
+ * would. The pass is therefore not among the default passes. The same holds
+ * for doubles, accumulated in long double where that is wider; fixed-point
+ * powers are accumulated in double, which may lose low bits of large bases.
+ */
+
+/**
+ * Replace exponentiation by integral literals with powi instructions,
+ * compacting the instruction stream of a program in place.
+ *
+ * @param self the program
+ */
+static void reduce ( struct program * self )
+{
+    const struct instruction * ins;
+    unsigned int n = 0;
+    double value;
+
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        ins = & ( self->code [ i ] );
+        value = number_to_double ( ins->value );
+
+        if ( ins->opcode == PROG_OP_LITERAL && i + 1 < self->length &&
+                self->code [ i + 1 ].opcode == PROG_OP_EXP &&
+                nearbyint ( value ) <= value &&
+                nearbyint ( value ) >= value &&
+                fabs ( value ) <= PROGRAM_POWI_MAX ) {
+            self->code [ n ].opcode = PROG_OP_POWI;
+            self->code [ n++ ].exponent = ( int ) value;
+            i++;
+        } else
+            self->code [ n++ ] = *ins;
+    }
+
+    debug_printf ( "Reduced a program of %u instruction(s) into %u\n",
+        self->length, n );
+
+    self->length = n;
+}
+
+/* NOTES ON COMMON-SUBEXPRESSION ELIMINATION
+ *
+ * The instruction stream is read into a DAG by hash-consing: each instruction
+ * becomes a node identified by its opcode, its operand, and the nodes of its
+ * operands, and a node identical to one already built is never built again.
+ * Structurally identical subtrees are therefore represented by a single node,
+ * however often they occur. Operands are never reordered, so "a+b" and "b+a"
+ * remain distinct; evaluation order, and so every result, is unchanged.
+ *
+ * The program is then re-emitted from the DAG, in the same postfix order. The
+ * first time an operator node with more than one reference is computed, a
+ * STORE instruction copies its value into a temporary, and later references
+ * load it with a TEMP instruction. Literals and variables are cheaper to push
+ * than to load, so they are never shared. A temporary is released once its
+ * last reference has loaded it, and is reused by the next shared value.
+ *
+ * Both the DAG and the emission are built without recursion, since the tree
+ * of a long left-associative chain is as deep as the chain is long.
+ */
+
+/**
+ * Are two instructions identical, given identical operands?
+ *
+ * @param a the first instruction
+ * @param b the second instruction
+ * @return whether the instructions compute the same value
+ */
+static bool same_instruction ( const struct instruction * a,
+        const struct instruction * b )
+{
+    if ( a->opcode != b->opcode )
+        return false;
+
+    switch ( ( enum prog_opcode ) a->opcode ) {
+        case PROG_OP_LITERAL:
+            return !memcmp ( &a->value, &b->value, sizeof ( number_t ) );
+
+        case PROG_OP_VARIABLE:
+            return a->slot == b->slot;
+
+        case PROG_OP_POWI:
+            return a->exponent == b->exponent;
+
+        case PROG_OP_SUM:
+        case PROG_OP_PRODUCT:
+            return a->count == b->count;
+
+        case PROG_OP_TEMP:
+        case PROG_OP_STORE:
+        case PROG_OP_EXP:
+        case PROG_OP_DIVIDE:
+        case PROG_OP_MULTIPLY:
+        case PROG_OP_ADD:
+        case PROG_OP_SUBTRACT:
+        case PROG_OP_COUNT:
+        default:
+            return true;
+    }
+}
+
+/**
+ * Hash a DAG node by its instruction and its children.
+ *
+ * @param node the node
+ * @return the hash
+ */
+static uint64_t hash_node ( const struct dag_node * node )
+{
+    uint64_t h = node->ins.opcode;
+    uint64_t operand = 0;
+
+    if ( node->ins.opcode == PROG_OP_LITERAL )
+        memcpy ( &operand, &node->ins.value, sizeof ( number_t ) );
+    else if ( node->ins.opcode == PROG_OP_VARIABLE )
+        operand = node->ins.slot;
+    else if ( node->ins.opcode == PROG_OP_POWI )
+        operand = ( uint32_t ) node->ins.exponent;
+
+    h = ( h ^ operand ) * UINT64_C ( 0x9e3779b97f4a7c15 );
+    h = ( h ^ node->lhs ) * UINT64_C ( 0x9e3779b97f4a7c15 );
+    h = ( h ^ node->rhs ) * UINT64_C ( 0x9e3779b97f4a7c15 );
+
+    return h ^ ( h >> 32 );
+}
+
+/**
+ * Emit the instructions that compute a DAG node, sharing the values of nodes
+ * with more than one reference through temporaries.
+ *
+ * @param nodes the DAG
+ * @param root the node to emit
+ * @param work scratch space for twice as many entries as there are nodes,
+ *      plus one
+ * @param free_temps scratch space for as many temporaries as there are nodes
+ * @param code the destination of the instructions
+ * @param limit the capacity of the destination
+ * @return the number of instructions emitted, or PROGRAM_NONE if they would
+ *      exceed the capacity
+ */
+static unsigned int emit ( struct dag_node * nodes, unsigned int root,
+        unsigned int * work, unsigned int * free_temps,
+        struct instruction * code, unsigned int limit )
+{
+    unsigned int top = 0, n = 0, temps = 0, freed = 0, id;
+    struct dag_node * node;
+
+    /* Each work entry is a node, doubled, plus one once its children have
+     * been scheduled. */
+    work [ top++ ] = root << 1;
+
+    while ( top ) {
+        id = work [ --top ];
+        node = & ( nodes [ id >> 1 ] );
+
+        if ( n + 2 > limit )
+            return PROGRAM_NONE;
+
+        if ( node->temp != PROGRAM_NONE ) {
+            code [ n ].opcode = PROG_OP_TEMP;
+            code [ n++ ].temp = node->temp;
+
+            if ( --node->uses == 0 )
+                free_temps [ freed++ ] = node->temp;
+        } else if ( node->ins.opcode <= PROG_OP_TEMP )
+            code [ n++ ] = node->ins;
+
+        else if ( ! ( id & 1 ) ) {
+            work [ top++ ] = id | 1;
+
+            if ( node->ins.opcode != PROG_OP_POWI )
+                work [ top++ ] = node->rhs << 1;
+            work [ top++ ] = node->lhs << 1;
+        } else {
+            code [ n++ ] = node->ins;
+
+            if ( node->uses > 1 ) {
+                node->temp = freed ? free_temps [ --freed ] : temps++;
+                node->uses--;
+                code [ n ].opcode = PROG_OP_STORE;
+                code [ n++ ].temp = node->temp;
+            }
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Build the DAG of a program by hash-consing its instructions.
+ *
+ * @param self the program
+ * @param nodes the destination of the DAG, with room for as many nodes as
+ *      there are instructions
+ * @param table an empty hash table of node indices, with more slots than
+ *      there are instructions
+ * @param mask one less than the number of slots, which is a power of two
+ * @param values scratch space for as many nodes as there are instructions
+ * @param count the destination of the number of nodes
+ * @return the root node
+ */
+static unsigned int build ( const struct program * self,
+        struct dag_node * nodes, unsigned int * table, unsigned int mask,
+        unsigned int * values, unsigned int * count )
+{
+    unsigned int top = 0, idx;
+    struct dag_node node;
+
+    *count = 0;
+
+    /* 'values' holds the node of each value on the value stack, exactly as
+     * the evaluator would hold the values themselves. */
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        node.ins = self->code [ i ];
+        node.lhs = node.rhs = 0;
+        node.uses = 0;
+        node.temp = PROGRAM_NONE;
+
+        if ( node.ins.opcode == PROG_OP_POWI )
+            node.lhs = values [ --top ];
+        else if ( node.ins.opcode > PROG_OP_STORE ) {
+            node.rhs = values [ --top ];
+            node.lhs = values [ --top ];
+        }
+
+        for ( idx = ( unsigned int ) hash_node ( &node ) & mask;
+                table [ idx ] != PROGRAM_NONE; idx = ( idx + 1 ) & mask )
+            if ( nodes [ table [ idx ] ].lhs == node.lhs &&
+                    nodes [ table [ idx ] ].rhs == node.rhs &&
+                    same_instruction ( & ( nodes [ table [ idx ] ].ins ),
+                    &node.ins ) )
+                break;
+
+        /* Only a new node adds references to its children */
+        if ( table [ idx ] == PROGRAM_NONE ) {
+            if ( node.ins.opcode == PROG_OP_POWI )
+                nodes [ node.lhs ].uses++;
+            else if ( node.ins.opcode > PROG_OP_STORE ) {
+                nodes [ node.lhs ].uses++;
+                nodes [ node.rhs ].uses++;
+            }
+
+            table [ idx ] = *count;
+            nodes [ ( *count )++ ] = node;
+        }
+
+        values [ top++ ] = table [ idx ];
+    }
+
+    nodes [ values [ 0 ] ].uses++;
+    return values [ 0 ];
+}
+
+/**
+ * Eliminate common subexpressions from a program, rewriting its instruction
+ * stream in place. The program is left unchanged if nothing is shared.
+ *
+ * @param self the program
+ * @return zero on success, or -1 if scratch space could not be allocated
+ */
+static int share ( struct program * self )
+{
+    const unsigned int length = self->length;
+    unsigned int capacity = 16, count, root, n;
+    struct instruction * code;
+    struct dag_node * nodes;
+    unsigned int * table, * scratch, * work;
+    int status = -1;
+
+    /* Temporaries are only ever introduced by this pass, and the DAG has no
+     * nodes for reductions */
+    if ( self->temps || self->reduction != PROG_REDUCTION_SERIAL )
+        return 0;
+
+    while ( capacity <= length * 2 )
+        capacity <<= 1;
+
+    table = malloc ( sizeof ( unsigned int ) * capacity );
+    nodes = malloc ( sizeof ( struct dag_node ) * length );
+    scratch = malloc ( sizeof ( unsigned int ) * length );
+    work = malloc ( sizeof ( unsigned int ) * ( length * 2 + 1 ) );
+    code = malloc ( sizeof ( struct instruction ) * length );
+
+    if ( table && nodes && scratch && work && code ) {
+        memset ( table, 0xff, sizeof ( unsigned int ) * capacity );
+        root = build ( self, nodes, table, capacity - 1, scratch, &count );
+
+        /* The scratch space is reused for the released temporaries */
+        if ( count < length && ( n = emit ( nodes, root, work, scratch,
+                code, length ) ) < length ) {
+            memcpy ( self->code, code, sizeof ( struct instruction ) * n );
+            self->eliminated = length - count;
+            self->length = n;
+            measure ( self );
+        }
+
+        debug_printf ( "Eliminated %u of %u node(s), leaving %u "
+            "instruction(s)\n", length - count, length, self->length );
+
+        status = 0;
+    }
+
+    free ( table );
+    free ( nodes );
+    free ( scratch );
+    free ( work );
+    free ( code );
+    return status;
+}
+
+/* NOTES ON REASSOCIATION
+ *
+ * A long chain of additions, such as "a + b + c + ...", compiles to a serial
+ * chain of dependencies: each addition waits for the last. The reassociation
+ * passes flatten every tree of additions, or of multiplications, of at least
+ * PROGRAM_CHAIN_MIN terms into reductions: SUM and PRODUCT instructions, each
+ * of which pops its terms at once and pushes their reduction. A partial result
+ * that is shared through a temporary is a term of its own, rather than a part
+ * of the chain, so that it is still computed. The terms keep their order, and
+ * a chain of more than PROGRAM_REDUCE_MAX terms is reduced in runs, each of
+ * which takes the result of the last as its first term.
+ *
+ * The order in which a reduction combines its terms is recorded with the
+ * program (see 'prog_reduction'):
+ *
+ *  - Interleaved: term j is accumulated into accumulator j mod PROGRAM_LANES,
+ *    so that the accumulators depend only on themselves, and then the
+ *    accumulators are combined pairwise;
+ *
+ *  - Pairwise: the terms are combined in a balanced tree, whose rounding error
+ *    grows with the logarithm of the number of terms, rather than linearly;
+ *
+ *  - Compensated: as interleaved, but each accumulator of a sum carries the
+ *    rounding error of its last addition into the next (Kahan summation), and
+ *    so do the accumulators as they are combined. Products are interleaved.
+ *
+ * Every engine applies the same operations in the same order, so the engines
+ * still agree bit-for-bit with each other, but not with the chain as written:
+ * these passes are the equivalent of fast-math, and are never among the
+ * defaults. Compensation assumes finite terms; an infinite term makes the
+ * compensated sum a NaN.
+ *
+ * The stack engine reduces the terms where they lie on the value stack, with
+ * the accumulators in a local array that the compiler vectorises, and the
+ * batch evaluator applies its kernels to whole row-vectors of terms in the
+ * same order. The register engine accumulates each term as soon as it has
+ * been computed, so that no more than PROGRAM_LANES accumulators are live
+ * however long the chain, and their dependencies are independent; the native
+ * engine assembles the same instructions.
+ */
+
+/**
+ * Is the given opcode that of an associative operator?
+ *
+ * @param opcode the opcode
+ * @return whether chains of the operator may be reassociated
+ */
+static inline bool is_associative ( unsigned char opcode )
+{
+    return opcode == PROG_OP_ADD || opcode == PROG_OP_MULTIPLY;
+}
+
+/**
+ * Rewrite every long chain of additions or of multiplications of a program as
+ * reductions, compacting its instruction stream in place.
+ *
+ * @param self the program
+ * @param reduction the order in which the reductions combine their terms
+ * @return zero on success, or -1 if scratch space could not be allocated
+ */
+static int reassociate ( struct program * self, enum prog_reduction reduction )
+{
+    const unsigned int length = self->length;
+    unsigned int * consumer, * terms, * chain, * pending;
+    unsigned int top = 0, n = 0, chains = 0, lhs, rhs, owner;
+    struct instruction * code;
+    const struct instruction * ins;
+    int status = -1;
+
+    /* The DAG of shared values has no nodes for reductions, so a program is
+     * reassociated once, and its temporaries are terms like any other. */
+    if ( self->reduction != PROG_REDUCTION_SERIAL )
+        return 0;
+
+    consumer = malloc ( sizeof ( unsigned int ) * length );
+    terms = malloc ( sizeof ( unsigned int ) * length );
+    chain = malloc ( sizeof ( unsigned int ) * length );
+    pending = malloc ( sizeof ( unsigned int ) * length );
+    code = malloc ( sizeof ( struct instruction ) * length );
+
+    if ( consumer && terms && chain && pending && code ) {
+        /* Find the instruction that consumes each value, and the number of
+         * terms of each chain, with 'pending' as the value stack. A value
+         * that is stored is consumed by the store. */
+        for ( unsigned int i = 0; i < length; i++ ) {
+            ins = & ( self->code [ i ] );
+            consumer [ i ] = PROGRAM_NONE;
+            terms [ i ] = 1;
+
+            if ( ins->opcode <= PROG_OP_TEMP )
+                pending [ top++ ] = i;
+
+            else if ( ins->opcode <= PROG_OP_STORE ) {
+                consumer [ pending [ top - 1 ] ] = i;
+                pending [ top - 1 ] = i;
+            } else {
+                rhs = pending [ --top ];
+                lhs = pending [ top - 1 ];
+                consumer [ lhs ] = consumer [ rhs ] = i;
+                pending [ top - 1 ] = i;
+
+                if ( is_associative ( ins->opcode ) )
+                    terms [ i ] = ( self->code [ lhs ].opcode == ins->opcode ?
+                        terms [ lhs ] : 1 ) + ( self->code [ rhs ].opcode ==
+                        ins->opcode ? terms [ rhs ] : 1 );
+            }
+        }
+
+        /* Find the root of the chain to which each operator belongs, if that
+         * chain is long enough to be reassociated */
+        for ( unsigned int i = length; i--; ) {
+            ins = & ( self->code [ i ] );
+            chain [ i ] = PROGRAM_NONE;
+            pending [ i ] = 0;
+
+            if ( !is_associative ( ins->opcode ) )
+                continue;
+
+            if ( consumer [ i ] != PROGRAM_NONE &&
+                    self->code [ consumer [ i ] ].opcode == ins->opcode )
+                chain [ i ] = chain [ consumer [ i ] ];
+            else if ( terms [ i ] >= PROGRAM_CHAIN_MIN ) {
+                chain [ i ] = i;
+                chains++;
+            }
+        }
+
+        /* Drop the operators of each chain, and reduce its terms once they
+         * have been computed; 'terms' counts those yet to be computed, and
+         * 'pending' those on the value stack. */
+        for ( unsigned int i = 0; i < length; i++ ) {
+            ins = & ( self->code [ i ] );
+
+            if ( chain [ i ] == PROGRAM_NONE )
+                code [ n++ ] = *ins;
+
+            else if ( chain [ i ] == i ) {
+                code [ n ].opcode = ( ins->opcode == PROG_OP_ADD ) ?
+                    PROG_OP_SUM : PROG_OP_PRODUCT;
+                code [ n++ ].count = pending [ i ];
+            }
+
+            if ( consumer [ i ] == PROGRAM_NONE || ( owner =
+                    chain [ consumer [ i ] ] ) == PROGRAM_NONE ||
+                    owner == chain [ i ] )
+                continue;
+
+            /* A full run is reduced at once, unless it is the last */
+            pending [ owner ]++;
+
+            if ( --terms [ owner ] &&
+                    pending [ owner ] == PROGRAM_REDUCE_MAX ) {
+                code [ n ].opcode = ( self->code [ owner ].opcode ==
+                    PROG_OP_ADD ) ? PROG_OP_SUM : PROG_OP_PRODUCT;
+                code [ n++ ].count = PROGRAM_REDUCE_MAX;
+                pending [ owner ] = 1;
+            }
+        }
+
+        debug_printf ( "Reassociated %u chain(s), leaving %u of %u "
+            "instruction(s)\n", chains, n, length );
+
+        memcpy ( self->code, code, sizeof ( struct instruction ) * n );
+        self->length = n;
+        self->reduction = reduction;
+        measure ( self );
+        status = 0;
+    }
+
+    free ( consumer );
+    free ( terms );
+    free ( chain );
+    free ( pending );
+    free ( code );
+    return status;
+}
+
+/**
+ * Apply the binary operator of a reduction.
+ *
+ * @param opcode PROG_OP_SUM or PROG_OP_PRODUCT
+ * @param lhs the left-hand operand
+ * @param rhs the right-hand operand
+ * @return the result
+ */
+static inline number_t combine ( enum prog_opcode opcode, number_t lhs,
+        number_t rhs )
+{
+    return ( opcode == PROG_OP_PRODUCT ) ? number_multiply ( lhs, rhs ) :
+        number_add ( lhs, rhs );
+}
+
+/**
+ * Reduce terms pairwise, in a balanced tree.
+ *
+ * @param terms the terms, which are overwritten
+ * @param count the number of terms
+ * @param opcode PROG_OP_SUM or PROG_OP_PRODUCT
+ * @return the reduction
+ */
+static inline number_t pairwise ( number_t * terms, unsigned int count,
+        enum prog_opcode opcode )
+{
+    for ( unsigned int w = 1; w < count; w <<= 1 )
+        for ( unsigned int k = 0; k + w < count; k += w << 1 )
+            terms [ k ] = combine ( opcode, terms [ k ], terms [ k + w ] );
+
+    return terms [ 0 ];
+}
+
+/**
+ * Reduce terms interleaved among PROGRAM_LANES accumulators.
+ *
+ * @param terms the terms
+ * @param count the number of terms
+ * @param opcode PROG_OP_SUM or PROG_OP_PRODUCT
+ * @return the reduction
+ */
+static inline number_t interleave ( const number_t * terms, unsigned int count,
+        enum prog_opcode opcode )
+{
+    const unsigned int lanes = ( count < PROGRAM_LANES ) ? count :
+        PROGRAM_LANES;
+    number_t acc [ PROGRAM_LANES ];
+    unsigned int j = PROGRAM_LANES;
+
+    memcpy ( acc, terms, sizeof ( number_t ) * lanes );
+
+    for ( ; j + PROGRAM_LANES <= count; j += PROGRAM_LANES )
+        for ( unsigned int k = 0; k < PROGRAM_LANES; k++ )
+            acc [ k ] = combine ( opcode, acc [ k ], terms [ j + k ] );
+
+    for ( unsigned int k = 0; j + k < count; k++ )
+        acc [ k ] = combine ( opcode, acc [ k ], terms [ j + k ] );
+
+    return pairwise ( acc, lanes, opcode );
+}
+
+/**
+ * Sum terms interleaved among PROGRAM_LANES compensated accumulators.
+ *
+ * @param terms the terms
+ * @param count the number of terms
+ * @return the sum
+ */
+static number_t compensate ( const number_t * terms, unsigned int count )
+{
+    const unsigned int lanes = ( count < PROGRAM_LANES ) ? count :
+        PROGRAM_LANES;
+    number_t sum [ PROGRAM_LANES ] = { NUMBER_ZERO };
+    number_t error [ PROGRAM_LANES ] = { NUMBER_ZERO };
+    number_t total, carry = NUMBER_ZERO, y, u;
+    unsigned int k;
+
+    memcpy ( sum, terms, sizeof ( number_t ) * lanes );
+
+    for ( unsigned int j = PROGRAM_LANES; j < count; j++ ) {
+        k = j % PROGRAM_LANES;
+        y = number_subtract ( terms [ j ], error [ k ] );
+        u = number_add ( sum [ k ], y );
+        error [ k ] = number_subtract ( number_subtract ( u, sum [ k ] ), y );
+        sum [ k ] = u;
+    }
+
+    total = number_subtract ( sum [ 0 ], error [ 0 ] );
+
+    for ( k = 1; k < lanes; k++ ) {
+        y = number_subtract ( number_subtract ( sum [ k ], error [ k ] ),
+            carry );
+        u = number_add ( total, y );
+        carry = number_subtract ( number_subtract ( u, total ), y );
+        total = u;
+    }
+
+    return number_subtract ( total, carry );
+}
+
+/**
+ * Reduce the operands of a reduction instruction, in the order recorded with
+ * the program.
+ *
+ * @param self the program
+ * @param terms the operands, which may be overwritten
+ * @param count the number of operands
+ * @param opcode PROG_OP_SUM or PROG_OP_PRODUCT
+ * @return the reduction
+ */
+static number_t accumulate ( const struct program * self, number_t * terms,
+        unsigned int count, enum prog_opcode opcode )
+{
+    if ( self->reduction == PROG_REDUCTION_PAIRWISE )
+        return ( opcode == PROG_OP_SUM ) ?
+            pairwise ( terms, count, PROG_OP_SUM ) :
+            pairwise ( terms, count, PROG_OP_PRODUCT );
+
+    if ( self->reduction == PROG_REDUCTION_COMPENSATED &&
+            opcode == PROG_OP_SUM )
+        return compensate ( terms, count );
+
+    return ( opcode == PROG_OP_SUM ) ?
+        interleave ( terms, count, PROG_OP_SUM ) :
+        interleave ( terms, count, PROG_OP_PRODUCT );
+}
+
+/**
+ * Execute the instruction stream of a program on the given value stack.
+ *
+ * @param self the program
+ * @param values scratch space for at least 'self->depth' values, followed by
+ *      'self->temps' temporaries
+ * @param vars the variables, indexed by slot
+ * @return the computed value
+ */
+static number_t run ( const struct program * self, number_t * values,
+        const number_t * vars )
+{
+    const struct instruction * ip = self->code;
+    const struct instruction * const end = ip + self->length;
+    number_t * const temps = values + self->depth;
+    number_t * top = values;
+
+    for ( ; ip != end; ip++ )
+        switch ( ( enum prog_opcode ) ip->opcode ) {
+            case PROG_OP_LITERAL:
+                *top++ = ip->value;
+                break;
+
+            case PROG_OP_VARIABLE:
+                *top++ = vars [ ip->slot ];
+                break;
+
+            case PROG_OP_TEMP:
+                *top++ = temps [ ip->temp ];
+                break;
+
+            case PROG_OP_POWI:
+                top [ -1 ] = powi ( top [ -1 ], ip->exponent );
+                break;
+
+            case PROG_OP_STORE:
+                temps [ ip->temp ] = top [ -1 ];
+                break;
+
+            case PROG_OP_EXP:
+                top--;
+                top [ -1 ] = number_power ( top [ -1 ], *top );
+                break;
+
+            case PROG_OP_DIVIDE:
+                top--;
+                top [ -1 ] = number_divide ( top [ -1 ], *top );
+                break;
+
+            case PROG_OP_MULTIPLY:
+                top--;
+                top [ -1 ] = number_multiply ( top [ -1 ], *top );
+                break;
+
+            case PROG_OP_ADD:
+                top--;
+                top [ -1 ] = number_add ( top [ -1 ], *top );
+                break;
+
+            case PROG_OP_SUBTRACT:
+                top--;
+                top [ -1 ] = number_subtract ( top [ -1 ], *top );
+                break;
+
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+                top -= ip->count;
+                *top = accumulate ( self, top, ip->count,
+                    ( enum prog_opcode ) ip->opcode );
+                top++;
+                break;
+
+            case PROG_OP_COUNT:
+                break;
+        }
+
+    return *values;
+}
+
+/**
+ * Reduce the operands of a reduction instruction over a block of rows, in the
+ * order recorded with the program. Each operand is a row-vector, to which the
+ * kernels are applied whole, except that compensated sums are computed row by
+ * row.
+ *
+ * @param self the program
+ * @param kernels the block kernels
+ * @param terms the operands, as consecutive row-vectors; the first is the
+ *      destination of the reduction
+ * @param count the number of operands, at most PROGRAM_REDUCE_MAX
+ * @param opcode PROG_OP_SUM or PROG_OP_PRODUCT
+ * @param n the number of rows in the block
+ */
+static void reduce_block ( const struct program * self,
+        const struct kernels * kernels, number_t * terms, unsigned int count,
+        enum prog_opcode opcode, unsigned int n )
+{
+    const kernel_fn kernel = ( opcode == PROG_OP_SUM ) ? kernels->add :
+        kernels->multiply;
+    number_t row [ PROGRAM_REDUCE_MAX ];
+    unsigned int lanes = count;
+
+    if ( self->reduction == PROG_REDUCTION_COMPENSATED &&
+            opcode == PROG_OP_SUM ) {
+        for ( unsigned int i = 0; i < n; i++ ) {
+            for ( unsigned int j = 0; j < count; j++ )
+                row [ j ] = terms [ j * PROGRAM_BLOCK + i ];
+
+            terms [ i ] = compensate ( row, count );
+        }
+
+        return;
+    }
+
+    /* Interleaving leaves the accumulators in the first row-vectors, which
+     * are then reduced pairwise */
+    if ( self->reduction != PROG_REDUCTION_PAIRWISE ) {
+        for ( unsigned int j = PROGRAM_LANES; j < count; j++ )
+            kernel ( terms + j % PROGRAM_LANES * PROGRAM_BLOCK,
+                terms + j * PROGRAM_BLOCK, n );
+
+        if ( lanes > PROGRAM_LANES )
+            lanes = PROGRAM_LANES;
+    }
+
+    for ( unsigned int w = 1; w < lanes; w <<= 1 )
+        for ( unsigned int k = 0; k + w < lanes; k += w << 1 )
+            kernel ( terms + k * PROGRAM_BLOCK,
+                terms + ( k + w ) * PROGRAM_BLOCK, n );
+}
+
+/**
+ * Execute the instruction stream of a program over a block of rows. Each entry
+ * of the value stack is a row-vector of PROGRAM_BLOCK values, so an instruction
+ * is decoded once and then handed, with the whole block, to a kernel.
+ *
+ * @param self the program
+ * @param kernels the block kernels
+ * @param values scratch space for at least 'self->depth' row-vectors, followed
+ *      by 'self->temps' temporary row-vectors
+ * @param columns the variable columns, indexed by slot
+ * @param base the index of the first row of the block
+ * @param n the number of rows in the block, at most PROGRAM_BLOCK
+ * @param out the destination of the results for the block
+ */
+static void run_block ( const struct program * self,
+        const struct kernels * kernels, number_t * values,
+        const number_t * const * columns, size_t base, unsigned int n,
+        number_t * out )
+{
+    const struct instruction * ip = self->code;
+    const struct instruction * const end = ip + self->length;
+    number_t * const temps = values + self->depth * PROGRAM_BLOCK;
+    number_t * top = values;
+
+    for ( ; ip != end; ip++ )
+        switch ( ( enum prog_opcode ) ip->opcode ) {
+            case PROG_OP_LITERAL:
+                for ( unsigned int i = 0; i < n; i++ )
+                    top [ i ] = ip->value;
+                top += PROGRAM_BLOCK;
+                break;
+
+            case PROG_OP_VARIABLE:
+                memcpy ( top, & ( columns [ ip->slot ] [ base ] ),
+                    sizeof ( number_t ) * n );
+                top += PROGRAM_BLOCK;
+                break;
+
+            case PROG_OP_TEMP:
+                memcpy ( top, temps + ip->temp * PROGRAM_BLOCK,
+                    sizeof ( number_t ) * n );
+                top += PROGRAM_BLOCK;
+                break;
+
+            case PROG_OP_POWI:
+                for ( unsigned int i = 0; i < n; i++ )
+                    ( top - PROGRAM_BLOCK ) [ i ] = powi (
+                        ( top - PROGRAM_BLOCK ) [ i ], ip->exponent );
+                break;
+
+            case PROG_OP_STORE:
+                memcpy ( temps + ip->temp * PROGRAM_BLOCK, top - PROGRAM_BLOCK,
+                    sizeof ( number_t ) * n );
+                break;
+
+            case PROG_OP_EXP:
+                top -= PROGRAM_BLOCK;
+                kernels->exp ( top - PROGRAM_BLOCK, top, n );
+                break;
+
+            case PROG_OP_DIVIDE:
+                top -= PROGRAM_BLOCK;
+                kernels->divide ( top - PROGRAM_BLOCK, top, n );
+                break;
+
+            case PROG_OP_MULTIPLY:
+                top -= PROGRAM_BLOCK;
+                kernels->multiply ( top - PROGRAM_BLOCK, top, n );
+                break;
+
+            case PROG_OP_ADD:
+                top -= PROGRAM_BLOCK;
+                kernels->add ( top - PROGRAM_BLOCK, top, n );
+                break;
+
+            case PROG_OP_SUBTRACT:
+                top -= PROGRAM_BLOCK;
+                kernels->subtract ( top - PROGRAM_BLOCK, top, n );
+                break;
+
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+                top -= PROGRAM_BLOCK * ip->count;
+                reduce_block ( self, kernels, top, ip->count,
+                    ( enum prog_opcode ) ip->opcode, n );
+                top += PROGRAM_BLOCK;
+                break;
+
+            case PROG_OP_COUNT:
+                break;
+        }
+
+    memcpy ( out, values, sizeof ( number_t ) * n );
+}
+
+/* NOTES ON THE REGISTER ENGINE
+ *
+ * The register engine executes three-address instructions over a frame of
+ * cells, laid out as:
+ *
+ *   [ registers | literals | variables | spilled values ]
+ *
+ * The literals and variables are copied into the frame before each evaluation,
+ * so every operand is simply a cell, and no instruction is spent pushing a
+ * leaf: "a * b + c * d" is three instructions, rather than the seven of the
+ * stack engine. Identical literals share a cell.
+ *
+ * The result of every operator is given a register by linear scan. The stack
+ * code is first translated with a virtual register per result, whose live
+ * interval runs from the instruction that defines it to the last one that
+ * consumes it. A value shared through a temporary by common-subexpression
+ * elimination is one virtual register, consumed wherever the temporary is
+ * loaded, so it needs no cell of its own. The intervals are then visited in
+ * order of their start: those that have ended release their registers, and if
+ * none is free, whichever interval ends last is spilled to a cell of its own
+ * for its whole life. Each instruction reads its operands before it writes its
+ * result, so the register of an operand may be reused as the destination of
+ * the instruction that last consumes it.
+ *
+ * A reduction (see "NOTES ON REASSOCIATION") is unrolled into the binary
+ * operations that the stack engine would perform, in the same order, with
+ * each term folded into its accumulator as soon as it is computed.
+ *
+ * Only 'program_evaluate' uses the register engine. The batch evaluator
+ * already amortises the dispatch of each instruction over a block of rows, so
+ * it always executes the stack code.
+ */
+
+/**
+ * Find the cell of a literal among the distinct literals of a translation,
+ * adding it if it is new.
+ *
+ * @param regs the translation
+ * @param table the hash table of literal indices
+ * @param mask one less than the number of slots, which is a power of two
+ * @param value the literal
+ * @return the cell
+ */
+static unsigned int constant ( struct reg_code * regs, unsigned int * table,
+        unsigned int mask, number_t value )
+{
+    uint64_t bits = 0;
+    unsigned int idx;
+
+    memcpy ( &bits, &value, sizeof ( number_t ) );
+
+    for ( idx = ( unsigned int ) ( ( bits * UINT64_C ( 0x9e3779b97f4a7c15 ) )
+            >> 32 ) & mask; table [ idx ] != PROGRAM_NONE;
+            idx = ( idx + 1 ) & mask )
+        if ( !memcmp ( & ( regs->pool [ table [ idx ] ] ), &value,
+                sizeof ( number_t ) ) )
+            return PROGRAM_REGISTERS + table [ idx ];
+
+    table [ idx ] = regs->constants;
+    regs->pool [ regs->constants ] = value;
+
+    return PROGRAM_REGISTERS + regs->constants++;
+}
+
+/**
+ * Assign a cell to every virtual register by linear scan.
+ *
+ * @param intervals the intervals of the virtual registers, in order of their
+ *      start
+ * @param count the number of intervals
+ * @param spills the first cell for spilled values
+ * @param registers the number of registers to allocate, at most
+ *      PROGRAM_REGISTERS
+ * @return the number of spilled values
+ */
+static unsigned int allocate ( struct interval * intervals, unsigned int count,
+        unsigned int spills, unsigned int registers )
+{
+    unsigned int active [ PROGRAM_REGISTERS ], free_regs [ PROGRAM_REGISTERS ];
+    unsigned int live = 0, available = registers, spilled = 0, i;
+    struct interval * v;
+
+    for ( unsigned int r = 0; r < registers; r++ )
+        free_regs [ r ] = registers - 1 - r;
+
+    for ( unsigned int id = 0; id < count; id++ ) {
+        v = & ( intervals [ id ] );
+
+        /* 'active' is ordered by end, so expired intervals are at its head */
+        for ( i = 0; i < live && intervals [ active [ i ] ].end <= v->start;
+                i++ )
+            free_regs [ available++ ] = intervals [ active [ i ] ].cell;
+
+        memmove ( active, active + i, sizeof ( unsigned int ) * ( live - i ) );
+        live -= i;
+
+        if ( available )
+            v->cell = free_regs [ --available ];
+
+        else if ( intervals [ active [ live - 1 ] ].end > v->end ) {
+            v->cell = intervals [ active [ --live ] ].cell;
+            intervals [ active [ live ] ].cell = spills + spilled++;
+        } else {
+            v->cell = spills + spilled++;
+            continue;
+        }
+
+        for ( i = live; i && intervals [ active [ i - 1 ] ].end > v->end; i-- )
+            active [ i ] = active [ i - 1 ];
+
+        active [ i ] = id;
+        live++;
+    }
+
+    return spilled;
+}
+
+/**
+ * Resolve an operand under translation to its cell.
+ *
+ * @param intervals the allocated intervals
+ * @param operand the operand, either a cell or a flagged virtual register
+ * @return the cell
+ */
+static inline unsigned int resolve ( const struct interval * intervals,
+        unsigned int operand )
+{
+    return ( operand & PROGRAM_VIRTUAL ) ?
+        intervals [ operand & ~PROGRAM_VIRTUAL ].cell : operand;
+}
+
+/**
+ * Append an instruction to a translation, whose result is a new virtual
+ * register, and extend the live intervals of its operands to the instruction.
+ *
+ * @param regs the translation
+ * @param intervals the intervals of the virtual registers
+ * @param n the number of instructions so far, which is incremented
+ * @param opcode the operation
+ * @param exponent the exponent, for PROG_OP_POWI
+ * @param lhs the left-hand (or only) operand
+ * @param rhs the right-hand operand, or zero
+ * @return the virtual register of the result
+ */
+static unsigned int append ( struct reg_code * regs,
+        struct interval * intervals, unsigned int * n, enum prog_opcode opcode,
+        int exponent, unsigned int lhs, unsigned int rhs )
+{
+    struct reg_instruction * out = & ( regs->code [ *n ] );
+
+    out->opcode = ( unsigned char ) opcode;
+    out->exponent = exponent;
+    out->lhs = lhs;
+    out->rhs = rhs;
+
+    if ( lhs & PROGRAM_VIRTUAL )
+        intervals [ lhs & ~PROGRAM_VIRTUAL ].end = *n;
+    if ( rhs & PROGRAM_VIRTUAL )
+        intervals [ rhs & ~PROGRAM_VIRTUAL ].end = *n;
+
+    intervals [ *n ] = ( struct interval ) { *n, PROGRAM_NONE, PROGRAM_NONE };
+    return out->dst = ( *n )++ | PROGRAM_VIRTUAL;
+}
+
+/**
+ * Accumulate a term of a reduction under translation, as soon as it has been
+ * computed, in the order recorded with the program. The accumulators lie on
+ * the operand stack beneath the term: the partial results of a pairwise
+ * reduction, or one per lane, which for a compensated sum is followed by its
+ * error, or by PROGRAM_NONE while that is zero.
+ *
+ * @param self the program
+ * @param regs the translation
+ * @param intervals the intervals of the virtual registers
+ * @param n the number of instructions so far, which is incremented
+ * @param values the operand stack, whose topmost operand is the term
+ * @param top the height of the operand stack
+ * @param term the index of the term among the operands of its reduction,
+ *      doubled, plus one if the reduction is a product
+ * @return the new height of the operand stack
+ */
+static unsigned int translate_term ( const struct program * self,
+        struct reg_code * regs, struct interval * intervals, unsigned int * n,
+        unsigned int * values, unsigned int top, unsigned int term )
+{
+    const enum prog_opcode op = ( term & 1 ) ? PROG_OP_MULTIPLY : PROG_OP_ADD;
+    const unsigned int j = term >> 1, k = j % PROGRAM_LANES;
+    unsigned int * acc, t, y, u;
+
+    /* Partial results of equal size are combined, as in a binary counter */
+    if ( self->reduction == PROG_REDUCTION_PAIRWISE ) {
+        for ( unsigned int carry = j + 1; ! ( carry & 1 ); carry >>= 1 ) {
+            top--;
+            values [ top - 1 ] = append ( regs, intervals, n, op, 0,
+                values [ top - 1 ], values [ top ] );
+        }
+
+        return top;
+    }
+
+    if ( self->reduction != PROG_REDUCTION_COMPENSATED ||
+            op != PROG_OP_ADD ) {
+        if ( j >= PROGRAM_LANES ) {
+            t = values [ --top ];
+            acc = & ( values [ top - PROGRAM_LANES + k ] );
+            *acc = append ( regs, intervals, n, op, 0, *acc, t );
+        }
+
+        return top;
+    }
+
+    if ( j < PROGRAM_LANES ) {
+        values [ top++ ] = PROGRAM_NONE;
+        return top;
+    }
+
+    t = values [ --top ];
+    acc = & ( values [ top - 2 * ( PROGRAM_LANES - k ) ] );
+    y = ( acc [ 1 ] == PROGRAM_NONE ) ? t : append ( regs, intervals, n,
+        PROG_OP_SUBTRACT, 0, t, acc [ 1 ] );
+    u = append ( regs, intervals, n, PROG_OP_ADD, 0, acc [ 0 ], y );
+    t = append ( regs, intervals, n, PROG_OP_SUBTRACT, 0, u, acc [ 0 ] );
+    acc [ 1 ] = append ( regs, intervals, n, PROG_OP_SUBTRACT, 0, t, y );
+    acc [ 0 ] = u;
+
+    return top;
+}
+
+/**
+ * Combine the accumulators of a reduction under translation, once its every
+ * term has been accumulated (see 'translate_term').
+ *
+ * @param self the program
+ * @param regs the translation
+ * @param intervals the intervals of the virtual registers
+ * @param n the number of instructions so far, which is incremented
+ * @param values the operand stack, whose topmost operands are the accumulators
+ * @param top the height of the operand stack
+ * @param ins the reduction instruction
+ * @return the new height of the operand stack, whose topmost operand is the
+ *      reduction
+ */
+static unsigned int translate_reduction ( const struct program * self,
+        struct reg_code * regs, struct interval * intervals, unsigned int * n,
+        unsigned int * values, unsigned int top,
+        const struct instruction * ins )
+{
+    const enum prog_opcode op = ( ins->opcode == PROG_OP_SUM ) ?
+        PROG_OP_ADD : PROG_OP_MULTIPLY;
+    const unsigned int lanes = ( ins->count < PROGRAM_LANES ) ? ins->count :
+        PROGRAM_LANES;
+    unsigned int * acc, total, carry = PROGRAM_NONE, y, u;
+
+    if ( self->reduction == PROG_REDUCTION_PAIRWISE ) {
+        for ( unsigned int parts = ( unsigned int ) __builtin_popcount (
+                ins->count ); parts > 1; parts-- ) {
+            top--;
+            values [ top - 1 ] = append ( regs, intervals, n, op, 0,
+                values [ top - 1 ], values [ top ] );
+        }
+
+        return top;
+    }
+
+    if ( self->reduction != PROG_REDUCTION_COMPENSATED ||
+            op != PROG_OP_ADD ) {
+        acc = & ( values [ top - lanes ] );
+
+        for ( unsigned int w = 1; w < lanes; w <<= 1 )
+            for ( unsigned int k = 0; k + w < lanes; k += w << 1 )
+                acc [ k ] = append ( regs, intervals, n, op, 0, acc [ k ],
+                    acc [ k + w ] );
+
+        return top - lanes + 1;
+    }
+
+    /* Each accumulator is corrected by its error, and the corrected values
+     * are summed with compensation in turn */
+    acc = & ( values [ top - 2 * lanes ] );
+    total = ( acc [ 1 ] == PROGRAM_NONE ) ? acc [ 0 ] : append ( regs,
+        intervals, n, PROG_OP_SUBTRACT, 0, acc [ 0 ], acc [ 1 ] );
+
+    for ( unsigned int k = 1; k < lanes; k++ ) {
+        y = ( acc [ 2 * k + 1 ] == PROGRAM_NONE ) ? acc [ 2 * k ] : append (
+            regs, intervals, n, PROG_OP_SUBTRACT, 0, acc [ 2 * k ],
+            acc [ 2 * k + 1 ] );
+
+        if ( carry != PROGRAM_NONE )
+            y = append ( regs, intervals, n, PROG_OP_SUBTRACT, 0, y, carry );
+
+        u = append ( regs, intervals, n, PROG_OP_ADD, 0, total, y );
+        carry = append ( regs, intervals, n, PROG_OP_SUBTRACT, 0, u, total );
+        carry = append ( regs, intervals, n, PROG_OP_SUBTRACT, 0, carry, y );
+        total = u;
+    }
+
+    acc [ 0 ] = ( carry == PROGRAM_NONE ) ? total : append ( regs, intervals,
+        n, PROG_OP_SUBTRACT, 0, total, carry );
+
+    return top - 2 * lanes + 1;
+}
+
+/**
+ * Translate the stack code of a program into register code, with every pass
+ * over the stack code sharing the same scratch space.
+ *
+ * @param self the program
+ * @param regs the translation, with room for every instruction that the
+ *      operators and reductions could need, and a literal per literal
+ *      instruction, and no literals yet
+ * @param table an empty hash table of literal indices
+ * @param mask one less than the number of slots, which is a power of two
+ * @param values scratch space for 'self->depth' operands, and PROGRAM_LANES
+ *      more per compensated sum
+ * @param temps scratch space for an operand per temporary
+ * @param terms scratch space for an entry per instruction
+ * @param intervals scratch space for an interval per register instruction
+ * @param registers the number of registers to allocate
+ */
+static void translate_into ( const struct program * self,
+        struct reg_code * regs, unsigned int * table, unsigned int mask,
+        unsigned int * values, unsigned int * temps, unsigned int * terms,
+        struct interval * intervals, unsigned int registers )
+{
+    const struct instruction * ins;
+    struct reg_instruction * out;
+    unsigned int top = 0, n = 0, count;
+
+    /* Every literal is interned first, so that the cells following them are
+     * known before any variable or temporary is referenced. */
+    for ( unsigned int i = 0; i < self->length; i++ )
+        if ( self->code [ i ].opcode == PROG_OP_LITERAL )
+            constant ( regs, table, mask, self->code [ i ].value );
+
+    regs->variables = PROGRAM_REGISTERS + regs->constants;
+
+    /* Find the instruction that completes each operand of every reduction,
+     * with 'values' holding the instruction that last wrote each value */
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        ins = & ( self->code [ i ] );
+        terms [ i ] = PROGRAM_NONE;
+
+        if ( ins->opcode <= PROG_OP_TEMP )
+            values [ top++ ] = i;
+
+        else if ( ins->opcode <= PROG_OP_STORE )
+            values [ top - 1 ] = i;
+
+        else {
+            count = ( ins->opcode >= PROG_OP_SUM ) ? ins->count : 2;
+            top -= count;
+
+            if ( ins->opcode >= PROG_OP_SUM )
+                for ( unsigned int j = 0; j < count; j++ )
+                    terms [ values [ top + j ] ] = j << 1 |
+                        ( ins->opcode == PROG_OP_PRODUCT );
+
+            values [ top++ ] = i;
+        }
+    }
+
+    top = 0;
+
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        ins = & ( self->code [ i ] );
+
+        switch ( ( enum prog_opcode ) ins->opcode ) {
+            case PROG_OP_LITERAL:
+                values [ top++ ] = constant ( regs, table, mask, ins->value );
+                break;
+
+            case PROG_OP_VARIABLE:
+                values [ top++ ] = regs->variables + ins->slot;
+                break;
+
+            case PROG_OP_TEMP:
+                values [ top++ ] = temps [ ins->temp ];
+                break;
+
+            case PROG_OP_STORE:
+                temps [ ins->temp ] = values [ top - 1 ];
+                break;
+
+            case PROG_OP_POWI:
+                values [ top - 1 ] = append ( regs, intervals, &n,
+                    PROG_OP_POWI, ins->exponent, values [ top - 1 ], 0 );
+                break;
+
+            case PROG_OP_EXP:
+            case PROG_OP_DIVIDE:
+            case PROG_OP_MULTIPLY:
+            case PROG_OP_ADD:
+            case PROG_OP_SUBTRACT:
+                top--;
+                values [ top - 1 ] = append ( regs, intervals, &n,
+                    ( enum prog_opcode ) ins->opcode, 0, values [ top - 1 ],
+                    values [ top ] );
+                break;
+
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+                top = translate_reduction ( self, regs, intervals, &n,
+                    values, top, ins );
+                break;
+
+            case PROG_OP_COUNT:
+                break;
+        }
+
+        if ( terms [ i ] != PROGRAM_NONE )
+            top = translate_term ( self, regs, intervals, &n, values, top,
+                terms [ i ] );
+    }
+
+    /* The result is live until the end */
+    if ( values [ 0 ] & PROGRAM_VIRTUAL )
+        intervals [ values [ 0 ] & ~PROGRAM_VIRTUAL ].end = n;
+
+    regs->length = n;
+    regs->frame = regs->variables + self->slots;
+    regs->frame += allocate ( intervals, n, regs->frame, registers );
+
+    for ( unsigned int i = 0; i < n; i++ ) {
+        out = & ( regs->code [ i ] );
+        out->dst = resolve ( intervals, out->dst );
+        out->lhs = resolve ( intervals, out->lhs );
+        out->rhs = resolve ( intervals, out->rhs );
+    }
+
+    regs->result = resolve ( intervals, values [ 0 ] );
+}
+
+/**
+ * Translate the stack code of a program for the register engine. If this
+ * function fails, then 'errno' is set appropriately.
+ *
+ * @param self the program
+ * @param registers the number of registers to allocate, at most
+ *      PROGRAM_REGISTERS
+ * @return the translation, or NULL on failure
+ */
+static struct reg_code * translate ( const struct program * self,
+        unsigned int registers )
+{
+    unsigned int operators = 0, literals = 0, stack = self->depth;
+    unsigned int capacity = 16;
+    const struct instruction * ins;
+    struct interval * intervals;
+    unsigned int * table, * values, * terms;
+    struct reg_code * regs;
+    size_t offset;
+
+    /* A compensated sum of n terms needs at most 5n + 1 instructions, and
+     * holds an error beside each of its accumulators */
+    for ( unsigned int i = 0; i < self->length; i++ ) {
+        ins = & ( self->code [ i ] );
+
+        if ( ins->opcode == PROG_OP_LITERAL )
+            literals++;
+
+        else if ( ins->opcode == PROG_OP_SUM &&
+                self->reduction == PROG_REDUCTION_COMPENSATED ) {
+            operators += ins->count * 5 + 1;
+            stack += PROGRAM_LANES;
+        } else if ( ins->opcode >= PROG_OP_SUM )
+            operators += ins->count - 1;
+
+        else if ( ins->opcode >= PROG_OP_POWI &&
+                ins->opcode != PROG_OP_STORE )
+            operators++;
+    }
+
+    while ( capacity <= literals * 2 )
+        capacity <<= 1;
+
+    /* The literals follow the instructions, suitably aligned */
+    offset = sizeof ( struct reg_code ) +
+        sizeof ( struct reg_instruction ) * operators;
+    offset = ( offset + _Alignof ( number_t ) - 1 ) &
+        ~ ( _Alignof ( number_t ) - 1 );
+
+    regs = malloc ( offset + sizeof ( number_t ) * literals );
+    table = malloc ( sizeof ( unsigned int ) * capacity );
+    values = malloc ( sizeof ( unsigned int ) * ( stack + self->temps ) );
+    terms = malloc ( sizeof ( unsigned int ) * self->length );
+    intervals = malloc ( sizeof ( struct interval ) * ( operators + 1 ) );
+
+    if ( regs && table && values && terms && intervals ) {
+        memset ( table, 0xff, sizeof ( unsigned int ) * capacity );
+        regs->pool = ( number_t * ) ( ( char * ) regs + offset );
+        regs->constants = 0;
+
+        translate_into ( self, regs, table, capacity - 1, values,
+            values + stack, terms, intervals, registers );
+        debug_printf ( "Translated %u stack instruction(s) into %u "
+            "register instruction(s) over %u cell(s)\n", self->length,
+            regs->length, regs->frame );
+    } else {
+        free ( regs );
+        regs = NULL;
+    }
+
+    free ( table );
+    free ( values );
+    free ( terms );
+    free ( intervals );
+    return regs;
+}
+
+/**
+ * Execute the register code of a program in the given frame.
+ *
+ * @param self the program
+ * @param frame scratch space for 'self->regs->frame' cells
+ * @param vars the variables, indexed by slot
+ * @return the computed value
+ */
+static number_t run_registers ( const struct program * self, number_t * frame,
+        const number_t * vars )
+{
+    const struct reg_code * regs = self->regs;
+    const struct reg_instruction * ip = regs->code;
+    const struct reg_instruction * const end = ip + regs->length;
+
+    memcpy ( frame + PROGRAM_REGISTERS, regs->pool,
+        sizeof ( number_t ) * regs->constants );
+
+    if ( self->slots )
+        memcpy ( frame + regs->variables, vars,
+            sizeof ( number_t ) * self->slots );
+
+    for ( ; ip != end; ip++ )
+        switch ( ( enum prog_opcode ) ip->opcode ) {
+            case PROG_OP_POWI:
+                frame [ ip->dst ] = powi ( frame [ ip->lhs ], ip->exponent );
+                break;
+
+            case PROG_OP_EXP:
+                frame [ ip->dst ] = number_power ( frame [ ip->lhs ],
+                    frame [ ip->rhs ] );
+                break;
+
+            case PROG_OP_DIVIDE:
+                frame [ ip->dst ] = number_divide ( frame [ ip->lhs ],
+                    frame [ ip->rhs ] );
+                break;
+
+            case PROG_OP_MULTIPLY:
+                frame [ ip->dst ] = number_multiply ( frame [ ip->lhs ],
+                    frame [ ip->rhs ] );
+                break;
+
+            case PROG_OP_ADD:
+                frame [ ip->dst ] = number_add ( frame [ ip->lhs ],
+                    frame [ ip->rhs ] );
+                break;
+
+            case PROG_OP_SUBTRACT:
+                frame [ ip->dst ] = number_subtract ( frame [ ip->lhs ],
+                    frame [ ip->rhs ] );
+                break;
+
+            case PROG_OP_LITERAL:
+            case PROG_OP_VARIABLE:
+            case PROG_OP_TEMP:
+            case PROG_OP_STORE:
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+            case PROG_OP_COUNT:
+                break;
+        }
+
+    return frame [ regs->result ];
+}
+
+/* NOTES ON THE NATIVE ENGINE
+ *
+ * The native engine is tiered. A program is translated for the register engine
+ * on selection, allocating one register fewer than usual (JIT_REGISTERS), and
+ * interpreted as such for its first PROGRAM_JIT_THRESHOLD evaluations. The
+ * evaluation that reaches the threshold assembles the register code into
+ * native code (see 'jit.h'), one instruction for each, and publishes the
+ * native function; every later evaluation calls it with the usual frame. Only
+ * one thread ever assembles a program, and others keep interpreting it
+ * meanwhile. Once the threshold is reached, the counter is only read, so
+ * threads do not contend over it for long.
+ *
+ * Where native code cannot be assembled, whether on other architectures or for
+ * want of memory, the program is simply interpreted by the register engine.
+ */
+
+/**
+ * Find the operand of the native engine that names a cell of the frame of the
+ * register engine.
+ *
+ * @param self the program
+ * @param cell the cell
+ * @return the operand
+ */
+static struct jit_operand operand ( const struct program * self,
+        unsigned int cell )
+{
+    const struct reg_code * regs = self->regs;
+
+    if ( cell < PROGRAM_REGISTERS )
+        return ( struct jit_operand ) { JIT_REGISTER, cell };
+
+    if ( cell < regs->variables )
+        return ( struct jit_operand ) { JIT_LITERAL,
+            cell - PROGRAM_REGISTERS };
+
+    if ( cell < regs->variables + self->slots )
+        return ( struct jit_operand ) { JIT_VARIABLE,
+            cell - regs->variables };
+
+    return ( struct jit_operand ) { JIT_CELL, cell };
+}
+
+/**
+ * Assemble the register code of a program into native code, and publish the
+ * native function. On failure, the program is left to the register engine.
+ *
+ * @param self the program, with the native engine selected
+ */
+static void assemble ( const struct program * self )
+{
+    const struct reg_code * regs = self->regs;
+    const struct reg_instruction * ip;
+    struct jit_operand dst, lhs, rhs;
+    jit_function fn;
+    struct jit * jit;
+
+    if ( ! ( jit = jit_initialise ( regs->pool, regs->constants ) ) ) {
+        debug_perror ( "Could not initialise the assembler" );
+        return;
+    }
+
+    for ( unsigned int i = 0; i < regs->length; i++ ) {
+        ip = & ( regs->code [ i ] );
+        dst = operand ( self, ip->dst );
+        lhs = operand ( self, ip->lhs );
+        rhs = operand ( self, ip->rhs );
+
+        switch ( ( enum prog_opcode ) ip->opcode ) {
+            case PROG_OP_POWI:
+                jit_call_int ( jit, powi, dst, lhs, ip->exponent );
+                break;
+
+            case PROG_OP_EXP:
+                jit_binary ( jit, JIT_OP_EXP, dst, lhs, rhs );
+                break;
+
+            case PROG_OP_DIVIDE:
+                jit_binary ( jit, JIT_OP_DIVIDE, dst, lhs, rhs );
+                break;
+
+            case PROG_OP_MULTIPLY:
+                jit_binary ( jit, JIT_OP_MULTIPLY, dst, lhs, rhs );
+                break;
+
+            case PROG_OP_ADD:
+                jit_binary ( jit, JIT_OP_ADD, dst, lhs, rhs );
+                break;
+
+            case PROG_OP_SUBTRACT:
+                jit_binary ( jit, JIT_OP_SUBTRACT, dst, lhs, rhs );
+                break;
+
+            case PROG_OP_LITERAL:
+            case PROG_OP_VARIABLE:
+            case PROG_OP_TEMP:
+            case PROG_OP_STORE:
+            case PROG_OP_SUM:
+            case PROG_OP_PRODUCT:
+            case PROG_OP_COUNT:
+                break;
+        }
+    }
+
+    jit_return ( jit, operand ( self, regs->result ) );
+
+    if ( ! ( fn = jit_finalise ( jit, & ( self->native->size ) ) ) ) {
+        debug_perror ( "Could not assemble native code" );
+        return;
+    }
+
+    atomic_store_explicit ( & ( self->native->function ), fn,
+        memory_order_release );
+}
+
+/**
+ * Count an evaluation of a program selected for the native engine, assembling
+ * it if the evaluation reaches the threshold.
+ *
+ * @param self the program
+ * @return the native function, or NULL if the program is still interpreted
+ */
+static jit_function tier ( const struct program * self )
+{
+    struct native * native = self->native;
+    jit_function fn;
+
+    if ( ( fn = atomic_load_explicit ( & ( native->function ),
+            memory_order_acquire ) ) )
+        return fn;
+
+    if ( atomic_load_explicit ( & ( native->evaluations ),
+            memory_order_relaxed ) >= PROGRAM_JIT_THRESHOLD ||
+            atomic_fetch_add_explicit ( & ( native->evaluations ), 1,
+            memory_order_relaxed ) != PROGRAM_JIT_THRESHOLD - 1 )
+        return NULL;
+
+    assemble ( self );
+    return atomic_load_explicit ( & ( native->function ),
+        memory_order_acquire );
+}
+
+/**
+ * Evaluate a program in the given scratch space, with its selected engine.
+ *
+ * @param self the program
+ * @param frame scratch space for the frame of the register or native engine,
+ *      or for the value stack and temporaries of the stack engine
+ * @param vars the variables, indexed by slot
+ * @return the computed value
+ */
+static number_t execute ( const struct program * self, number_t * frame,
+        const number_t * vars )
+{
+    jit_function fn;
+
+    if ( self->native && ( fn = tier ( self ) ) )
+        return fn ( frame, vars );
+
+    return self->regs ? run_registers ( self, frame, vars ) :
+        run ( self, frame, vars );
+}
+
+/**
+ * Release the translations of a program for every engine besides the stack
+ * engine, which is selected in their place.
+ *
+ * @param self the program
+ */
+static void deselect ( struct program * self )
+{
+    if ( self->native ) {
+        jit_release ( atomic_load ( & ( self->native->function ) ),
+            self->native->size );
+        free ( self->native );
+        self->native = NULL;
+    }
+
+    free ( self->regs );
+    self->regs = NULL;
+}
+
+struct program * program_assemble ( struct stack * postfix )
+{
+    const unsigned int length = stack_size ( postfix );
+    const node_kind_t * kinds = stack_kinds ( postfix );
+    const union node_datum * data = stack_data ( postfix );
+    struct program * self;
+    struct instruction * ins;
+    unsigned int depth = 0;
+    bool valid = true;
+
+    if ( ! ( self = malloc ( sizeof ( struct program ) +
+            sizeof ( struct instruction ) * length ) ) )
+        return NULL;
+
+    self->length = length;
+    self->depth = 0;
+    self->slots = 0;
+    self->temps = 0;
+    self->eliminated = 0;
+    self->reduction = PROG_REDUCTION_SERIAL;
+    self->regs = NULL;
+    self->native = NULL;
+
+    for ( unsigned int i = 0; i < length && valid; i++ ) {
+        ins = & ( self->code [ i ] );
+
+        switch ( node_kind_type ( kinds [ i ] ) ) {
+            case NODE_LITERAL:
+                ins->opcode = PROG_OP_LITERAL;
+                ins->value = data [ i ].value;
+
+                if ( ++depth > self->depth )
+                    self->depth = depth;
+                break;
+
+            case NODE_VARIABLE:
+                ins->opcode = PROG_OP_VARIABLE;
+                ins->slot = data [ i ].slot;
+
+                if ( ins->slot >= self->slots )
+                    self->slots = ins->slot + 1;
+                if ( ++depth > self->depth )
+                    self->depth = depth;
+                break;
+
+            case NODE_OPERATOR:
+                ins->opcode = ( unsigned char ) opcode_of (
+                    node_kind_op ( kinds [ i ] ) );
+                ins->value = 0;
+
+                if ( ins->opcode == PROG_OP_COUNT || depth < 2 )
+                    valid = false;
+                else
+                    depth--;
+                break;
+
+            case NODE_LPAREN:
+            case NODE_RPAREN:
+            case NODE_UNKNOWN:
+            case NODE_COUNT:
+                valid = false;
+                break;
+        }
+    }
+
+    if ( !valid || depth != 1 ) {
+        free ( self );
+        errno = EINVAL;
+        return NULL;
+    }
+
+    debug_puts ( "Program assembled" );
+    return self;
+}
+
+int program_optimise ( struct program * self, unsigned int passes )
+{
+    enum prog_reduction reduction = PROG_REDUCTION_SERIAL;
+
+    deselect ( self );
+
+    if ( ( passes & PROG_PASS_FOLD ) && fold ( self ) )
+        return -1;
+
+    if ( passes & PROG_PASS_POWI )
+        reduce ( self );
+
+    if ( ( passes & PROG_PASS_CSE ) && share ( self ) )
+        return -1;
+
+    if ( passes & PROG_PASS_KAHAN )
+        reduction = PROG_REDUCTION_COMPENSATED;
+    else if ( passes & PROG_PASS_PAIRWISE )
+        reduction = PROG_REDUCTION_PAIRWISE;
+    else if ( passes & PROG_PASS_REASSOCIATE )
+        reduction = PROG_REDUCTION_INTERLEAVED;
+
+    if ( reduction != PROG_REDUCTION_SERIAL && reassociate ( self, reduction ) )
+        return -1;
+
+    return 0;
+}
+
+int program_select ( struct program * self, enum prog_engine engine )
+{
+    struct reg_code * regs = NULL;
+    struct native * native = NULL;
+
+    /* Without native code, the native engine is the register engine */
+    if ( engine == PROG_ENGINE_NATIVE && jit_supported ( ) ) {
+        if ( ! ( native = malloc ( sizeof ( struct native ) ) ) ||
+                ! ( regs = translate ( self, JIT_REGISTERS ) ) ) {
+            free ( native );
+            return -1;
+        }
+
+        atomic_init ( & ( native->evaluations ), 0 );
+        atomic_init ( & ( native->function ), NULL );
+        native->size = 0;
+    } else if ( engine != PROG_ENGINE_STACK &&
+            ! ( regs = translate ( self, PROGRAM_REGISTERS ) ) )
+        return -1;
+
+    deselect ( self );
+    self->regs = regs;
+    self->native = native;
+
+    return 0;
+}
+
+void program_destruct ( struct program * self )
+{
+    if ( self ) {
+        deselect ( self );
+        free ( self );
+        debug_puts ( "Program destructed" );
+    }
+}
+
+number_t program_evaluate ( const struct program * self,
+        const number_t * vars )
+{
+    const unsigned int size = self->regs ? self->regs->frame :
+        self->depth + self->temps;
+    number_t local [ PROGRAM_LOCAL_DEPTH ];
+    number_t * values, result;
+
+    stats_start ( start );
+
+    if ( size <= PROGRAM_LOCAL_DEPTH )
+        result = execute ( self, local, vars );
+
+    else if ( ( values = malloc ( sizeof ( number_t ) * size ) ) ) {
+        result = execute ( self, values, vars );
+        free ( values );
+    }
+
+    else
+        result = NUMBER_INVALID;
+
+    stats_stop ( STATS_EVALUATE, start );
+    return result;
+}
+
+int program_evaluate_batch ( const struct program * self,
+        const number_t * const * columns, number_t * out, size_t rows )
+{
+    const struct kernels * kernels = kernels_get ( );
+    number_t * values;
+    unsigned int n;
+
+    if ( ! ( values = malloc ( sizeof ( number_t ) * PROGRAM_BLOCK *
+            ( self->depth + self->temps ) ) ) )
+        return -1;
+
+    for ( size_t base = 0; base < rows; base += n ) {
+        n = ( rows - base < PROGRAM_BLOCK ) ? ( unsigned int ) ( rows - base )
+            : PROGRAM_BLOCK;
+        run_block ( self, kernels, values, columns, base, n,
+            & ( out [ base ] ) );
+    }
+
+    free ( values );
+    return 0;
+}
+
+unsigned int program_slots ( const struct program * self )
+{
+    return self->slots;
+}
+
+unsigned int program_eliminated ( const struct program * self )
+{
+    return self->eliminated;
+}
+
+enum prog_reduction program_reduction ( const struct program * self )
+{
+    return self->reduction;
+}
+
+unsigned int program_length ( const struct program * self )
+{
+    return self->regs ? self->regs->length : self->length;
+}
+
+size_t program_footprint ( const struct program * self )
+{
+    size_t footprint = sizeof ( struct program ) +
+        sizeof ( struct instruction ) * self->length;
+
+    if ( self->regs )
+        footprint += sizeof ( struct reg_code ) + sizeof ( number_t ) *
+            self->regs->constants + sizeof ( struct reg_instruction ) *
+            self->regs->length;
+
+    if ( self->native ) {
+        footprint += sizeof ( struct native );
+
+        if ( atomic_load ( & ( self->native->function ) ) )
+            footprint += self->native->size;
+    }
+
+    return footprint;
+}
@@ -0,0 +1,226 @@
+/**
+ * This interface handles compiled programs: compact, immutable, self-contained
+ * instruction sequences assembled from the postfix form of an expression. A
+ * program holds no references to the nodes, pools, or stacks from which it was
+ * assembled, so once built it may be evaluated any number of times without
+ * involving the parser. Callers should:
+ *
+ *  - Tokenise an expression and convert it to postfix, as usual;
+ *  - Compile the postfix form into a program (see 'expression_compile');
+ *  - Optimise the program, if it was not optimised during compilation;
+ *  - Select the engine that evaluates the program, if not the stack engine;
+ *  - Release the expression and its node pools, if they are no longer needed;
+ *  - Evaluate the program as often as required;
+ *  - Once finished, destruct the program.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef PROG_H
+#define PROG_H
+
+#include <stddef.h>
+
+#include "node.h"
+#include "stack.h"
+
+/**
+ * The base opaque type of a compiled program
+ */
+struct program;
+
+/**
+ * The optimisation passes that may be applied to a program, as a set of flags.
+ * The default passes never change the result of any evaluation, bit-for-bit;
+ * the others are selected explicitly, and their effects are described below.
+ */
+enum prog_pass {
+    PROG_PASS_NONE = 0,
+
+    /* Fold constant subtrees to literals, and apply exact identities */
+    PROG_PASS_FOLD = 1 << 0,
+
+    /* Raise to small integral powers by repeated multiplication, rather than
+     * by powf(3); the result may differ from that of powf(3) in the last bit */
+    PROG_PASS_POWI = 1 << 1,
+
+    /* Compute structurally identical subexpressions once, and reuse their
+     * values */
+    PROG_PASS_CSE = 1 << 2,
+
+    /* Evaluate long chains of additions, or of multiplications, as single
+     * reductions over several independent accumulators, as under fast-math;
+     * the result may differ from that of the chain as written, beyond the
+     * last bit (see 'prog_reduction') */
+    PROG_PASS_REASSOCIATE = 1 << 3,
+
+    /* As PROG_PASS_REASSOCIATE, but reduce pairwise, in a balanced tree */
+    PROG_PASS_PAIRWISE = 1 << 4,
+
+    /* As PROG_PASS_REASSOCIATE, but compensate sums for their rounding error
+     * (Kahan summation); this takes precedence over PROG_PASS_PAIRWISE */
+    PROG_PASS_KAHAN = 1 << 5,
+
+    PROG_PASS_DEFAULT = PROG_PASS_FOLD | PROG_PASS_CSE,
+    PROG_PASS_ALL = PROG_PASS_FOLD | PROG_PASS_POWI | PROG_PASS_CSE
+};
+
+/**
+ * The orders in which a program combines the terms of its long chains of
+ * additions and of multiplications, as chosen by the reassociation passes
+ */
+enum prog_reduction {
+    /* As written, one after the other; the program is not reassociated */
+    PROG_REDUCTION_SERIAL,
+
+    /* Interleaved among independent accumulators, which are then combined */
+    PROG_REDUCTION_INTERLEAVED,
+
+    /* Pairwise, in a balanced tree */
+    PROG_REDUCTION_PAIRWISE,
+
+    /* As interleaved, with every sum compensated for its rounding error */
+    PROG_REDUCTION_COMPENSATED,
+};
+
+/**
+ * The engines by which a program may be evaluated
+ */
+enum prog_engine {
+    /* Interpret the postfix instructions on a value stack */
+    PROG_ENGINE_STACK,
+
+    /* Interpret three-address instructions over a register file, with the
+     * values of leaves as direct operands */
+    PROG_ENGINE_REGISTER,
+
+    /* Interpret as the register engine at first, and then, once the program
+     * has been evaluated often enough, execute native machine code assembled
+     * from the same instructions; on hosts without native code, this is the
+     * register engine */
+    PROG_ENGINE_NATIVE,
+};
+
+/**
+ * Assemble a program from the given postfix stack of nodes. The postfix form is
+ * validated during assembly, such that any assembled program is guaranteed to
+ * reduce to exactly one value. If this function fails, then 'errno' is set
+ * appropriately: EINVAL indicates a malformed postfix form.
+ *
+ * @param postfix the postfix stack, as produced by 'expression_postfix'
+ * @return the new program, or NULL on failure
+ */
+struct program * program_assemble ( struct stack * postfix );
+
+/**
+ * Apply the given optimisation passes to a program, in place. This reverts the
+ * program to the stack engine. If this function fails, then 'errno' is set
+ * appropriately.
+ *
+ * @param self the program
+ * @param passes the passes to apply, from the 'prog_pass' enumeration
+ * @return zero on success, -1 on error
+ */
+int program_optimise ( struct program * self, unsigned int passes );
+
+/**
+ * Select the engine by which 'program_evaluate' evaluates a program; the batch
+ * evaluator always uses the stack engine. Every engine gives identical results.
+ * The stack engine is selected on assembly, and selection should follow any
+ * optimisation. Selecting any engine discards native code assembled for the
+ * program, and restarts the count of its evaluations. If this function fails,
+ * then 'errno' is set appropriately, and the selected engine is unchanged.
+ *
+ * @param self the program
+ * @param engine the engine
+ * @return zero on success, -1 on error
+ */
+int program_select ( struct program * self, enum prog_engine engine );
+
+/**
+ * Destruct a program.
+ *
+ * @param self the program to be destructed
+ */
+void program_destruct ( struct program * self );
+
+/**
+ * Evaluate a program to a single number. The program is not modified, besides
+ * the count of its evaluations and the native code assembled under the native
+ * engine, which are safe to share, so this may be called concurrently on the
+ * same program.
+ *
+ * @param self the program
+ * @param vars the values of the variables, indexed by slot; this must hold at
+ *      least 'program_slots' values, and may be NULL if that is zero
+ * @return the computed value, or an invalid number (see 'number.h') if scratch
+ *      space could not be allocated
+ */
+number_t program_evaluate ( const struct program * self,
+    const number_t * vars );
+
+/**
+ * Evaluate a program over a batch of rows, given the variables in columnar
+ * (struct-of-arrays) form: the value of the variable in slot 's' for row 'r'
+ * is 'columns [ s ] [ r ]'. Rows are processed in blocks, such that each
+ * instruction is decoded once per block rather than once per row. If this
+ * function fails, then 'errno' is set appropriately.
+ *
+ * @param self the program
+ * @param columns the variable columns, indexed by slot; this must hold at least
+ *      'program_slots' columns of 'rows' values each
+ * @param out the destination of the results, holding at least 'rows' values
+ * @param rows the number of rows
+ * @return zero on success, -1 on error
+ */
+int program_evaluate_batch ( const struct program * self,
+    const number_t * const * columns, number_t * out, size_t rows );
+
+/**
+ * Retrieve the number of variable slots that must be supplied to evaluate the
+ * given program.
+ *
+ * @param self the program
+ * @return one greater than the greatest slot referenced by the program, or
+ *      zero if the program refers to no variables
+ */
+unsigned int program_slots ( const struct program * self );
+
+/**
+ * Retrieve the number of expression nodes removed from the given program by
+ * common-subexpression elimination: the number of nodes in its expression tree
+ * less the number in its expression DAG.
+ *
+ * @param self the program
+ * @return the number of eliminated nodes
+ */
+unsigned int program_eliminated ( const struct program * self );
+
+/**
+ * Retrieve the order in which the given program combines the terms of its long
+ * chains, as recorded when it was reassociated.
+ *
+ * @param self the program
+ * @return the reduction order
+ */
+enum prog_reduction program_reduction ( const struct program * self );
+
+/**
+ * Retrieve the number of instructions in the given program, as executed by its
+ * selected engine on every evaluation.
+ *
+ * @param self the program
+ * @return the instruction count
+ */
+unsigned int program_length ( const struct program * self );
+
+/**
+ * Retrieve the number of bytes occupied by the given program, including its
+ * instructions and those of its selected engine.
+ *
+ * @param self the program
+ * @return the footprint in bytes
+ */
+size_t program_footprint ( const struct program * self );
+
+#endif /* PROG_H */
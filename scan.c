@@ -0,0 +1,738 @@
+/**
+ * Implement the numeric literal scanner; see 'scan.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+
+#include "node.h"
+
+#include "scan.h"
+
+/**
+ * The greatest number of significant decimal digits that is guaranteed to be
+ * held by a 64-bit mantissa
+ */
+#define SCAN_DEC_DIGITS 19
+
+/**
+ * The greatest number of significant hexadecimal digits held by a 64-bit
+ * mantissa
+ */
+#define SCAN_HEX_DIGITS 16
+
+/**
+ * The largest magnitude of any exponent that is accumulated; anything larger is
+ * out of range regardless of the mantissa
+ */
+#define SCAN_EXP_LIMIT 100000
+
+#if defined NUMBER_DOUBLE
+
+/**
+ * The parameters of the floating number type (see 'number.h'), its C library
+ * scanner, and an unsigned integer type of the same width
+ */
+#    define SCAN_MANT_DIG DBL_MANT_DIG
+#    define SCAN_MIN_EXP  DBL_MIN_EXP
+#    define SCAN_MAX_EXP  DBL_MAX_EXP
+#    define SCAN_MIN      DBL_MIN
+#    define SCAN_MAX      DBL_MAX
+#    define SCAN_STRTO    strtod
+typedef uint64_t scan_bits;
+
+#elif !defined NUMBER_FIXED
+
+#    define SCAN_MANT_DIG FLT_MANT_DIG
+#    define SCAN_MIN_EXP  FLT_MIN_EXP
+#    define SCAN_MAX_EXP  FLT_MAX_EXP
+#    define SCAN_MIN      FLT_MIN
+#    define SCAN_MAX      FLT_MAX
+#    define SCAN_STRTO    strtof
+typedef uint32_t scan_bits;
+
+#endif
+
+/**
+ * The greatest mantissa that is exactly representable in a double
+ */
+#define SCAN_EXACT_MANTISSA ( UINT64_C ( 1 ) << DBL_MANT_DIG )
+
+/**
+ * The number of mantissa bits of a double that are discarded when narrowing it
+ * to a float
+ */
+#define SCAN_NARROW_BITS ( DBL_MANT_DIG - FLT_MANT_DIG )
+
+#ifndef NUMBER_FIXED
+
+/**
+ * The powers of ten that are exactly representable in a double
+ */
+static const double POW10 [ ] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define SCAN_POW10_MAX ( ( int ) ( sizeof ( POW10 ) / sizeof ( *POW10 ) ) - 1 )
+
+#endif /* NUMBER_FIXED */
+
+/**
+ * The range of decimal exponents covered by the table of significands below,
+ * which spans every exponent that can yield a normal float from a mantissa of
+ * at most SCAN_DEC_DIGITS digits; doubles beyond it are left to the C library
+ */
+#define SCAN_SIG10_MIN ( -64 )
+#define SCAN_SIG10_MAX 40
+
+/**
+ * The greatest decimal exponent whose power of ten has an exact 64-bit
+ * significand, since 5^27 < 2^64
+ */
+#define SCAN_SIG10_EXACT 27
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 scan_u128;
+#endif
+
+#if defined __SIZEOF_INT128__ && !defined NUMBER_FIXED
+
+/**
+ * The 64-bit significands of the powers of ten from 10^SCAN_SIG10_MIN to
+ * 10^SCAN_SIG10_MAX, normalised such that the most significant bit is set,
+ * and truncated. The corresponding binary exponents are given by
+ * 'sig10_exponent'.
+ */
+static const uint64_t SIG10 [ ] = {
+    UINT64_C ( 0xa87fea27a539e9a5 ), UINT64_C ( 0xd29fe4b18e88640e ),
+    UINT64_C ( 0x83a3eeeef9153e89 ), UINT64_C ( 0xa48ceaaab75a8e2b ),
+    UINT64_C ( 0xcdb02555653131b6 ), UINT64_C ( 0x808e17555f3ebf11 ),
+    UINT64_C ( 0xa0b19d2ab70e6ed6 ), UINT64_C ( 0xc8de047564d20a8b ),
+    UINT64_C ( 0xfb158592be068d2e ), UINT64_C ( 0x9ced737bb6c4183d ),
+    UINT64_C ( 0xc428d05aa4751e4c ), UINT64_C ( 0xf53304714d9265df ),
+    UINT64_C ( 0x993fe2c6d07b7fab ), UINT64_C ( 0xbf8fdb78849a5f96 ),
+    UINT64_C ( 0xef73d256a5c0f77c ), UINT64_C ( 0x95a8637627989aad ),
+    UINT64_C ( 0xbb127c53b17ec159 ), UINT64_C ( 0xe9d71b689dde71af ),
+    UINT64_C ( 0x9226712162ab070d ), UINT64_C ( 0xb6b00d69bb55c8d1 ),
+    UINT64_C ( 0xe45c10c42a2b3b05 ), UINT64_C ( 0x8eb98a7a9a5b04e3 ),
+    UINT64_C ( 0xb267ed1940f1c61c ), UINT64_C ( 0xdf01e85f912e37a3 ),
+    UINT64_C ( 0x8b61313bbabce2c6 ), UINT64_C ( 0xae397d8aa96c1b77 ),
+    UINT64_C ( 0xd9c7dced53c72255 ), UINT64_C ( 0x881cea14545c7575 ),
+    UINT64_C ( 0xaa242499697392d2 ), UINT64_C ( 0xd4ad2dbfc3d07787 ),
+    UINT64_C ( 0x84ec3c97da624ab4 ), UINT64_C ( 0xa6274bbdd0fadd61 ),
+    UINT64_C ( 0xcfb11ead453994ba ), UINT64_C ( 0x81ceb32c4b43fcf4 ),
+    UINT64_C ( 0xa2425ff75e14fc31 ), UINT64_C ( 0xcad2f7f5359a3b3e ),
+    UINT64_C ( 0xfd87b5f28300ca0d ), UINT64_C ( 0x9e74d1b791e07e48 ),
+    UINT64_C ( 0xc612062576589dda ), UINT64_C ( 0xf79687aed3eec551 ),
+    UINT64_C ( 0x9abe14cd44753b52 ), UINT64_C ( 0xc16d9a0095928a27 ),
+    UINT64_C ( 0xf1c90080baf72cb1 ), UINT64_C ( 0x971da05074da7bee ),
+    UINT64_C ( 0xbce5086492111aea ), UINT64_C ( 0xec1e4a7db69561a5 ),
+    UINT64_C ( 0x9392ee8e921d5d07 ), UINT64_C ( 0xb877aa3236a4b449 ),
+    UINT64_C ( 0xe69594bec44de15b ), UINT64_C ( 0x901d7cf73ab0acd9 ),
+    UINT64_C ( 0xb424dc35095cd80f ), UINT64_C ( 0xe12e13424bb40e13 ),
+    UINT64_C ( 0x8cbccc096f5088cb ), UINT64_C ( 0xafebff0bcb24aafe ),
+    UINT64_C ( 0xdbe6fecebdedd5be ), UINT64_C ( 0x89705f4136b4a597 ),
+    UINT64_C ( 0xabcc77118461cefc ), UINT64_C ( 0xd6bf94d5e57a42bc ),
+    UINT64_C ( 0x8637bd05af6c69b5 ), UINT64_C ( 0xa7c5ac471b478423 ),
+    UINT64_C ( 0xd1b71758e219652b ), UINT64_C ( 0x83126e978d4fdf3b ),
+    UINT64_C ( 0xa3d70a3d70a3d70a ), UINT64_C ( 0xcccccccccccccccc ),
+    UINT64_C ( 0x8000000000000000 ), UINT64_C ( 0xa000000000000000 ),
+    UINT64_C ( 0xc800000000000000 ), UINT64_C ( 0xfa00000000000000 ),
+    UINT64_C ( 0x9c40000000000000 ), UINT64_C ( 0xc350000000000000 ),
+    UINT64_C ( 0xf424000000000000 ), UINT64_C ( 0x9896800000000000 ),
+    UINT64_C ( 0xbebc200000000000 ), UINT64_C ( 0xee6b280000000000 ),
+    UINT64_C ( 0x9502f90000000000 ), UINT64_C ( 0xba43b74000000000 ),
+    UINT64_C ( 0xe8d4a51000000000 ), UINT64_C ( 0x9184e72a00000000 ),
+    UINT64_C ( 0xb5e620f480000000 ), UINT64_C ( 0xe35fa931a0000000 ),
+    UINT64_C ( 0x8e1bc9bf04000000 ), UINT64_C ( 0xb1a2bc2ec5000000 ),
+    UINT64_C ( 0xde0b6b3a76400000 ), UINT64_C ( 0x8ac7230489e80000 ),
+    UINT64_C ( 0xad78ebc5ac620000 ), UINT64_C ( 0xd8d726b7177a8000 ),
+    UINT64_C ( 0x878678326eac9000 ), UINT64_C ( 0xa968163f0a57b400 ),
+    UINT64_C ( 0xd3c21bcecceda100 ), UINT64_C ( 0x84595161401484a0 ),
+    UINT64_C ( 0xa56fa5b99019a5c8 ), UINT64_C ( 0xcecb8f27f4200f3a ),
+    UINT64_C ( 0x813f3978f8940984 ), UINT64_C ( 0xa18f07d736b90be5 ),
+    UINT64_C ( 0xc9f2c9cd04674ede ), UINT64_C ( 0xfc6f7c4045812296 ),
+    UINT64_C ( 0x9dc5ada82b70b59d ), UINT64_C ( 0xc5371912364ce305 ),
+    UINT64_C ( 0xf684df56c3e01bc6 ), UINT64_C ( 0x9a130b963a6c115c ),
+    UINT64_C ( 0xc097ce7bc90715b3 ), UINT64_C ( 0xf0bdc21abb48db20 ),
+    UINT64_C ( 0x96769950b50d88f4 ), UINT64_C ( 0xbc143fa4e250eb31 ),
+    UINT64_C ( 0xeb194f8e1ae525fd )
+};
+#endif /* __SIZEOF_INT128__ && !NUMBER_FIXED */
+
+/**
+ * Retrieve the value of a decimal digit, without consulting the locale.
+ *
+ * @param c the character
+ * @return the value of the digit, or a value of at least ten if the character
+ *      is not a decimal digit
+ */
+static inline unsigned int dec_value ( char c )
+{
+    return ( unsigned int ) ( unsigned char ) c - '0';
+}
+
+/**
+ * Retrieve the value of a hexadecimal digit, without consulting the locale.
+ *
+ * @param c the character
+ * @return the value of the digit, or a value of at least sixteen if the
+ *      character is not a hexadecimal digit
+ */
+static inline unsigned int hex_value ( char c )
+{
+    if ( c >= '0' && c <= '9' )
+        return ( unsigned int ) ( c - '0' );
+    if ( c >= 'a' && c <= 'f' )
+        return ( unsigned int ) ( c - 'a' ) + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return ( unsigned int ) ( c - 'A' ) + 10;
+
+    return 16;
+}
+
+/**
+ * Scan an optional exponent, introduced by either of the given markers and
+ * followed by an optionally signed decimal integer. If the marker is not
+ * followed by an integer, then it is not part of the literal, and nothing is
+ * consumed.
+ *
+ * @param str the string whose head may begin an exponent
+ * @param markers the two characters that may introduce the exponent
+ * @param exponent the exponent, to which the scanned exponent is added
+ * @return the new read head
+ */
+static const char * scan_exponent ( const char * str, const char * markers,
+        int * exponent )
+{
+    const char * head = str + 1;
+    bool negative = false;
+    int value = 0;
+
+    if ( *str != markers [ 0 ] && *str != markers [ 1 ] )
+        return str;
+
+    if ( *head == '+' || *head == '-' )
+        negative = *head++ == '-';
+
+    if ( dec_value ( *head ) >= 10 )
+        return str;
+
+    for ( ; dec_value ( *head ) < 10; head++ )
+        if ( value < SCAN_EXP_LIMIT )
+            value = value * 10 + ( int ) dec_value ( *head );
+
+    *exponent += negative ? -value : value;
+    return head;
+}
+
+#if defined NUMBER_FIXED
+
+/**
+ * Compute the fixed-point number nearest to mantissa * radix^exponent, with
+ * ties to even. Every product and quotient is exact in 128 bits, so that only
+ * the final rounding takes place. A number beyond the range saturates, as
+ * does the result of any fixed-point operation.
+ *
+ * @param mantissa the mantissa
+ * @param exponent the exponent
+ * @param radix the radix, which is either two or ten
+ * @param value the destination of the number
+ */
+static void fix ( uint64_t mantissa, int exponent, unsigned int radix,
+        number_t * value )
+{
+    scan_u128 num = ( scan_u128 ) mantissa << NUMBER_FRACTION_BITS, den = 1;
+    scan_u128 q, r;
+
+    /* The scaled mantissa is below 2^96, so it rounds to zero once divided
+     * by 2^97, or by 10^30, or anything greater */
+    if ( radix == 2 && exponent < -97 )
+        exponent = -97;
+    else if ( radix == 10 && exponent < -30 )
+        exponent = -30;
+
+    /* A whole number is exact, so need only be in range */
+    for ( ; exponent > 0; exponent-- ) {
+        if ( num >> 63 ) {
+            *value = NUMBER_MAX;
+            return;
+        }
+
+        num *= radix;
+    }
+
+    for ( ; exponent < 0; exponent++ )
+        den *= radix;
+
+    q = num / den;
+    r = num % den;
+
+    if ( r > den - r || ( r == den - r && ( q & 1 ) ) )
+        q++;
+
+    *value = ( q > NUMBER_MAX ) ? NUMBER_MAX : ( number_t ) q;
+}
+
+/**
+ * Compute the fixed-point number nearest to a scanned literal. A truncated
+ * mantissa lies between the scanned mantissa and its successor, so the result
+ * is only certain if both agree.
+ *
+ * @param mantissa the mantissa, which must not be zero
+ * @param exponent the exponent
+ * @param radix the radix, which is either two or ten
+ * @param truncated whether non-zero digits were discarded from the mantissa
+ * @param value the destination of the number
+ * @return the ability to compute the number
+ */
+static bool round_literal ( uint64_t mantissa, int exponent,
+        unsigned int radix, bool truncated, number_t * value )
+{
+    number_t rounded, upper;
+
+    fix ( mantissa, exponent, radix, &rounded );
+
+    if ( truncated ) {
+        fix ( mantissa + 1, exponent, radix, &upper );
+
+        if ( upper != rounded )
+            return false;
+    }
+
+    *value = rounded;
+    return true;
+}
+
+#else
+
+/**
+ * Narrow a correctly rounded double to the number type. For a double, this is
+ * the identity. For a float, rounding twice, first to the double and then to
+ * the float, gives the correctly rounded float unless the double lies exactly
+ * half-way between two floats, or is subnormal as a float; these cases are
+ * refused.
+ *
+ * @param d the correctly rounded double
+ * @param value the destination of the number
+ * @return the ability to narrow the double
+ */
+static bool narrow ( double d, number_t * value )
+{
+#if defined NUMBER_DOUBLE
+    *value = d;
+    return true;
+#else
+    const uint64_t half = UINT64_C ( 1 ) << ( SCAN_NARROW_BITS - 1 );
+    const uint64_t mask = ( half << 1 ) - 1;
+    number_t narrowed;
+    uint64_t bits;
+
+    memcpy ( &bits, &d, sizeof ( bits ) );
+
+    if ( d < ( double ) FLT_MIN || ( bits & mask ) == half )
+        return false;
+
+    if ( isinf ( narrowed = ( number_t ) d ) )
+        return false;
+
+    *value = narrowed;
+    return true;
+#endif
+}
+
+#ifdef __SIZEOF_INT128__
+
+/**
+ * Compute the binary exponent of the normalised significand of a power of ten,
+ * such that 10^q = SIG10 [ q - SCAN_SIG10_MIN ] * 2^sig10_exponent ( q ). The
+ * constant is floor ( log2 ( 10 ) * 2^16 ), which is exact for this range.
+ *
+ * @param q the decimal exponent
+ * @return the binary exponent
+ */
+static inline int sig10_exponent ( int q )
+{
+    return ( ( q * 217706 ) >> 16 ) - 63;
+}
+
+/**
+ * Compute the correctly rounded number nearest to mantissa * 10^exponent, with
+ * the Eisel-Lemire algorithm: the mantissa is multiplied by a truncated 64-bit
+ * significand of the power of ten, and the result is accepted only when the
+ * truncation cannot have affected the rounding. Results that would be
+ * subnormal or out of range are refused.
+ *
+ * @param mantissa the decimal mantissa, which must not be zero
+ * @param exponent the decimal exponent
+ * @param value the destination of the number
+ * @return the ability to compute the number
+ */
+static bool scale ( uint64_t mantissa, int exponent, number_t * value )
+{
+    /* The significand of the number, and a rounding bit */
+    const unsigned int keep = SCAN_MANT_DIG + 1;
+    uint64_t hi, lo, rem, mask, significand;
+    unsigned int leading, shift;
+    scan_u128 product;
+    scan_bits bits;
+    int biased;
+    bool sticky;
+
+    if ( exponent < SCAN_SIG10_MIN || exponent > SCAN_SIG10_MAX )
+        return false;
+
+    leading = ( unsigned int ) __builtin_clzll ( mantissa );
+    mantissa <<= leading;
+
+    product = ( scan_u128 ) mantissa * SIG10 [ exponent - SCAN_SIG10_MIN ];
+    hi = ( uint64_t ) ( product >> 64 );
+    lo = ( uint64_t ) product;
+
+    /* The product of two normalised significands has its leading bit in
+     * either of the top two positions. */
+    shift = ( unsigned int ) ( hi >> 63 ) + 63 - keep;
+    mask = ( UINT64_C ( 1 ) << shift ) - 1;
+    significand = hi >> shift;
+    rem = hi & mask;
+
+    if ( exponent >= 0 && exponent <= SCAN_SIG10_EXACT )
+        sticky = rem || lo;
+    else {
+        /* The true product lies in [ product, product + mantissa ), which
+         * is strictly above the truncated product. This is only ambiguous
+         * if a carry out of the low bits could reach the significand. */
+        if ( rem == mask && lo > UINT64_MAX - mantissa )
+            return false;
+
+        sticky = true;
+    }
+
+    /* Round to nearest, with ties to even */
+    if ( ( significand & 1 ) && ( sticky || ( significand & 2 ) ) )
+        significand += 2;
+    significand >>= 1;
+
+    biased = ( int ) shift + 65 + sig10_exponent ( exponent ) -
+        ( int ) leading + ( SCAN_MANT_DIG - 1 ) - ( SCAN_MIN_EXP - 2 );
+
+    if ( significand >> SCAN_MANT_DIG ) {
+        significand >>= 1;
+        biased++;
+    }
+
+    if ( biased < 1 || biased > SCAN_MAX_EXP - SCAN_MIN_EXP + 1 )
+        return false;
+
+    bits = ( scan_bits ) biased << ( SCAN_MANT_DIG - 1 ) |
+        ( ( scan_bits ) significand &
+            ( ( ( scan_bits ) 1 << ( SCAN_MANT_DIG - 1 ) ) - 1 ) );
+    memcpy ( value, &bits, sizeof ( bits ) );
+
+    return true;
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+/**
+ * Compute the correctly rounded number nearest to a scanned literal, where
+ * this is cheap.
+ *
+ * @param mantissa the mantissa, which must not be zero
+ * @param exponent the exponent
+ * @param radix the radix, which is either two or ten
+ * @param truncated whether non-zero digits were discarded from the mantissa
+ * @param value the destination of the number
+ * @return the ability to compute the number
+ */
+static bool round_literal ( uint64_t mantissa, int exponent,
+        unsigned int radix, bool truncated, number_t * value )
+{
+    number_t rounded_number, upper;
+    double rounded;
+
+    /* A mantissa that fits a double is scaled exactly by a power of two, so
+     * only one rounding takes place, when narrowing to the number type. */
+    if ( radix == 2 ) {
+        if ( truncated || mantissa >= SCAN_EXACT_MANTISSA ||
+                exponent <= -SCAN_EXP_LIMIT || exponent >= SCAN_EXP_LIMIT )
+            return false;
+
+        rounded = ldexp ( ( double ) mantissa, exponent );
+
+        if ( rounded < ( double ) SCAN_MIN || rounded > ( double ) SCAN_MAX )
+            return false;
+
+        *value = ( number_t ) rounded;
+        return true;
+    }
+
+    /* Clinger's fast path: when both the mantissa and the power of ten are
+     * exact doubles, a single multiplication or division rounds correctly. */
+    if ( !truncated && mantissa <= SCAN_EXACT_MANTISSA &&
+            exponent >= -SCAN_POW10_MAX && exponent <= SCAN_POW10_MAX ) {
+        rounded = ( exponent < 0 ) ?
+            ( double ) mantissa / POW10 [ -exponent ] :
+            ( double ) mantissa * POW10 [ exponent ];
+
+        if ( narrow ( rounded, value ) )
+            return true;
+    }
+
+#ifdef __SIZEOF_INT128__
+    /* A truncated mantissa lies between the scanned mantissa and its
+     * successor, so the result is only certain if both agree. */
+    if ( scale ( mantissa, exponent, &rounded_number ) && ( !truncated || (
+            scale ( mantissa + 1, exponent, &upper ) &&
+            !memcmp ( &rounded_number, &upper, sizeof ( upper ) ) ) ) ) {
+        *value = rounded_number;
+        return true;
+    }
+#else
+    ( void ) rounded_number;
+    ( void ) upper;
+#endif
+
+    return false;
+}
+
+#endif /* NUMBER_FIXED */
+
+/**
+ * Scan a literal of known length with the C library. The library's notion of
+ * the decimal point is taken from the locale, so any '.' is translated first.
+ *
+ * @param str the string whose head begins a literal
+ * @param length the length of the literal
+ * @param value the destination of the scanned value
+ * @return the length of the literal, or zero if the library rejected it
+ */
+static unsigned int scan_fallback ( const char * str, unsigned int length,
+        number_t * value )
+{
+    const char point = *localeconv ( )->decimal_point;
+    char local [ 64 ], * copy = local, * end_ptr;
+    bool valid;
+#if defined NUMBER_FIXED
+    long double val;
+#else
+    number_t val;
+#endif
+
+    if ( length >= sizeof ( local ) && ! ( copy = malloc ( length + 1 ) ) )
+        return 0;
+
+    for ( unsigned int i = 0; i < length; i++ )
+        copy [ i ] = ( str [ i ] == '.' ) ? point : str [ i ];
+    copy [ length ] = '\0';
+
+    errno = 0;
+#if defined NUMBER_FIXED
+    /* Only literals whose truncated digits are significant reach here. The
+     * long double is rounded again to the fixed-point number, with ties to
+     * even, which is only incorrect for literals within a part in 2^64 of
+     * half-way between two fixed-point numbers. A literal beyond the range
+     * saturates. */
+    val = ldexpl ( strtold ( copy, &end_ptr ), NUMBER_FRACTION_BITS );
+    valid = ( !errno || errno == ERANGE ) && end_ptr == copy + length;
+#else
+    val = SCAN_STRTO ( copy, &end_ptr );
+    valid = !errno && end_ptr == copy + length;
+#endif
+
+    if ( copy != local )
+        free ( copy );
+
+    if ( !valid )
+        return 0;
+
+#if defined NUMBER_FIXED
+    *value = ( val >= ( long double ) NUMBER_MAX ) ? NUMBER_MAX :
+        ( number_t ) llrintl ( val );
+#else
+    *value = val;
+#endif
+    return length;
+}
+
+/**
+ * Scan a hexadecimal floating-point literal, beginning with "0x" or "0X".
+ *
+ * @param str the string whose head begins a hexadecimal literal
+ * @param value the destination of the scanned value
+ * @return the length of the literal, or zero if the literal is out of range
+ */
+static unsigned int scan_hex ( const char * str, number_t * value )
+{
+    const char * head = str + 2;
+    bool any = false, truncated = false;
+    unsigned int digits = 0, length, d;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+
+    for ( ; ( d = hex_value ( *head ) ) < 16; head++, any = true )
+        if ( !mantissa && !d )
+            continue;
+        else if ( digits < SCAN_HEX_DIGITS ) {
+            mantissa = mantissa << 4 | d;
+            digits++;
+        } else {
+            exponent += 4;
+            truncated |= d != 0;
+        }
+
+    if ( *head == '.' )
+        for ( head++; ( d = hex_value ( *head ) ) < 16; head++, any = true )
+            if ( !mantissa && !d )
+                exponent -= 4;
+            else if ( digits < SCAN_HEX_DIGITS ) {
+                mantissa = mantissa << 4 | d;
+                digits++;
+                exponent -= 4;
+            } else
+                truncated |= d != 0;
+
+    if ( !any )
+        return 0;
+
+    head = scan_exponent ( head, "pP", &exponent );
+    length = ( unsigned int ) ( head - str );
+
+    if ( !mantissa ) {
+        *value = 0;
+        return length;
+    }
+
+    if ( round_literal ( mantissa, exponent, 2, truncated, value ) )
+        return length;
+
+    return scan_fallback ( str, length, value );
+}
+
+/**
+ * Scan a decimal literal.
+ *
+ * @param str the string whose head begins a decimal literal
+ * @param value the destination of the scanned value
+ * @return the length of the literal, or zero if the string does not begin with
+ *      a decimal literal, or the literal is out of range
+ */
+static unsigned int scan_decimal ( const char * str, number_t * value )
+{
+    const char * head = str;
+    bool any = false, truncated = false;
+    unsigned int digits = 0, length, d;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+
+    /* Leading zeros are not significant, and digits beyond the capacity of
+     * the mantissa only scale it, or mark it as truncated. */
+    for ( ; ( d = dec_value ( *head ) ) < 10; head++, any = true )
+        if ( !mantissa && !d )
+            continue;
+        else if ( digits < SCAN_DEC_DIGITS ) {
+            mantissa = mantissa * 10 + d;
+            digits++;
+        } else {
+            exponent++;
+            truncated |= d != 0;
+        }
+
+    if ( *head == '.' )
+        for ( head++; ( d = dec_value ( *head ) ) < 10; head++, any = true )
+            if ( !mantissa && !d )
+                exponent--;
+            else if ( digits < SCAN_DEC_DIGITS ) {
+                mantissa = mantissa * 10 + d;
+                digits++;
+                exponent--;
+            } else
+                truncated |= d != 0;
+
+    if ( !any )
+        return 0;
+
+    head = scan_exponent ( head, "eE", &exponent );
+    length = ( unsigned int ) ( head - str );
+
+    if ( !mantissa ) {
+        *value = 0;
+        return length;
+    }
+
+    if ( round_literal ( mantissa, exponent, 10, truncated, value ) )
+        return length;
+
+    return scan_fallback ( str, length, value );
+}
+
+/**
+ * Skip a run of digits.
+ *
+ * @param str the string whose head may begin a run of digits
+ * @param hex whether the digits are hexadecimal, rather than decimal
+ * @return the new read head, after the digits
+ */
+static inline const char * skip_digits ( const char * str, bool hex )
+{
+    if ( hex )
+        while ( hex_value ( *str ) < 16 )
+            str++;
+    else
+        while ( dec_value ( *str ) < 10 )
+            str++;
+
+    return str;
+}
+
+/**
+ * Measure a literal without converting it. The syntax is that accepted by
+ * 'scan_hex' and 'scan_decimal', but no mantissa is accumulated.
+ *
+ * @param str the string whose head begins a literal
+ * @param hex whether the literal is hexadecimal, beginning with "0x" or "0X"
+ * @return the length of the literal, or zero if the string does not begin with
+ *      a literal
+ */
+static unsigned int measure ( const char * str, bool hex )
+{
+    const char * digits = hex ? str + 2 : str;
+    const char * head = skip_digits ( digits, hex );
+    bool any = head != digits;
+    int exponent = 0;
+
+    if ( *head == '.' ) {
+        digits = head + 1;
+        head = skip_digits ( digits, hex );
+        any |= head != digits;
+    }
+
+    if ( !any )
+        return 0;
+
+    head = scan_exponent ( head, hex ? "pP" : "eE", &exponent );
+    return ( unsigned int ) ( head - str );
+}
+
+unsigned int scan_number ( const char * str, number_t * value )
+{
+    /* A prefix without any hexadecimal digits is just a zero, followed by
+     * some other token. */
+    const bool hex = str [ 0 ] == '0' && ( str [ 1 ] == 'x' ||
+        str [ 1 ] == 'X' ) && ( hex_value ( str [ 2 ] ) < 16 ||
+        ( str [ 2 ] == '.' && hex_value ( str [ 3 ] ) < 16 ) );
+
+    if ( !value )
+        return measure ( str, hex );
+
+    return hex ? scan_hex ( str, value ) : scan_decimal ( str, value );
+}
@@ -0,0 +1,39 @@
+/**
+ * This interface exposes a dedicated scanner for numeric literals, used by the
+ * tokeniser in place of strtof(3). It accepts unsigned decimal literals, with
+ * an optional fractional part and decimal exponent ("12", "1.5", ".5e-3"), and
+ * hexadecimal floating-point literals ("0x1.8p3"). Signs, white-space, and the
+ * special values (infinities and NaNs) are not accepted: these are the business
+ * of the tokeniser.
+ *
+ * The scanner is locale-independent: the decimal point is always '.'. Values
+ * are correctly rounded to the nearest number of the configured type (see
+ * 'number.h'); the common cases are handled in-line, and the rare cases that
+ * cannot be rounded correctly without arbitrary-precision arithmetic are
+ * deferred to the C library. Fixed-point literals are rounded with exact
+ * integer arithmetic, which only defers to the C library when significant
+ * digits lie beyond the capacity of the mantissa.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "node.h"
+
+/**
+ * Scan a numeric literal from the head of the given string.
+ *
+ * @param str the string whose head begins a literal
+ * @param value the destination of the scanned value; this is only written if
+ *      the scan succeeds. If this is NULL, the literal is only measured, and
+ *      is not converted, so its range is not checked.
+ * @return the number of bytes occupied by the literal, or zero if the string
+ *      does not begin with a literal, or the literal is out of range. In
+ *      fixed point, no literal is out of range: those beyond the range
+ *      saturate to NUMBER_MAX, as do the results of operations.
+ */
+unsigned int scan_number ( const char * str, number_t * value );
+
+#endif /* SCAN_H */
@@ -7,8 +7,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "debug.h"
+#include "alloc.h"
+#include "stats.h"
 #include "stack.h"
 
 /**
@@ -26,11 +29,47 @@ struct stack {
     unsigned int size;
 
     /**
-     * The stack contents
+     * The kinds of the nodes
      */
-    void ** data;
+    node_kind_t * kinds;
+
+    /**
+     * The data of the nodes
+     */
+    union node_datum * data;
+
+    /**
+     * The allocator of the stack, and of its spilled nodes
+     */
+    const struct allocator * allocator;
+
+    /**
+     * Whether the stack was allocated by 'stack_initialise', rather than
+     * placed in storage by the caller
+     */
+    bool owned;
+
+    /**
+     * The in-line data and kinds, used until the stack spills to the heap
+     */
+    union node_datum inline_data [ STACK_INLINE_CAPACITY ];
+    node_kind_t inline_kinds [ STACK_INLINE_CAPACITY ];
 };
 
+_Static_assert ( sizeof ( struct stack ) <= sizeof ( struct stack_storage ),
+    "A stack must fit within its storage" );
+
+/**
+ * Are the nodes of the stack held in-line?
+ *
+ * @param self the stack
+ * @return the location of the nodes
+ */
+static inline bool is_inline ( struct stack * self )
+{
+    return self->kinds == self->inline_kinds;
+}
+
 /**
  * Is the stack empty?
  *
@@ -42,6 +81,42 @@ static inline bool is_empty ( struct stack * self )
     return !self->size;
 }
 
+/**
+ * Move the nodes of the stack to new heap arrays of the given capacity, which
+ * is no less than the size of the stack.
+ *
+ * @param self the stack
+ * @param capacity the new capacity
+ * @return the ability to allocate the arrays
+ */
+static bool spill ( struct stack * self, unsigned int capacity )
+{
+    node_kind_t * new_kinds = allocator_alloc ( self->allocator,
+        sizeof ( node_kind_t ) * capacity );
+    union node_datum * new_data = allocator_alloc ( self->allocator,
+        sizeof ( union node_datum ) * capacity );
+
+    if ( !new_kinds || !new_data ) {
+        if ( new_data )
+            allocator_free ( self->allocator, new_data,
+                sizeof ( union node_datum ) * capacity );
+        if ( new_kinds )
+            allocator_free ( self->allocator, new_kinds,
+                sizeof ( node_kind_t ) * capacity );
+        return false;
+    }
+
+    memcpy ( new_kinds, self->kinds, sizeof ( node_kind_t ) * self->size );
+    memcpy ( new_data, self->data, sizeof ( union node_datum ) * self->size );
+
+    self->kinds = new_kinds;
+    self->data = new_data;
+    self->capacity = capacity;
+    debug_puts ( "Stack spilled to the heap" );
+
+    return true;
+}
+
 /**
  * Determine whether the given stack capacity must be increased to accommodate a
  * new (unseen) node. If the current capacity is insufficient, its size is
@@ -52,11 +127,27 @@ static inline bool is_empty ( struct stack * self )
  */
 static bool realloc_check ( struct stack * self )
 {
-    void ** new_data;
+    node_kind_t * new_kinds;
+    union node_datum * new_data;
 
     if ( self->size + 1 >= self->capacity ) {
-        if ( ! ( new_data = realloc ( self->data, sizeof ( void * ) *
-                ( self->capacity << 1 ) ) ) )
+        stats_count ( growths, 1 );
+
+        if ( is_inline ( self ) )
+            return spill ( self, self->capacity << 1 );
+
+        if ( ! ( new_kinds = allocator_realloc ( self->allocator, self->kinds,
+                sizeof ( node_kind_t ) * self->capacity,
+                sizeof ( node_kind_t ) * ( self->capacity << 1 ) ) ) )
+            return false;
+
+        self->kinds = new_kinds;
+
+        /* The kinds are grown first, and a failure to grow the data leaves
+         * them merely larger than their capacity */
+        if ( ! ( new_data = allocator_realloc ( self->allocator, self->data,
+                sizeof ( union node_datum ) * self->capacity,
+                sizeof ( union node_datum ) * ( self->capacity << 1 ) ) ) )
             return false;
 
         self->data = new_data;
@@ -66,24 +157,40 @@ static bool realloc_check ( struct stack * self )
     return true;
 }
 
-struct stack * stack_initialise ( unsigned int capacity )
+struct stack * stack_initialise_in ( struct stack_storage * storage,
+        unsigned int capacity, const struct allocator * allocator )
 {
-    const unsigned int DEFAULT_CAPACITY = 16;
-    struct stack * self;
-
-    if ( !capacity )
-        capacity = DEFAULT_CAPACITY;
-
-    if ( ( self = malloc ( sizeof ( struct stack ) ) ) )
-        if ( ! ( self->data = malloc ( sizeof ( void * ) *
-                capacity ) ) ) {
-            free ( self );
-            self = NULL;
-        } else {
-            self->capacity = capacity;
-            self->size = 0;
-            debug_puts ( "Stack initialised" );
-        }
+    struct stack * self = ( void * ) storage;
+
+    self->allocator = allocator_resolve ( allocator );
+    self->kinds = self->inline_kinds;
+    self->data = self->inline_data;
+    self->capacity = STACK_INLINE_CAPACITY;
+    self->size = 0;
+    self->owned = false;
+
+    if ( capacity > STACK_INLINE_CAPACITY && !spill ( self, capacity ) )
+        return NULL;
+
+    debug_puts ( "Stack initialised" );
+    return self;
+}
+
+struct stack * stack_initialise ( unsigned int capacity,
+        const struct allocator * allocator )
+{
+    struct stack_storage * storage;
+    struct stack * self = NULL;
+
+    allocator = allocator_resolve ( allocator );
+
+    if ( ( storage = allocator_alloc ( allocator,
+            sizeof ( struct stack_storage ) ) ) &&
+            ! ( self = stack_initialise_in ( storage, capacity, allocator ) ) )
+        allocator_free ( allocator, storage, sizeof ( struct stack_storage ) );
+
+    if ( self )
+        self->owned = true;
 
     return self;
 }
@@ -91,33 +198,66 @@ struct stack * stack_initialise ( unsigned int capacity )
 void stack_destruct ( struct stack * self )
 {
     if ( self ) {
-        free ( self->data );
-        free ( self );
+        if ( !is_inline ( self ) ) {
+            allocator_free ( self->allocator, self->data,
+                sizeof ( union node_datum ) * self->capacity );
+            allocator_free ( self->allocator, self->kinds,
+                sizeof ( node_kind_t ) * self->capacity );
+        }
+
+        if ( self->owned )
+            allocator_free ( self->allocator, self,
+                sizeof ( struct stack_storage ) );
+
         debug_puts ( "Stack destructed" );
     }
 }
 
-void * stack_pop ( struct stack * self )
+node_kind_t stack_pop ( struct stack * self )
 {
-    return ( is_empty ( self ) ) ? NULL : self->data [ --self->size ];
+    return ( is_empty ( self ) ) ? 0 : self->kinds [ --self->size ];
 }
 
-void * stack_peek ( struct stack * self )
+node_kind_t stack_peek ( struct stack * self )
 {
-    return ( is_empty ( self ) ) ? NULL : self->data [ self->size - 1 ];
+    return ( is_empty ( self ) ) ? 0 : self->kinds [ self->size - 1 ];
 }
 
-void * stack_push ( struct stack * self, void * node )
+bool stack_push ( struct stack * self, node_kind_t kind,
+        union node_datum datum )
 {
     if ( !realloc_check ( self ) )
-        return NULL;
+        return false;
 
-    self->data [ self->size++ ] = node;
-    return node;
+    self->kinds [ self->size ] = kind;
+    self->data [ self->size++ ] = datum;
+    stats_peak ( self->size );
+
+    return true;
+}
+
+void stack_clear ( struct stack * self )
+{
+    self->size = 0;
+}
+
+unsigned int stack_size ( struct stack * self )
+{
+    return self->size;
+}
+
+const node_kind_t * stack_kinds ( struct stack * self )
+{
+    return self->kinds;
+}
+
+const union node_datum * stack_data ( struct stack * self )
+{
+    return self->data;
 }
 
-void stack_print ( struct stack * self, char * ( * printer ) ( void *,
-        char *, unsigned int ) )
+void stack_print ( struct stack * self, char * ( * printer ) ( node_kind_t,
+        union node_datum, char *, unsigned int ) )
 {
     const unsigned int BUFFER_SIZE = 20;
     char buffer [ BUFFER_SIZE ];
@@ -131,8 +271,8 @@ void stack_print ( struct stack * self, char * ( * printer ) ( void *,
         puts ( "Stack Contents: ...\n" );
         for ( unsigned int i = self->size; i != 0; i-- )
             printf ( "\t%d\t%s\n", i - 1,
-                ( printer ( self->data [ i - 1 ], buffer,
-                    BUFFER_SIZE ) )
+                ( printer ( self->kinds [ i - 1 ], self->data [ i - 1 ],
+                    buffer, BUFFER_SIZE ) )
                 ? buffer : "Formatting Error" );
     }
 }
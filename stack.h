@@ -1,6 +1,17 @@
 /**
- * This interface exposes an abstract stack, used for storing generic pointers
- * in the canonical LIFO ADT form.
+ * This interface exposes a stack of nodes, in the canonical LIFO ADT form. The
+ * nodes are stored by value, and by column: the kind of each node (its type and
+ * operator) is a byte in one packed array, and the datum of each node (its
+ * value or slot) lies in a separate array. A stack therefore takes no pointers
+ * into a node pool, and a walk over its kinds, such as the dispatch loop of an
+ * evaluator, reads one contiguous run of bytes.
+ *
+ * The first STACK_INLINE_CAPACITY nodes are held in-line, within the stack
+ * itself, and only a deeper stack spills its nodes to the heap. A stack may
+ * also be placed in storage provided by the caller (see 'struct
+ * stack_storage'), such as a member of another object or an automatic
+ * variable, so that a shallow stack makes no calls to the dynamic allocator at
+ * all.
  *
  * @author Oliver Dixon
  */
@@ -8,61 +19,139 @@
 #ifndef STACK_H
 #define STACK_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "node.h"
+#include "alloc.h"
+
+/**
+ * The number of nodes held in-line by every stack
+ */
+#define STACK_INLINE_CAPACITY 32
+
 /**
  * The base opaque type of a stack
  */
 struct stack;
 
+/**
+ * Storage, of a fixed size, in which a stack may be placed by the caller. Its
+ * contents are private to the stack.
+ */
+struct stack_storage {
+    /* The header, with room for its padding, and then the in-line nodes */
+    _Alignas ( max_align_t ) unsigned char bytes [ 3 * sizeof ( void * ) +
+        2 * sizeof ( unsigned int ) + sizeof ( union node_datum ) +
+        STACK_INLINE_CAPACITY * ( sizeof ( union node_datum ) +
+        sizeof ( node_kind_t ) ) ];
+};
+
 /**
  * Initialise and return a stack, with the given initial capacity.
  *
  * @param capacity the initial capacity
+ * @param allocator the allocator of the stack, or NULL for the standard
+ *      allocator (see 'alloc.h'); it must outlive the stack
  * @return the new stack
  */
-struct stack * stack_initialise ( unsigned int capacity );
+struct stack * stack_initialise ( unsigned int capacity,
+    const struct allocator * allocator );
 
 /**
- * Destroy a stack; its data is unchanged.
+ * Initialise and return a stack, with the given initial capacity, within the
+ * given storage. The stack only calls the dynamic allocator if its capacity
+ * exceeds STACK_INLINE_CAPACITY, so this cannot fail for a lesser capacity.
+ *
+ * @param storage the storage, which must outlive the stack
+ * @param capacity the initial capacity
+ * @param allocator the allocator of any nodes that spill from the storage, or
+ *      NULL for the standard allocator; it must outlive the stack
+ * @return the new stack, or NULL on failure
+ */
+struct stack * stack_initialise_in ( struct stack_storage * storage,
+    unsigned int capacity, const struct allocator * allocator );
+
+/**
+ * Destroy a stack. The storage of a stack initialised with
+ * 'stack_initialise_in' is not freed, but any nodes that spilled from it are.
  *
  * @param self the stack
  */
 void stack_destruct ( struct stack * self );
 
 /**
- * Remove and return the top element from the given stack.
+ * Remove the top node from the given stack, and return its kind.
  *
  * @param self the stack
- * @return the topmost element, or NULL if the stack is empty
+ * @return the kind of the topmost node, or zero if the stack is empty
  */
-void * stack_pop ( struct stack * self );
+node_kind_t stack_pop ( struct stack * self );
 
 /**
- * Return the top element from the given stack.
+ * Return the kind of the top node of the given stack.
  *
  * @param self the stack
- * @return the topmost element, or NULL if the stack is empty
+ * @return the kind of the topmost node, or zero if the stack is empty
  */
-void * stack_peek ( struct stack * self );
+node_kind_t stack_peek ( struct stack * self );
 
 /**
- * Push a given element to the given stack.
+ * Push a node, given by its kind and datum, to the given stack.
  *
  * @param self the stack
- * @param node the source node
- * @return the pushed node, or NULL if the stack is incapable of accommodating
+ * @param kind the kind of the node, which is not zero
+ * @param datum the datum of the node
+ * @return true on success, or false if the stack is incapable of accommodating
  *      more data
  */
-void * stack_push ( struct stack * self, void * node );
+bool stack_push ( struct stack * self, node_kind_t kind,
+    union node_datum datum );
+
+/**
+ * Remove every element from the given stack. Its capacity is retained, so that
+ * the stack may be refilled without reallocation.
+ *
+ * @param self the stack
+ */
+void stack_clear ( struct stack * self );
+
+/**
+ * Return the number of elements currently held by the given stack.
+ *
+ * @param self the stack
+ * @return the stack size
+ */
+unsigned int stack_size ( struct stack * self );
+
+/**
+ * Return the kinds of the nodes of the given stack, from the bottom of the
+ * stack. This permits a caller to walk the stack in insertion order. The
+ * array is only valid until the stack is next changed.
+ *
+ * @param self the stack
+ * @return the array of 'stack_size' kinds
+ */
+const node_kind_t * stack_kinds ( struct stack * self );
+
+/**
+ * Return the data of the nodes of the given stack, in the order of their kinds
+ * (see 'stack_kinds'). The datum of a node that has none is unspecified.
+ *
+ * @param self the stack
+ * @return the array of 'stack_size' data
+ */
+const union node_datum * stack_data ( struct stack * self );
 
 /**
  * Print the contents of the stack to the standard output
  *
  * @param self the stack
  * @param printer a function to parse all stack nodes into a fixed-size string
- *      buffer, given a node, buffer, and buffer capacity
+ *      buffer, given the kind and datum of a node, a buffer, and the buffer
+ *      capacity
  */
-void stack_print ( struct stack * self, char * ( * printer ) ( void *, char *,
-    unsigned int ) );
+void stack_print ( struct stack * self, char * ( * printer ) ( node_kind_t,
+    union node_datum, char *, unsigned int ) );
 
 #endif /* STACK_H */
-
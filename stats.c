@@ -0,0 +1,167 @@
+/**
+ * Implement the performance-counting interface; see 'stats.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+#ifdef STATS_ENABLED
+
+_Thread_local struct stats stats_local;
+
+/**
+ * The counters folded in from every thread, and their lock
+ */
+static struct stats total;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Add one set of counters to another.
+ *
+ * @param self the destination counters
+ * @param other the counters to be added
+ */
+static void accumulate ( struct stats * self, const struct stats * other )
+{
+    for ( unsigned int i = 0; i < STATS_STAGE_COUNT; i++ ) {
+        self->stages [ i ].calls += other->stages [ i ].calls;
+        self->stages [ i ].nanoseconds += other->stages [ i ].nanoseconds;
+        self->stages [ i ].cycles += other->stages [ i ].cycles;
+    }
+
+    self->tokens += other->tokens;
+    self->nodes += other->nodes;
+    self->growths += other->growths;
+
+    if ( other->peak_depth > self->peak_depth )
+        self->peak_depth = other->peak_depth;
+}
+
+struct stats_mark stats_now ( void )
+{
+    struct timespec ts;
+    struct stats_mark mark = { 0, 0 };
+
+    if ( !clock_gettime ( CLOCK_MONOTONIC, &ts ) )
+        mark.nanoseconds = ( uint64_t ) ts.tv_sec * 1000000000U +
+            ( uint64_t ) ts.tv_nsec;
+
+#if defined __x86_64__ || defined __i386__
+    mark.cycles = __builtin_ia32_rdtsc ( );
+#endif
+
+    return mark;
+}
+
+void stats_record ( enum stats_stage stage, const struct stats_mark * mark )
+{
+    const struct stats_mark now = stats_now ( );
+    struct stats_timer * timer = & ( stats_local.stages [ stage ] );
+
+    timer->calls++;
+    timer->nanoseconds += now.nanoseconds - mark->nanoseconds;
+    timer->cycles += now.cycles - mark->cycles;
+}
+
+bool stats_enabled ( void )
+{
+    return true;
+}
+
+void stats_flush ( void )
+{
+    pthread_mutex_lock ( &total_lock );
+    accumulate ( &total, &stats_local );
+    pthread_mutex_unlock ( &total_lock );
+
+    memset ( &stats_local, 0, sizeof ( stats_local ) );
+}
+
+void stats_read ( struct stats * out )
+{
+    pthread_mutex_lock ( &total_lock );
+    *out = total;
+    pthread_mutex_unlock ( &total_lock );
+
+    accumulate ( out, &stats_local );
+}
+
+void stats_reset ( void )
+{
+    pthread_mutex_lock ( &total_lock );
+    memset ( &total, 0, sizeof ( total ) );
+    pthread_mutex_unlock ( &total_lock );
+
+    memset ( &stats_local, 0, sizeof ( stats_local ) );
+}
+
+#else
+
+bool stats_enabled ( void )
+{
+    return false;
+}
+
+void stats_flush ( void )
+{
+}
+
+void stats_read ( struct stats * out )
+{
+    memset ( out, 0, sizeof ( *out ) );
+}
+
+void stats_reset ( void )
+{
+}
+
+#endif /* STATS_ENABLED */
+
+const char * stats_stage_str ( enum stats_stage stage )
+{
+    switch ( stage ) {
+        case STATS_TOKENISE: return "tokenise";
+        case STATS_POSTFIX:  return "postfix";
+        case STATS_PARSE:    return "parse (fused)";
+        case STATS_OPTIMISE: return "optimise";
+        case STATS_EVALUATE: return "evaluate";
+
+        case STATS_STAGE_COUNT:
+        default: return "unknown";
+    }
+}
+
+void stats_print ( const struct stats * self, FILE * stream )
+{
+    const struct stats_timer * timer;
+
+    fprintf ( stream, "%-14s %12s %14s %10s %12s\n", "stage", "calls",
+        "total ns", "ns/call", "cycles/call" );
+
+    for ( unsigned int i = 0; i < STATS_STAGE_COUNT; i++ ) {
+        timer = & ( self->stages [ i ] );
+
+        fprintf ( stream, "%-14s %12llu %14llu %10.1f %12.1f\n",
+            stats_stage_str ( ( enum stats_stage ) i ),
+            ( unsigned long long ) timer->calls,
+            ( unsigned long long ) timer->nanoseconds,
+            timer->calls ? ( double ) timer->nanoseconds /
+                ( double ) timer->calls : 0.0,
+            timer->calls ? ( double ) timer->cycles /
+                ( double ) timer->calls : 0.0 );
+    }
+
+    fprintf ( stream, "tokens: %llu, nodes: %llu, growths: %llu, "
+        "peak stack depth: %llu\n", ( unsigned long long ) self->tokens,
+        ( unsigned long long ) self->nodes,
+        ( unsigned long long ) self->growths,
+        ( unsigned long long ) self->peak_depth );
+}
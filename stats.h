@@ -0,0 +1,171 @@
+/**
+ * A performance-counting interface, exposing per-stage timers and counters for
+ * the parsing and evaluation of expressions. Each stage (tokenisation,
+ * conversion to postfix, the fused parser, optimisation, and evaluation) is
+ * timed in nanoseconds and, on x86, in cycles of the time-stamp counter; the
+ * number of tokens scanned, of nodes taken from pools, of growths of stacks
+ * and token lists, and the peak depth of any stack are also counted.
+ *
+ * The instrumentation is compiled only when STATS_ENABLED is defined (see the
+ * "release-stats" target of the Makefile). Otherwise, the macros below are
+ * no-ops, and the functions report nothing.
+ *
+ * The counters are thread-local, so counting never contends. Each thread folds
+ * its counters into a process-wide total with 'stats_flush' before it exits;
+ * 'stats_read' then reports that total, together with the counters of the
+ * calling thread.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * The timed stages
+ */
+enum stats_stage {
+    STATS_TOKENISE,
+    STATS_POSTFIX,
+    STATS_PARSE,
+    STATS_OPTIMISE,
+    STATS_EVALUATE,
+
+    STATS_STAGE_COUNT
+};
+
+/**
+ * The time spent in one stage
+ */
+struct stats_timer {
+    /**
+     * The number of times the stage was entered
+     */
+    uint64_t calls;
+
+    /**
+     * The total time spent in the stage, in nanoseconds, and in cycles of the
+     * time-stamp counter (or zero, where there is none)
+     */
+    uint64_t nanoseconds;
+    uint64_t cycles;
+};
+
+/**
+ * A set of counters
+ */
+struct stats {
+    /**
+     * The timers of each stage
+     */
+    struct stats_timer stages [ STATS_STAGE_COUNT ];
+
+    /**
+     * The number of tokens scanned, of nodes taken from pools, and of growths
+     * of stacks and token lists
+     */
+    uint64_t tokens;
+    uint64_t nodes;
+    uint64_t growths;
+
+    /**
+     * The greatest number of nodes held by any stack
+     */
+    uint64_t peak_depth;
+};
+
+/**
+ * A point in time, from which a stage is timed
+ */
+struct stats_mark {
+    uint64_t nanoseconds;
+    uint64_t cycles;
+};
+
+#ifdef STATS_ENABLED
+
+/**
+ * The counters of the calling thread
+ */
+extern _Thread_local struct stats stats_local;
+
+/**
+ * Take the current time.
+ *
+ * @return the current time
+ */
+struct stats_mark stats_now ( void );
+
+/**
+ * Charge the time since the given mark to a stage.
+ *
+ * @param stage the stage
+ * @param mark the time at which the stage was entered
+ */
+void stats_record ( enum stats_stage stage, const struct stats_mark * mark );
+
+#    define stats_count(counter, n) \
+        ( stats_local.counter += ( n ) )
+#    define stats_peak(depth)                          \
+        do {                                           \
+            if ( ( depth ) > stats_local.peak_depth )  \
+                stats_local.peak_depth = ( depth );    \
+        } while ( 0 )
+#    define stats_start(mark) \
+        const struct stats_mark mark = stats_now ( )
+#    define stats_stop(stage, mark) \
+        stats_record ( ( stage ), & ( mark ) )
+#else
+#    define stats_count(counter, n)
+#    define stats_peak(depth)
+#    define stats_start(mark)
+#    define stats_stop(stage, mark)
+#endif
+
+/**
+ * Determine whether the instrumentation was compiled.
+ *
+ * @return true if the counters are maintained, or false
+ */
+bool stats_enabled ( void );
+
+/**
+ * Fold the counters of the calling thread into the process-wide total, and
+ * clear them. A thread that counts should call this before it exits.
+ */
+void stats_flush ( void );
+
+/**
+ * Read the process-wide total, together with the counters of the calling
+ * thread.
+ *
+ * @param out the destination of the counters
+ */
+void stats_read ( struct stats * out );
+
+/**
+ * Clear the process-wide total, and the counters of the calling thread.
+ */
+void stats_reset ( void );
+
+/**
+ * Retrieve a human-readable name for the given stage.
+ *
+ * @param stage the stage
+ * @return the name of the stage
+ */
+const char * stats_stage_str ( enum stats_stage stage );
+
+/**
+ * Print a human-readable report of the given counters.
+ *
+ * @param self the counters
+ * @param stream the destination stream
+ */
+void stats_print ( const struct stats * self, FILE * stream );
+
+#endif /* STATS_H */
@@ -1,41 +1,64 @@
 /**
  * This is the primary testing driver of the calculator demonstration. As the
  * testing routines evolve into the full calculator, this will become the
- * standard entry point.
+ * standard entry point. It is invoked either with a single expression, or with
+ * the "-b" flag and an optional file name, in which case every line of the file
+ * (or of the standard input, if no file is named) is evaluated. In the latter
+ * case, these options may follow "-b":
+ *
+ *  - "-j N": use N threads, rather than one per processor; and
+ *
+ *  - "-c BYTES": give each thread a cache of compiled programs, bounded by the
+ *    given number of bytes, so that repeated lines are not parsed again.
+ *
+ * In either case, these flags may lead:
+ *
+ *  - "--stats": print the per-stage timers and counters of 'stats.h' to the
+ *    standard error once the work is done. These are only maintained in builds
+ *    with STATS_ENABLED defined; and
+ *
+ *  - "--trace[=LEVEL]": trace the Shunting Yard at the given level of
+ *    'trace.h' ("tokens", "decisions", or "all", the default), and dump the
+ *    trace of the main thread to the standard error once the work is done. In
+ *    batch mode, "-j 1" keeps every line on the main thread.
  *
  * @author Oliver Dixon
  */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "node.h"
 #include "expr.h"
+#include "batch.h"
+#include "stats.h"
+#include "trace.h"
 
 /**
  * A wrapper to test all aspects of the Expression interface, including
- * initialisation, tokenisation, and conversion. A single pool is supported, and
- * any errors are printed directly to stderr.
+ * initialisation, tokenisation, conversion, and evaluation. Any errors are
+ * printed directly to stderr. The expression and its pool are placed in a
+ * scratch context on the stack, so a short expression is evaluated without
+ * calling the dynamic allocator.
  *
- * @param pool the node pool
  * @param expr_str the string-infix representation of the expression
  * @return zero on success, -1 on error
  */
-static int test_expression ( struct node_pool * pool, const char * expr_str )
+static int test_expression ( const char * expr_str )
 {
-    struct expression * expr;
-    enum expr_status status = EXPR_OK;
-
-    if ( ! ( expr = expression_initialise ( expr_str, 0 ) ) )
+    struct expression_scratch scratch;
+    struct node_pool * pool;
+    struct expression * expr = expression_scratch_initialise ( &scratch,
+        expr_str, &pool, NULL );
+    enum expr_status status;
+    char buffer [ NUMBER_FORMAT_SIZE ];
+    number_t result;
 
-        /* Do not use 'expression_perror' here, since we do not have a
-         * function expression object on which the method can be called.
-         * Furthermore, 'errno' is well-defined to be set upon failure
-         * of 'expression_initialise'. */
-        perror ( "Could not initialise the expression" );
-
-    else if ( ( status = expression_tokenise ( expr, &pool, 1 ) )
-            != EXPR_OK )
+    if ( ( status = expression_tokenise ( expr, pool ) ) != EXPR_OK )
 
         expression_perror ( expr, "Could not tokenise the expression",
             status );
@@ -45,24 +68,142 @@ static int test_expression ( struct node_pool * pool, const char * expr_str )
         expression_perror ( expr, "Could not convert the expression " \
             "to an equivalent postfix form", status );
 
+    else if ( ( status = expression_evaluate ( expr, &result ) ) != EXPR_OK )
+
+        expression_perror ( expr, "Could not evaluate the expression",
+            status );
+
+    else {
+        number_format ( buffer, sizeof ( buffer ), result );
+        puts ( buffer );
+    }
+
     expression_destruct ( expr );
-    return ( expr && status == EXPR_OK ) ? 0 : -1;
+    pool_destruct ( pool );
+    return ( status == EXPR_OK ) ? 0 : -1;
+}
+
+/**
+ * Evaluate every line of the named file, or of the standard input, writing the
+ * results to the standard output.
+ *
+ * @param path the name of the file, or NULL for the standard input
+ * @param workers the number of threads, or zero for one per processor
+ * @param cache the budget of the cache of each thread, or zero for none
+ * @return zero if every line was evaluated, -1 otherwise
+ */
+static int test_batch ( const char * path, unsigned int workers,
+        size_t cache )
+{
+    unsigned long failures = 0;
+    int fd = STDIN_FILENO, status;
+
+    if ( path && ( fd = open ( path, O_RDONLY ) ) == -1 ) {
+        perror ( "Could not open the input" );
+        return -1;
+    }
+
+    if ( ( status = batch_run ( fd, STDOUT_FILENO, workers, cache,
+            &failures ) ) == -1 )
+        perror ( "Could not complete the batch" );
+    else if ( failures )
+        fprintf ( stderr, "%lu expression(s) could not be evaluated.\n",
+            failures );
+
+    if ( path )
+        close ( fd );
+
+    return ( status == -1 || failures ) ? -1 : 0;
+}
+
+/**
+ * Select the level of tracing named by a "--trace" flag.
+ *
+ * @param flag the flag
+ * @return zero on success, -1 if the level was unknown or could not be set
+ */
+static int test_trace ( const char * flag )
+{
+    enum trace_level level = TRACE_ALL;
+
+    if ( flag [ 7 ] == '=' )
+        for ( level = TRACE_OFF; level < TRACE_LEVEL_COUNT &&
+                strcmp ( flag + 8, trace_level_str ( level ) ); level++ )
+            ;
+
+    if ( level == TRACE_LEVEL_COUNT ) {
+        fprintf ( stderr, "Unknown trace level \"%s\".\n", flag + 8 );
+        return -1;
+    }
+
+    if ( !trace_set_level ( level ) ) {
+        fputs ( "Tracing was not compiled in; rebuild without " \
+            "TRACE_DISABLED defined.\n", stderr );
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Print the counters gathered by every thread to the standard error.
+ */
+static void test_report ( void )
+{
+    struct stats stats;
+
+    if ( !stats_enabled ( ) ) {
+        fputs ( "Statistics were not compiled in; rebuild with " \
+            "STATS_ENABLED defined (e.g. \"make release-stats\").\n",
+            stderr );
+        return;
+    }
+
+    stats_read ( &stats );
+    stats_print ( &stats, stderr );
 }
 
 int main ( int argc, char ** argv )
 {
-    struct node_pool * pool = NULL;
-    int status = EXIT_SUCCESS;
+    int status = EXIT_SUCCESS, arg = 2;
+    unsigned int workers = 0;
+    size_t cache = 0;
+    bool report = false, trace = false;
+
+    for ( ; argc >= 2 && !strncmp ( argv [ 1 ], "--", 2 ); argc--, argv++ )
+        if ( !strcmp ( argv [ 1 ], "--stats" ) )
+            report = true;
+        else if ( !strncmp ( argv [ 1 ], "--trace", 7 ) &&
+                ( argv [ 1 ] [ 7 ] == '\0' || argv [ 1 ] [ 7 ] == '=' ) ) {
+            if ( test_trace ( argv [ 1 ] ) )
+                return EXIT_FAILURE;
+            trace = true;
+        } else
+            break;
+
+    if ( argc >= 2 && !strcmp ( argv [ 1 ], "-b" ) ) {
+        for ( ; arg + 1 < argc; arg += 2 )
+            if ( !strcmp ( argv [ arg ], "-j" ) )
+                workers = ( unsigned int ) strtoul ( argv [ arg + 1 ], NULL,
+                    10 );
+            else if ( !strcmp ( argv [ arg ], "-c" ) )
+                cache = ( size_t ) strtoull ( argv [ arg + 1 ], NULL, 10 );
+            else
+                break;
 
-    if ( argc < 2 ) {
+        status = ( test_batch ( argv [ arg ], workers, cache ) == -1 ) ?
+            EXIT_FAILURE : EXIT_SUCCESS;
+    } else if ( argc < 2 ) {
         fputs ( "No expression provided!\n", stderr );
         status = EXIT_FAILURE;
-    } else if ( ! ( pool = pool_initialise ( 0 ) ) ) {
-        perror ( "Could not initialise the node pool" );
-        status = EXIT_FAILURE;
-    } else if ( test_expression ( pool, argv [ 1 ] ) == -1 )
+    } else if ( test_expression ( argv [ 1 ] ) == -1 )
         status = EXIT_FAILURE;
 
+    if ( report )
+        test_report ( );
+    if ( trace )
+        trace_dump ( stderr );
+
     return status;
 }
 
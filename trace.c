@@ -0,0 +1,170 @@
+/**
+ * Implement the tracing interface; see 'trace.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "node.h"
+#include "trace.h"
+
+_Static_assert ( ( TRACE_CAPACITY & ( TRACE_CAPACITY - 1 ) ) == 0,
+    "The capacity of a trace ring must be a power of two" );
+
+#ifndef TRACE_DISABLED
+
+enum trace_level trace_threshold = TRACE_OFF;
+
+/**
+ * The ring of the calling thread, and the number of events ever recorded in
+ * it, of which only the last 'TRACE_CAPACITY' are retained
+ */
+static _Thread_local struct trace_event ring [ TRACE_CAPACITY ];
+static _Thread_local unsigned long recorded;
+
+void trace_record ( struct trace_event event )
+{
+    ring [ recorded++ & ( TRACE_CAPACITY - 1 ) ] = event;
+}
+
+bool trace_set_level ( enum trace_level level )
+{
+    trace_threshold = level;
+    return true;
+}
+
+void trace_clear ( void )
+{
+    recorded = 0;
+}
+
+/**
+ * Retrieve a human-readable name for the given precedence decision.
+ *
+ * @param prec the decision
+ * @return the name of the decision
+ */
+static const char * prec_str ( enum node_precedence prec )
+{
+    switch ( prec ) {
+        case NODE_PREC_GREATER: return "greater";
+        case NODE_PREC_LESSER:  return "lesser";
+        case NODE_PREC_SAME:    return "same";
+        case NODE_PREC_LASSOC:  return "same, left-associative";
+
+        default: return "unknown";
+    }
+}
+
+/**
+ * Retrieve a human-readable name for the given stack.
+ *
+ * @param stack the stack
+ * @return the name of the stack
+ */
+static const char * stack_str ( enum trace_stack stack )
+{
+    switch ( stack ) {
+        case TRACE_OPERATORS: return "operators";
+        case TRACE_OUTPUT:    return "output";
+
+        default: return "unknown";
+    }
+}
+
+/**
+ * Format and print a single event.
+ *
+ * @param event the event
+ * @param seq the sequence number of the event
+ * @param stream the destination stream
+ */
+static void print_event ( const struct trace_event * event, unsigned long seq,
+        FILE * stream )
+{
+    char node [ 64 ], other [ 64 ];
+
+    if ( !node_format ( event->kind, event->datum, node, sizeof ( node ) ) )
+        node [ 0 ] = '\0';
+
+    switch ( ( enum trace_type ) event->type ) {
+        case TRACE_TOKEN:
+            fprintf ( stream, "%8lu token    %s at offset %lu\n", seq, node,
+                ( unsigned long ) event->arg );
+            break;
+
+        case TRACE_PUSH:
+            fprintf ( stream, "%8lu push     %s onto %s (depth %lu)\n", seq,
+                node, stack_str ( event->stack ),
+                ( unsigned long ) event->arg );
+            break;
+
+        case TRACE_POP:
+            fprintf ( stream, "%8lu pop      %s from %s (depth %lu)\n", seq,
+                node, stack_str ( event->stack ),
+                ( unsigned long ) event->arg );
+            break;
+
+        case TRACE_DECISION:
+            if ( !node_format ( event->other, NODE_NO_DATUM, other,
+                    sizeof ( other ) ) )
+                other [ 0 ] = '\0';
+
+            fprintf ( stream, "%8lu decide   %s against incoming %s: %s\n",
+                seq, node, other,
+                prec_str ( ( enum node_precedence ) event->arg ) );
+            break;
+
+        default:
+            fprintf ( stream, "%8lu unknown event\n", seq );
+            break;
+    }
+}
+
+void trace_dump ( FILE * stream )
+{
+    const unsigned long first = ( recorded > TRACE_CAPACITY ) ?
+        recorded - TRACE_CAPACITY : 0;
+
+    fprintf ( stream, "Trace of %lu event(s)", recorded );
+    if ( first )
+        fprintf ( stream, ", of which the oldest %lu were overwritten", first );
+    fputs ( ":\n", stream );
+
+    for ( unsigned long seq = first; seq < recorded; seq++ )
+        print_event ( &ring [ seq & ( TRACE_CAPACITY - 1 ) ], seq, stream );
+}
+
+#else
+
+bool trace_set_level ( enum trace_level level )
+{
+    return level == TRACE_OFF;
+}
+
+void trace_clear ( void )
+{
+}
+
+void trace_dump ( FILE * stream )
+{
+    fputs ( "Tracing was not compiled in.\n", stream );
+}
+
+#endif /* TRACE_DISABLED */
+
+const char * trace_level_str ( enum trace_level level )
+{
+    switch ( level ) {
+        case TRACE_OFF:       return "off";
+        case TRACE_TOKENS:    return "tokens";
+        case TRACE_DECISIONS: return "decisions";
+        case TRACE_ALL:       return "all";
+
+        case TRACE_LEVEL_COUNT:
+        default: return "unknown";
+    }
+}
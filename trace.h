@@ -0,0 +1,173 @@
+/**
+ * A tracing interface for the Shunting Yard, recording the tokens it consumes,
+ * the nodes it pushes and pops, and the precedence decisions it makes. Events
+ * are binary records, written to a fixed-size ring buffer per thread, so
+ * recording an event neither allocates nor formats, and never contends; once
+ * the ring is full, the oldest events are overwritten. Events are only
+ * formatted when the ring is dumped.
+ *
+ * Which events are recorded is selected at run-time by a level, which is off
+ * by default, so that an untraced build pays a single comparison per event
+ * site. A misbehaving expression may then be traced on demand (see the
+ * "--trace" flag of the calculator). The level is shared by every thread, and
+ * should be set before any thread begins tracing.
+ *
+ * Where even that comparison is unwanted, TRACE_DISABLED may be defined, in
+ * which case the macros below are no-ops, and the level cannot be raised.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "node.h"
+
+/**
+ * The number of events held by the ring of each thread, which must be a power
+ * of two
+ */
+#ifndef TRACE_CAPACITY
+#    define TRACE_CAPACITY 1024
+#endif
+
+/**
+ * The levels of tracing, in increasing verbosity; each records the events of
+ * those before it
+ */
+enum trace_level {
+    TRACE_OFF,       /* Record nothing                            */
+    TRACE_TOKENS,    /* Record each token reaching the Yard       */
+    TRACE_DECISIONS, /* Also record each precedence decision      */
+    TRACE_ALL,       /* Also record each push to and pop from a stack */
+
+    TRACE_LEVEL_COUNT
+};
+
+/**
+ * The types of event
+ */
+enum trace_type {
+    TRACE_TOKEN,
+    TRACE_PUSH,
+    TRACE_POP,
+    TRACE_DECISION,
+};
+
+/**
+ * The stacks of the Shunting Yard
+ */
+enum trace_stack {
+    TRACE_OPERATORS,
+    TRACE_OUTPUT,
+};
+
+/**
+ * An event, in binary form
+ */
+struct trace_event {
+    /**
+     * The datum of the node pushed, or of the token
+     */
+    union node_datum datum;
+
+    /**
+     * The offset of the token in its source, the depth of the stack after a
+     * push or pop, or the precedence ('enum node_precedence') decided
+     */
+    uint32_t arg;
+
+    /**
+     * The type of the event ('enum trace_type'), and the stack pushed or
+     * popped ('enum trace_stack')
+     */
+    unsigned char type;
+    unsigned char stack;
+
+    /**
+     * The kind of the node; for a decision, that of the operator on top of the
+     * operator stack, and of the incoming operator
+     */
+    node_kind_t kind;
+    node_kind_t other;
+};
+
+#ifndef TRACE_DISABLED
+
+/**
+ * The current level; see 'trace_set_level'
+ */
+extern enum trace_level trace_threshold;
+
+/**
+ * Record an event in the ring of the calling thread, regardless of the level.
+ *
+ * @param event the event
+ */
+void trace_record ( struct trace_event event );
+
+#    define trace_emit(level, ...)                  \
+        do {                                        \
+            if ( ( level ) <= trace_threshold )     \
+                trace_record ( __VA_ARGS__ );       \
+        } while ( 0 )
+#    define trace_token(offset_, kind_, datum_)                 \
+        trace_emit ( TRACE_TOKENS, ( struct trace_event ) {     \
+            .type = TRACE_TOKEN, .arg = ( uint32_t ) ( offset_ ), \
+            .kind = ( kind_ ), .datum = ( datum_ ) } )
+#    define trace_decision(top_, kind_, prec_)                  \
+        trace_emit ( TRACE_DECISIONS, ( struct trace_event ) {  \
+            .type = TRACE_DECISION, .arg = ( uint32_t ) ( prec_ ), \
+            .kind = ( top_ ), .other = ( kind_ ) } )
+#    define trace_push(stack_, kind_, datum_, depth_)           \
+        trace_emit ( TRACE_ALL, ( struct trace_event ) {        \
+            .type = TRACE_PUSH, .stack = ( stack_ ),            \
+            .arg = ( depth_ ), .kind = ( kind_ ), .datum = ( datum_ ) } )
+#    define trace_pop(stack_, kind_, depth_)                    \
+        trace_emit ( TRACE_ALL, ( struct trace_event ) {        \
+            .type = TRACE_POP, .stack = ( stack_ ),             \
+            .arg = ( depth_ ), .kind = ( kind_ ) } )
+#else
+#    define trace_emit(level, ...)
+#    define trace_token(offset_, kind_, datum_)
+#    define trace_decision(top_, kind_, prec_)
+#    define trace_push(stack_, kind_, datum_, depth_)
+#    define trace_pop(stack_, kind_, depth_)
+#endif
+
+/**
+ * Select which events are recorded by every thread.
+ *
+ * @param level the level
+ * @return true if the level was set, or false if tracing was compiled out and
+ *      the level was not TRACE_OFF
+ */
+bool trace_set_level ( enum trace_level level );
+
+/**
+ * Retrieve a human-readable name for the given level, as accepted by the
+ * calculator.
+ *
+ * @param level the level
+ * @return the name of the level
+ */
+const char * trace_level_str ( enum trace_level level );
+
+/**
+ * Discard the events in the ring of the calling thread.
+ */
+void trace_clear ( void );
+
+/**
+ * Format the events in the ring of the calling thread, oldest first, and
+ * print them to the given stream. The ring is left untouched.
+ *
+ * @param stream the destination stream
+ */
+void trace_dump ( FILE * stream );
+
+#endif /* TRACE_H */
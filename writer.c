@@ -0,0 +1,188 @@
+/**
+ * Implement the buffered writer interface; see 'writer.h'.
+ *
+ * @author Oliver Dixon
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "writer.h"
+
+/**
+ * The default capacity of the buffer, in bytes
+ */
+#define WRITER_CAPACITY ( 1U << 16 )
+
+/**
+ * The largest number of bytes occupied by a formatted number, including its
+ * new-line and the NULL-terminator written by snprintf(3)
+ */
+#define WRITER_NUMBER_SIZE ( NUMBER_FORMAT_SIZE + 1 )
+
+/**
+ * The transparent writer
+ */
+struct writer {
+    /**
+     * The destination file descriptor
+     */
+    int fd;
+
+    /**
+     * The capacity of the buffer
+     */
+    size_t capacity;
+
+    /**
+     * The number of bytes currently buffered
+     */
+    size_t used;
+
+    /**
+     * The buffer
+     */
+    char * data;
+};
+
+/**
+ * Write all of the given bytes to a file descriptor, retrying after partial
+ * writes and interruptions.
+ *
+ * @param fd the file descriptor
+ * @param data the bytes
+ * @param length the number of bytes
+ * @return zero on success, or -1 on failure
+ */
+static int write_all ( int fd, const char * data, size_t length )
+{
+    ssize_t written;
+
+    while ( length )
+        if ( ( written = write ( fd, data, length ) ) < 0 ) {
+            if ( errno != EINTR )
+                return -1;
+        } else {
+            data += written;
+            length -= ( size_t ) written;
+        }
+
+    return 0;
+}
+
+/**
+ * Ensure that the given number of bytes can be appended to the buffer. A writer
+ * over a file descriptor is flushed to make room; a writer over memory has its
+ * buffer grown instead.
+ *
+ * @param self the writer
+ * @param length the number of bytes
+ * @return zero on success, or -1 on failure
+ */
+static int make_room ( struct writer * self, size_t length )
+{
+    size_t capacity = self->capacity;
+    char * data;
+
+    if ( self->used + length <= capacity )
+        return 0;
+
+    if ( self->fd != WRITER_MEMORY )
+        return writer_flush ( self );
+
+    while ( self->used + length > capacity )
+        capacity <<= 1;
+
+    if ( ! ( data = realloc ( self->data, capacity ) ) )
+        return -1;
+
+    self->data = data;
+    self->capacity = capacity;
+
+    return 0;
+}
+
+struct writer * writer_initialise ( int fd, size_t capacity )
+{
+    struct writer * self;
+
+    if ( !capacity )
+        capacity = WRITER_CAPACITY;
+
+    /* The buffer must at least hold one number, which is formatted in place */
+    if ( capacity < WRITER_NUMBER_SIZE )
+        capacity = WRITER_NUMBER_SIZE;
+
+    if ( ( self = malloc ( sizeof ( struct writer ) ) ) ) {
+        if ( ! ( self->data = malloc ( capacity ) ) ) {
+            free ( self );
+            return NULL;
+        }
+
+        self->fd = fd;
+        self->capacity = capacity;
+        self->used = 0;
+        debug_puts ( "Writer initialised" );
+    }
+
+    return self;
+}
+
+void writer_destruct ( struct writer * self )
+{
+    if ( self ) {
+        free ( self->data );
+        free ( self );
+        debug_puts ( "Writer destructed" );
+    }
+}
+
+int writer_flush ( struct writer * self )
+{
+    const size_t used = self->used;
+
+    if ( self->fd == WRITER_MEMORY )
+        return 0;
+
+    self->used = 0;
+    return write_all ( self->fd, self->data, used );
+}
+
+int writer_write ( struct writer * self, const char * data, size_t length )
+{
+    if ( make_room ( self, length ) )
+        return -1;
+
+    /* Anything too large to buffer is written straight through */
+    if ( length > self->capacity - self->used )
+        return write_all ( self->fd, data, length );
+
+    memcpy ( & ( self->data [ self->used ] ), data, length );
+    self->used += length;
+
+    return 0;
+}
+
+int writer_number ( struct writer * self, number_t value )
+{
+    if ( make_room ( self, WRITER_NUMBER_SIZE ) )
+        return -1;
+
+    self->used += number_format ( & ( self->data [ self->used ] ),
+        NUMBER_FORMAT_SIZE, value );
+    self->data [ self->used++ ] = '\n';
+
+    return 0;
+}
+
+int writer_append ( struct writer * self, struct writer * source )
+{
+    const size_t used = source->used;
+
+    source->used = 0;
+    return writer_write ( self, source->data, used );
+}
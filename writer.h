@@ -0,0 +1,91 @@
+/**
+ * This interface exposes a buffered writer for bulk output. Text is gathered in
+ * a fixed-size buffer and passed to the operating system with write(2) only
+ * when the buffer fills, or when the writer is flushed, so that millions of
+ * short results cost a few thousand system calls rather than millions.
+ *
+ * A writer may instead be made over memory, in which case its buffer grows to
+ * hold everything written to it, until the contents are appended to another
+ * writer. Threads that produce output in parallel each write to their own
+ * memory writer, and the results are then appended to a shared writer in order.
+ *
+ * @author Oliver Dixon
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+
+#include "node.h"
+
+/**
+ * The base opaque type of a writer
+ */
+struct writer;
+
+/**
+ * The pseudo-file-descriptor that makes a writer over memory
+ */
+#define WRITER_MEMORY ( -1 )
+
+/**
+ * Initialise a writer over the given file descriptor, with the given buffer
+ * capacity. If this function fails, then 'errno' is set appropriately.
+ *
+ * @param fd the destination file descriptor, or WRITER_MEMORY; a descriptor is
+ *      not closed by the writer
+ * @param capacity the capacity of the buffer in bytes, or zero for the default
+ * @return the new writer, or NULL on failure
+ */
+struct writer * writer_initialise ( int fd, size_t capacity );
+
+/**
+ * Destruct a writer. Any buffered text is discarded, so callers should flush
+ * the writer first.
+ *
+ * @param self the writer to be destructed
+ */
+void writer_destruct ( struct writer * self );
+
+/**
+ * Append the given bytes to the writer.
+ *
+ * @param self the writer
+ * @param data the bytes
+ * @param length the number of bytes
+ * @return zero on success, or -1 on failure, with 'errno' set by write(2)
+ */
+int writer_write ( struct writer * self, const char * data, size_t length );
+
+/**
+ * Append the textual form of the given number, followed by a new-line, to the
+ * writer. The number is formatted as by the "%g" printf(3) conversion.
+ *
+ * @param self the writer
+ * @param value the number
+ * @return zero on success, or -1 on failure, with 'errno' set by write(2)
+ */
+int writer_number ( struct writer * self, number_t value );
+
+/**
+ * Pass all buffered text to the operating system. This does nothing to a
+ * writer over memory.
+ *
+ * @param self the writer
+ * @return zero on success, or -1 on failure, with 'errno' set by write(2)
+ */
+int writer_flush ( struct writer * self );
+
+/**
+ * Append the contents of a writer over memory to another writer, emptying the
+ * former. The capacity of the source is retained, so it may be refilled without
+ * reallocation.
+ *
+ * @param self the destination writer
+ * @param source the writer over memory whose contents are to be appended
+ * @return zero on success, or -1 on failure, with 'errno' set by write(2)
+ */
+int writer_append ( struct writer * self, struct writer * source );
+
+#endif /* WRITER_H */